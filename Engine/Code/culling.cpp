@@ -0,0 +1,246 @@
+//
+// culling.cpp : View frustum extraction and bounding volume tests (see culling.h).
+//
+
+#include "culling.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#else
+#include <xmmintrin.h>
+#endif
+
+#define ATTRIBUTE_POSITION 0
+
+Frustum ExtractFrustum(const glm::mat4& viewProjection)
+{
+    // glm is column major, row i of the matrix is (m[0][i], m[1][i], m[2][i], m[3][i])
+    const glm::mat4& m = viewProjection;
+    vec4 row0 = vec4(m[0][0], m[1][0], m[2][0], m[3][0]);
+    vec4 row1 = vec4(m[0][1], m[1][1], m[2][1], m[3][1]);
+    vec4 row2 = vec4(m[0][2], m[1][2], m[2][2], m[3][2]);
+    vec4 row3 = vec4(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+    Frustum frustum;
+    frustum.planes[FrustumPlane_Left]   = row3 + row0;
+    frustum.planes[FrustumPlane_Right]  = row3 - row0;
+    frustum.planes[FrustumPlane_Bottom] = row3 + row1;
+    frustum.planes[FrustumPlane_Top]    = row3 - row1;
+    frustum.planes[FrustumPlane_Near]   = row3 + row2;
+    frustum.planes[FrustumPlane_Far]    = row3 - row2;
+
+    for (u32 i = 0; i < FrustumPlane_Count; ++i)
+        frustum.planes[i] /= glm::length(vec3(frustum.planes[i]));
+
+    return frustum;
+}
+
+bool IsSphereInFrustum(const Frustum& frustum, vec3 center, f32 radius)
+{
+    for (u32 i = 0; i < FrustumPlane_Count; ++i)
+    {
+        const vec4& plane = frustum.planes[i];
+        if (glm::dot(vec3(plane), center) + plane.w < -radius)
+            return false;
+    }
+    return true;
+}
+
+void ComputeSubmeshBounds(Submesh& submesh)
+{
+    const u32 stride = submesh.vertexBufferLayout.stride / sizeof(float);
+    u32 positionOffset = UINT32_MAX;
+    for (u32 i = 0; i < submesh.vertexBufferLayout.attributes.size(); ++i)
+        if (submesh.vertexBufferLayout.attributes[i].location == ATTRIBUTE_POSITION)
+            positionOffset = submesh.vertexBufferLayout.attributes[i].offset / sizeof(float);
+    if (stride == 0 || positionOffset == UINT32_MAX || submesh.vertices.empty())
+        return;
+
+    const u32 vertexCount = (u32)submesh.vertices.size() / stride;
+    vec3 boundsMin = vec3(FLT_MAX);
+    vec3 boundsMax = vec3(-FLT_MAX);
+    for (u32 v = 0; v < vertexCount; ++v)
+    {
+        const float* position = &submesh.vertices[v * stride + positionOffset];
+        boundsMin = glm::min(boundsMin, vec3(position[0], position[1], position[2]));
+        boundsMax = glm::max(boundsMax, vec3(position[0], position[1], position[2]));
+    }
+
+    // Tighter than the half diagonal whenever the corners of the box are empty
+    vec3 center = (boundsMin + boundsMax) * 0.5f;
+    f32 radiusSquared = 0.0f;
+    for (u32 v = 0; v < vertexCount; ++v)
+    {
+        const float* position = &submesh.vertices[v * stride + positionOffset];
+        vec3 offset = vec3(position[0], position[1], position[2]) - center;
+        radiusSquared = glm::max(radiusSquared, glm::dot(offset, offset));
+    }
+
+    submesh.boundsCenter = center;
+    submesh.boundsExtent = (boundsMax - boundsMin) * 0.5f;
+    submesh.boundsRadius = sqrtf(radiusSquared);
+}
+
+static void TransformBounds(CullingScene& scene, u32 entry, const glm::mat4& modelMat, const Submesh& submesh)
+{
+    // Each world axis of the new box takes the absolute contribution of every local axis
+    vec3 center = vec3(modelMat * vec4(submesh.boundsCenter, 1.0f));
+    vec3 extent = glm::abs(vec3(modelMat[0])) * submesh.boundsExtent.x +
+                  glm::abs(vec3(modelMat[1])) * submesh.boundsExtent.y +
+                  glm::abs(vec3(modelMat[2])) * submesh.boundsExtent.z;
+    f32 scale = glm::max(glm::length(vec3(modelMat[0])), glm::max(glm::length(vec3(modelMat[1])), glm::length(vec3(modelMat[2]))));
+
+    scene.centerX[entry] = center.x;
+    scene.centerY[entry] = center.y;
+    scene.centerZ[entry] = center.z;
+    scene.extentX[entry] = extent.x;
+    scene.extentY[entry] = extent.y;
+    scene.extentZ[entry] = extent.z;
+    scene.radius[entry] = submesh.boundsRadius * scale;
+}
+
+void UpdateCullingScene(App* app)
+{
+    CullingScene& scene = app->cullingScene;
+    const u32 objectCount = (u32)app->sceneObjects.size();
+
+    bool relayout = scene.dirty || scene.firstEntry.size() != objectCount;
+    if (relayout)
+    {
+        scene.firstEntry.resize(objectCount);
+        scene.transforms.resize(objectCount);
+        u32 entryCount = 0;
+        for (u32 a = 0; a < objectCount; ++a)
+        {
+            const Objects* object = app->sceneObjects[a];
+            scene.firstEntry[a] = entryCount;
+            entryCount += (u32)app->meshes[app->models[object->meshID].meshIdx].submeshes.size();
+        }
+
+        // Padding entries are tested with the rest but never read back
+        const u32 paddedCount = (entryCount + CULLING_BATCH_SIZE - 1) / CULLING_BATCH_SIZE * CULLING_BATCH_SIZE;
+        scene.centerX.assign(paddedCount, 0.0f);
+        scene.centerY.assign(paddedCount, 0.0f);
+        scene.centerZ.assign(paddedCount, 0.0f);
+        scene.extentX.assign(paddedCount, 0.0f);
+        scene.extentY.assign(paddedCount, 0.0f);
+        scene.extentZ.assign(paddedCount, 0.0f);
+        scene.radius.assign(paddedCount, 0.0f);
+        scene.visible.assign(paddedCount, 1);
+        scene.entryCount = entryCount;
+        scene.layoutVersion++;
+        scene.dirty = false;
+    }
+
+    scene.movedObjects.clear();
+
+    for (u32 a = 0; a < objectCount; ++a)
+    {
+        const Objects* object = app->sceneObjects[a];
+        if (!relayout && scene.transforms[a] == object->modelMat)
+            continue;
+
+        const Mesh& mesh = app->meshes[app->models[object->meshID].meshIdx];
+        for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+            TransformBounds(scene, scene.firstEntry[a] + i, object->modelMat, mesh.submeshes[i]);
+        scene.transforms[a] = object->modelMat;
+        scene.movedObjects.push_back(a);
+    }
+}
+
+u32 CullScene(CullingScene& scene, const Frustum& frustum)
+{
+    const u32 paddedCount = (u32)scene.centerX.size();
+
+    // A bound is outside a plane when its center is further behind it than the smaller of
+    // the sphere radius and the box extent projected on the plane normal
+#if defined(__AVX__)
+    __m256 planeX[FrustumPlane_Count], planeY[FrustumPlane_Count], planeZ[FrustumPlane_Count], planeW[FrustumPlane_Count];
+    __m256 absX[FrustumPlane_Count], absY[FrustumPlane_Count], absZ[FrustumPlane_Count];
+    for (u32 p = 0; p < FrustumPlane_Count; ++p)
+    {
+        const vec4& plane = frustum.planes[p];
+        planeX[p] = _mm256_set1_ps(plane.x);
+        planeY[p] = _mm256_set1_ps(plane.y);
+        planeZ[p] = _mm256_set1_ps(plane.z);
+        planeW[p] = _mm256_set1_ps(plane.w);
+        absX[p] = _mm256_set1_ps(fabsf(plane.x));
+        absY[p] = _mm256_set1_ps(fabsf(plane.y));
+        absZ[p] = _mm256_set1_ps(fabsf(plane.z));
+    }
+
+    const __m256 zero = _mm256_setzero_ps();
+    for (u32 i = 0; i < paddedCount; i += 8)
+    {
+        __m256 centerX = _mm256_loadu_ps(&scene.centerX[i]);
+        __m256 centerY = _mm256_loadu_ps(&scene.centerY[i]);
+        __m256 centerZ = _mm256_loadu_ps(&scene.centerZ[i]);
+        __m256 extentX = _mm256_loadu_ps(&scene.extentX[i]);
+        __m256 extentY = _mm256_loadu_ps(&scene.extentY[i]);
+        __m256 extentZ = _mm256_loadu_ps(&scene.extentZ[i]);
+        __m256 radius = _mm256_loadu_ps(&scene.radius[i]);
+
+        __m256 inside = _mm256_cmp_ps(zero, zero, _CMP_EQ_OQ);
+        for (u32 p = 0; p < FrustumPlane_Count; ++p)
+        {
+            __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planeX[p], centerX), _mm256_mul_ps(planeY[p], centerY)),
+                                            _mm256_add_ps(_mm256_mul_ps(planeZ[p], centerZ), planeW[p]));
+            __m256 boxRadius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(absX[p], extentX), _mm256_mul_ps(absY[p], extentY)),
+                                             _mm256_mul_ps(absZ[p], extentZ));
+            __m256 reach = _mm256_min_ps(radius, boxRadius);
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, reach), zero, _CMP_GE_OQ));
+        }
+
+        u32 mask = (u32)_mm256_movemask_ps(inside);
+        for (u32 k = 0; k < 8; ++k)
+            scene.visible[i + k] = (mask >> k) & 1;
+    }
+#else
+    __m128 planeX[FrustumPlane_Count], planeY[FrustumPlane_Count], planeZ[FrustumPlane_Count], planeW[FrustumPlane_Count];
+    __m128 absX[FrustumPlane_Count], absY[FrustumPlane_Count], absZ[FrustumPlane_Count];
+    for (u32 p = 0; p < FrustumPlane_Count; ++p)
+    {
+        const vec4& plane = frustum.planes[p];
+        planeX[p] = _mm_set1_ps(plane.x);
+        planeY[p] = _mm_set1_ps(plane.y);
+        planeZ[p] = _mm_set1_ps(plane.z);
+        planeW[p] = _mm_set1_ps(plane.w);
+        absX[p] = _mm_set1_ps(fabsf(plane.x));
+        absY[p] = _mm_set1_ps(fabsf(plane.y));
+        absZ[p] = _mm_set1_ps(fabsf(plane.z));
+    }
+
+    const __m128 zero = _mm_setzero_ps();
+    for (u32 i = 0; i < paddedCount; i += 4)
+    {
+        __m128 centerX = _mm_loadu_ps(&scene.centerX[i]);
+        __m128 centerY = _mm_loadu_ps(&scene.centerY[i]);
+        __m128 centerZ = _mm_loadu_ps(&scene.centerZ[i]);
+        __m128 extentX = _mm_loadu_ps(&scene.extentX[i]);
+        __m128 extentY = _mm_loadu_ps(&scene.extentY[i]);
+        __m128 extentZ = _mm_loadu_ps(&scene.extentZ[i]);
+        __m128 radius = _mm_loadu_ps(&scene.radius[i]);
+
+        __m128 inside = _mm_cmpeq_ps(zero, zero);
+        for (u32 p = 0; p < FrustumPlane_Count; ++p)
+        {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], centerX), _mm_mul_ps(planeY[p], centerY)),
+                                         _mm_add_ps(_mm_mul_ps(planeZ[p], centerZ), planeW[p]));
+            __m128 boxRadius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(absX[p], extentX), _mm_mul_ps(absY[p], extentY)),
+                                          _mm_mul_ps(absZ[p], extentZ));
+            __m128 reach = _mm_min_ps(radius, boxRadius);
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, reach), zero));
+        }
+
+        u32 mask = (u32)_mm_movemask_ps(inside);
+        for (u32 k = 0; k < 4; ++k)
+            scene.visible[i + k] = (mask >> k) & 1;
+    }
+#endif
+
+    u32 visibleCount = 0;
+    for (u32 i = 0; i < scene.entryCount; ++i)
+        visibleCount += scene.visible[i];
+    scene.visibleCount = visibleCount;
+    return visibleCount;
+}
@@ -0,0 +1,59 @@
+//
+// culling.h: View frustum extraction and bounding volume tests.
+//
+// Scene objects are culled per submesh against the camera frustum before they reach the
+// render queue. Their world bounds live in a CullingScene and are only recomputed when the
+// model matrix of the object changes. The kernel tests CULLING_BATCH_SIZE bounds at once,
+// 8 with AVX and 4 with SSE.
+//
+
+#pragma once
+#include "engine.h"
+
+#if defined(__AVX__)
+#define CULLING_BATCH_SIZE 8
+#else
+#define CULLING_BATCH_SIZE 4
+#endif
+
+enum FrustumPlane
+{
+    FrustumPlane_Left,
+    FrustumPlane_Right,
+    FrustumPlane_Bottom,
+    FrustumPlane_Top,
+    FrustumPlane_Near,
+    FrustumPlane_Far,
+    FrustumPlane_Count
+};
+
+struct Frustum
+{
+    vec4 planes[FrustumPlane_Count]; // xyz = inward normal, w = distance, normalized
+};
+
+/**
+ * Extracts the planes of the frustum of a view projection matrix (Gribb/Hartmann).
+ * With a view projection the planes are in world space, with a model view projection
+ * they are in the object space of that model.
+ */
+Frustum ExtractFrustum(const glm::mat4& viewProjection);
+
+bool IsSphereInFrustum(const Frustum& frustum, vec3 center, f32 radius);
+
+/**
+ * Object space box and sphere of a submesh with the float layout of the importers.
+ */
+void ComputeSubmeshBounds(Submesh& submesh);
+
+/**
+ * Lays the entries out again when the scene is dirty and transforms the bounds of the
+ * objects whose model matrix changed since the last call, which end up in movedObjects.
+ */
+void UpdateCullingScene(App* app);
+
+/**
+ * Fills scene.visible, an entry is visible when both its sphere and its box intersect the
+ * frustum. Returns the number of visible entries.
+ */
+u32 CullScene(CullingScene& scene, const Frustum& frustum);
@@ -0,0 +1,67 @@
+//
+// depthpyramid.cpp : Hierarchical depth for occlusion culling (see depthpyramid.h).
+//
+
+#include "depthpyramid.h"
+#include "programreflection.h"
+
+static u32 PreviousPowerOfTwo(u32 value)
+{
+    u32 power = 1;
+    while (power * 2 <= value)
+        power *= 2;
+    return power;
+}
+
+void CreateDepthPyramid(DepthPyramid& pyramid, ivec2 sourceSize)
+{
+    pyramid.sourceSize = sourceSize;
+    pyramid.size = ivec2(PreviousPowerOfTwo(glm::max(sourceSize.x, 1)), PreviousPowerOfTwo(glm::max(sourceSize.y, 1)));
+    pyramid.levelCount = 1;
+    while ((1 << pyramid.levelCount) <= glm::max(pyramid.size.x, pyramid.size.y))
+        pyramid.levelCount++;
+
+    glGenTextures(1, &pyramid.texture);
+    glBindTexture(GL_TEXTURE_2D, pyramid.texture);
+    glTexStorage2D(GL_TEXTURE_2D, pyramid.levelCount, GL_R32F, pyramid.size.x, pyramid.size.y);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void DestroyDepthPyramid(DepthPyramid& pyramid)
+{
+    glDeleteTextures(1, &pyramid.texture);
+    pyramid.texture = 0;
+}
+
+ivec2 GetDepthPyramidLevelSize(const DepthPyramid& pyramid, u32 level)
+{
+    return glm::max(ivec2(pyramid.size.x >> level, pyramid.size.y >> level), ivec2(1));
+}
+
+void BuildDepthPyramid(App* app, GLuint depthTexture)
+{
+    DepthPyramid& pyramid = app->depthPyramid;
+    Program& program = app->programs[pyramid.buildProgramIdx];
+    glUseProgram(program.handle);
+    glActiveTexture(GL_TEXTURE0);
+
+    // Level 0 reads the depth buffer, every other level the one above it in the pyramid
+    for (u32 level = 0; level < pyramid.levelCount; ++level)
+    {
+        glBindTexture(GL_TEXTURE_2D, level == 0 ? depthTexture : pyramid.texture);
+        glUniform1i(GetProgramUniform(program, ProgramUniform_SourceLevel), level == 0 ? 0 : level - 1);
+        glBindImageTexture(0, pyramid.texture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+        ivec2 size = GetDepthPyramidLevelSize(pyramid, level);
+        glDispatchCompute((size.x + DEPTH_PYRAMID_GROUP_SIZE - 1) / DEPTH_PYRAMID_GROUP_SIZE, (size.y + DEPTH_PYRAMID_GROUP_SIZE - 1) / DEPTH_PYRAMID_GROUP_SIZE, 1);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    }
+
+    glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glUseProgram(0);
+}
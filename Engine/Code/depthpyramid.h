@@ -0,0 +1,26 @@
+//
+// depthpyramid.h: Hierarchical depth (Hi-Z) of the G-buffer for occlusion culling. Each
+// texel of a level holds the farthest depth of the texels it covers in the level above,
+// so a bounding volume whose nearest depth is farther than the texels under its screen
+// rectangle is hidden. Level 0 is the largest power of two size that fits in the depth
+// buffer, its texels take the maximum of every depth texel they overlap.
+//
+// The pyramid is built by the DEPTH_PYRAMID compute shader of gpuculling.glsl, one
+// dispatch per level. See gpudriven.h for how the culling uses it.
+//
+
+#pragma once
+#include "engine.h"
+
+#define DEPTH_PYRAMID_GROUP_SIZE 8 // local_size_x and local_size_y of the build shader
+
+void CreateDepthPyramid(DepthPyramid& pyramid, ivec2 sourceSize);
+void DestroyDepthPyramid(DepthPyramid& pyramid);
+
+ivec2 GetDepthPyramidLevelSize(const DepthPyramid& pyramid, u32 level);
+
+/**
+ * Reduces depthTexture, of pyramid.sourceSize texels, into every level of the pyramid.
+ * Leaves it ready to be fetched by the next dispatch.
+ */
+void BuildDepthPyramid(App* app, GLuint depthTexture);
@@ -6,6 +6,28 @@
 //
 
 #include "engine.h"
+#include "meshcook.h"
+#include "texturecook.h"
+#include "textureregistry.h"
+#include "vertexformat.h"
+#include "meshlet.h"
+#include "culling.h"
+#include "scenebvh.h"
+#include "simplify.h"
+#include "meshoptimize.h"
+#include "geometryarena.h"
+#include "objimport.h"
+#include "renderqueue.h"
+#include "programreflection.h"
+#include "vaocache.h"
+#include "instancing.h"
+#include "gpudriven.h"
+#include "depthpyramid.h"
+#include "lighting.h"
+#include "lightvolumes.h"
+#include "ssao.h"
+#include "gtao.h"
+#include "loader.h"
 #include <imgui.h>
 ////////////////////////////////////////
 bool IsPowerOf2(u32 value)
@@ -60,12 +82,149 @@ void AlignHead(Buffer& buffer, u32 alignment)
     buffer.head = Align(buffer.head, alignment);
 }
 
-void PushAlignedData(Buffer& buffer, const void* data, u32 size, u32 alignment)
+// Returns false and writes nothing when the data does not fit, ring buffers grow before
+// their next frame then
+bool PushAlignedData(Buffer& buffer, const void* data, u32 size, u32 alignment)
 {
     ASSERT(buffer.data != NULL, "The buffer must be mapped first");
     AlignHead(buffer, alignment);
+    if ((u64)buffer.head + size > (buffer.frameSize ? buffer.frameSize : buffer.size))
+    {
+        buffer.overflowSize += size + alignment;
+        return false;
+    }
     memcpy((u8*)buffer.data + buffer.head, data, size);
     buffer.head += size;
+    return true;
+}
+
+// GL 4.4 and GL_ARB_buffer_storage, above what the loader provides
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT   0x0080
+typedef void (APIENTRYP PFNGLBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+#endif
+static PFNGLBUFFERSTORAGEPROC BufferStorage = NULL;
+
+// Without buffer storage every frame maps its region unsynchronized, the fences keep that safe
+Buffer CreateRingBuffer(u32 frameSize, GLenum type)
+{
+    Buffer buffer = {};
+    buffer.frameSize = frameSize;
+    buffer.size = frameSize * BUFFER_RING_FRAMES;
+    buffer.type = type;
+
+    glGenBuffers(1, &buffer.handle);
+    glBindBuffer(type, buffer.handle);
+    if (BufferStorage)
+    {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        BufferStorage(type, buffer.size, NULL, flags);
+        buffer.persistentData = (u8*)glMapBufferRange(type, 0, buffer.size, flags);
+    }
+    else
+    {
+        glBufferData(type, buffer.size, NULL, GL_STREAM_DRAW);
+    }
+    glBindBuffer(type, 0);
+
+    return buffer;
+}
+
+void DestroyRingBuffer(Buffer& buffer)
+{
+    for (u32 i = 0; i < BUFFER_RING_FRAMES; ++i)
+        if (buffer.fences[i])
+            glDeleteSync(buffer.fences[i]);
+    if (buffer.persistentData)
+    {
+        glBindBuffer(buffer.type, buffer.handle);
+        glUnmapBuffer(buffer.type);
+        glBindBuffer(buffer.type, 0);
+    }
+    glDeleteBuffers(1, &buffer.handle);
+    buffer = {};
+}
+
+// Recreates the ring with regions that fit the last frame, once the GPU is done with all of them
+static void GrowRingBuffer(Buffer& buffer)
+{
+    u32 frameSize = buffer.frameSize;
+    while (frameSize < buffer.frameSize + buffer.overflowSize)
+        frameSize *= 2;
+
+    for (u32 i = 0; i < BUFFER_RING_FRAMES; ++i)
+    {
+        if (!buffer.fences[i])
+            continue;
+        GLenum result = glClientWaitSync(buffer.fences[i], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        while (result == GL_TIMEOUT_EXPIRED)
+            result = glClientWaitSync(buffer.fences[i], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+    }
+
+    ILOG("Ring buffer regions grown from %u to %u bytes", buffer.frameSize, frameSize);
+    GLenum type = buffer.type;
+    DestroyRingBuffer(buffer);
+    buffer = CreateRingBuffer(frameSize, type);
+}
+
+/**
+ * Waits until the GPU is done with the region of this frame, which only happens when it
+ * is BUFFER_RING_FRAMES frames behind, and makes it writable from offset 0.
+ */
+void BeginRingBufferFrame(Buffer& buffer)
+{
+    if (buffer.overflowSize > 0)
+        GrowRingBuffer(buffer);
+
+    GLsync& fence = buffer.fences[buffer.frameIndex];
+    if (fence)
+    {
+        GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        while (result == GL_TIMEOUT_EXPIRED)
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+        glDeleteSync(fence);
+        fence = NULL;
+    }
+
+    const u32 regionOffset = buffer.frameIndex * buffer.frameSize;
+    if (buffer.persistentData)
+    {
+        buffer.data = buffer.persistentData + regionOffset;
+    }
+    else
+    {
+        glBindBuffer(buffer.type, buffer.handle);
+        buffer.data = (u8*)glMapBufferRange(buffer.type, regionOffset, buffer.frameSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        glBindBuffer(buffer.type, 0);
+    }
+    buffer.head = 0;
+}
+
+// Draws may not read a buffer while it is mapped, unless the mapping is persistent
+void EndRingBufferWrites(Buffer& buffer)
+{
+    if (!buffer.persistentData && buffer.data)
+    {
+        glBindBuffer(buffer.type, buffer.handle);
+        glUnmapBuffer(buffer.type);
+        glBindBuffer(buffer.type, 0);
+    }
+    buffer.data = NULL;
+}
+
+// After the last command reading this frame's region
+void FenceRingBufferFrame(Buffer& buffer)
+{
+    EndRingBufferWrites(buffer);
+    buffer.fences[buffer.frameIndex] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    buffer.frameIndex = (buffer.frameIndex + 1) % BUFFER_RING_FRAMES;
+}
+
+// Offset of the head in the whole buffer, what glBindBufferRange expects
+u32 GetBufferOffset(const Buffer& buffer)
+{
+    return buffer.frameIndex * buffer.frameSize + buffer.head;
 }
 
 #define PushData(buffer, data, size) PushAlignedData(buffer, data, size, 1)
@@ -163,13 +322,13 @@ void ProcessAssimpMesh(const aiScene* scene, aiMesh* mesh, Mesh* myMesh, u32 bas
     myMesh->submeshes.push_back(submesh);
 }
 
-void ProcessAssimpMaterial(App* app, aiMaterial* material, Material& myMaterial, String directory)
+void ProcessAssimpMaterial(aiMaterial* material, MaterialImport& myMaterial)
 {
     aiString name;
     aiColor3D diffuseColor;
     aiColor3D emissiveColor;
     aiColor3D specularColor;
-    ai_real shininess;
+    ai_real shininess = 0;
     material->Get(AI_MATKEY_NAME, name);
     material->Get(AI_MATKEY_COLOR_DIFFUSE, diffuseColor);
     material->Get(AI_MATKEY_COLOR_EMISSIVE, emissiveColor);
@@ -181,41 +340,23 @@ void ProcessAssimpMaterial(App* app, aiMaterial* material, Material& myMaterial,
     myMaterial.emissive = vec3(emissiveColor.r, emissiveColor.g, emissiveColor.b);
     myMaterial.smoothness = shininess / 256.0f;
 
+    // only the file names are stored here, textures are loaded when the model is created
+    const aiTextureType textureTypes[MaterialTexture_Count] = {
+        aiTextureType_DIFFUSE,
+        aiTextureType_EMISSIVE,
+        aiTextureType_SPECULAR,
+        aiTextureType_NORMALS,
+        aiTextureType_HEIGHT
+    };
+
     aiString aiFilename;
-    if (material->GetTextureCount(aiTextureType_DIFFUSE) > 0)
-    {
-        material->GetTexture(aiTextureType_DIFFUSE, 0, &aiFilename);
-        String filename = MakeString(aiFilename.C_Str());
-        String filepath = MakePath(directory, filename);
-        myMaterial.albedoTextureIdx = LoadTexture2D(app, filepath.str);
-    }
-    if (material->GetTextureCount(aiTextureType_EMISSIVE) > 0)
-    {
-        material->GetTexture(aiTextureType_EMISSIVE, 0, &aiFilename);
-        String filename = MakeString(aiFilename.C_Str());
-        String filepath = MakePath(directory, filename);
-        myMaterial.emissiveTextureIdx = LoadTexture2D(app, filepath.str);
-    }
-    if (material->GetTextureCount(aiTextureType_SPECULAR) > 0)
-    {
-        material->GetTexture(aiTextureType_SPECULAR, 0, &aiFilename);
-        String filename = MakeString(aiFilename.C_Str());
-        String filepath = MakePath(directory, filename);
-        myMaterial.specularTextureIdx = LoadTexture2D(app, filepath.str);
-    }
-    if (material->GetTextureCount(aiTextureType_NORMALS) > 0)
+    for (u32 slot = 0; slot < MaterialTexture_Count; ++slot)
     {
-        material->GetTexture(aiTextureType_NORMALS, 0, &aiFilename);
-        String filename = MakeString(aiFilename.C_Str());
-        String filepath = MakePath(directory, filename);
-        myMaterial.normalsTextureIdx = LoadTexture2D(app, filepath.str);
-    }
-    if (material->GetTextureCount(aiTextureType_HEIGHT) > 0)
-    {
-        material->GetTexture(aiTextureType_HEIGHT, 0, &aiFilename);
-        String filename = MakeString(aiFilename.C_Str());
-        String filepath = MakePath(directory, filename);
-        myMaterial.bumpTextureIdx = LoadTexture2D(app, filepath.str);
+        if (material->GetTextureCount(textureTypes[slot]) > 0)
+        {
+            material->GetTexture(textureTypes[slot], 0, &aiFilename);
+            myMaterial.textures[slot] = aiFilename.C_Str();
+        }
     }
 
     //myMaterial.createNormalFromBump();
@@ -237,7 +378,7 @@ void ProcessAssimpNode(const aiScene* scene, aiNode* node, Mesh* myMesh, u32 bas
     }
 }
 
-u32 LoadModel(App* app, const char* filename)
+bool ImportModelAssimp(const char* filename, ModelImport& model)
 {
     const aiScene* scene = aiImportFile(filename,
         aiProcess_Triangulate |
@@ -245,82 +386,385 @@ u32 LoadModel(App* app, const char* filename)
         aiProcess_CalcTangentSpace |
         aiProcess_JoinIdenticalVertices |
         aiProcess_PreTransformVertices |
-        aiProcess_ImproveCacheLocality |
         aiProcess_OptimizeMeshes |
         aiProcess_SortByPType);
 
-    /* if (!scene)
-     {
-         ELOG("Error loading mesh %s: %s", filename, aiGetErrorString());
-         return UINT32_MAX;
-     }*/
+    if (!scene)
+    {
+        ELOG("Error loading mesh %s: %s", filename, aiGetErrorString());
+        return false;
+    }
+
+    // Create a list of materials
+    model.materials.resize(scene->mNumMaterials);
+    for (unsigned int i = 0; i < scene->mNumMaterials; ++i)
+    {
+        ProcessAssimpMaterial(scene->mMaterials[i], model.materials[i]);
+    }
+
+    ProcessAssimpNode(scene, scene->mRootNode, &model.mesh, 0, model.submeshMaterialIndices);
+
+    aiReleaseImport(scene);
+
+    ProcessModelImport(model, filename);
+    return true;
+}
 
+// OBJ files go through the dedicated parallel importer, everything else through Assimp
+bool ImportModel(const char* filename, ModelImport& model)
+{
+    size_t length = strlen(filename);
+    if (length > 4 && tolower(filename[length - 3]) == 'o' && tolower(filename[length - 2]) == 'b' &&
+        tolower(filename[length - 1]) == 'j' && filename[length - 4] == '.')
+        return ImportModelObj(filename, model);
+
+    return ImportModelAssimp(filename, model);
+}
+
+// Engine side processing of an imported model, before it is cooked or uploaded.
+// Works on the float layout of the importers.
+void ProcessModelImport(ModelImport& model, const char* name)
+{
+    VertexCacheStats before = {};
+    VertexCacheStats after = {};
+
+    for (u32 i = 0; i < model.mesh.submeshes.size(); ++i)
+    {
+        Submesh& submesh = model.mesh.submeshes[i];
+        const u32 stride = submesh.vertexBufferLayout.stride / sizeof(float);
+        if (stride == 0 || submesh.indices.empty())
+            continue;
+
+        AccumulateVertexCacheStats(before, AnalyzeVertexCache(submesh.indices.data(), (u32)submesh.indices.size(), (u32)submesh.vertices.size() / stride));
+
+        OptimizeSubmesh(submesh);
+        ComputeSubmeshBounds(submesh);
+        BuildMeshlets(submesh);
+        BuildLods(submesh);
+
+        // Meshlets and LODs reorder triangles, restore the cache order inside their ranges
+        const u32 vertexCount = (u32)submesh.vertices.size() / stride;
+        std::vector<u32> remap(vertexCount, UINT32_MAX);
+        for (u32 m = 0; m < submesh.meshlets.size(); ++m)
+            OptimizeVertexCacheRange(&submesh.indices[submesh.meshlets[m].indexOffset], submesh.meshlets[m].indexCount, remap);
+        for (u32 l = 1; l < submesh.lods.size(); ++l)
+            OptimizeVertexCacheRange(&submesh.indices[submesh.lods[l].indexOffset], submesh.lods[l].indexCount, remap);
+
+        AccumulateVertexCacheStats(after, AnalyzeVertexCache(submesh.indices.data(), submesh.lods.empty() ? (u32)submesh.indices.size() : submesh.lods[0].indexCount, vertexCount));
+    }
+
+    if (before.triangleCount > 0 && before.vertexCount > 0)
+    {
+        ILOG("%s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f", name, before.acmr, after.acmr, before.atvr, after.atvr);
+    }
+}
+
+u32 CreateMaterial(App* app, const MaterialImport& materialImport, String directory, bool async)
+{
+    Material material = {};
+    material.name = materialImport.name;
+    material.albedo = materialImport.albedo;
+    material.emissive = materialImport.emissive;
+    material.smoothness = materialImport.smoothness;
+    material.albedoTextureIdx = app->whiteTexIdx;
+    material.emissiveTextureIdx = app->blackTexIdx;
+    material.specularTextureIdx = app->whiteTexIdx;
+    material.normalsTextureIdx = app->normalTexIdx;
+    material.bumpTextureIdx = app->blackTexIdx;
+
+    u32* textureIndices[MaterialTexture_Count] = {
+        &material.albedoTextureIdx,
+        &material.emissiveTextureIdx,
+        &material.specularTextureIdx,
+        &material.normalsTextureIdx,
+        &material.bumpTextureIdx
+    };
+
+    for (u32 slot = 0; slot < MaterialTexture_Count; ++slot)
+    {
+        if (!materialImport.textures[slot].empty())
+        {
+            String filename = MakeString(materialImport.textures[slot].c_str());
+            String filepath = MakePath(directory, filename);
+            *textureIndices[slot] = async ? LoadTexture2DAsync(app, filepath.str) : LoadTexture2D(app, filepath.str);
+        }
+    }
+
+    app->materials.push_back(material);
+    return (u32)app->materials.size() - 1u;
+}
+
+// Adds an empty model (a mesh without submeshes draws nothing) to be filled later
+u32 ReserveModel(App* app)
+{
     app->meshes.push_back(Mesh{});
-    Mesh& mesh = app->meshes.back();
     u32 meshIdx = (u32)app->meshes.size() - 1u;
 
     app->models.push_back(Model{});
     Model& model = app->models.back();
     model.meshIdx = meshIdx;
-    u32 modelIdx = (u32)app->models.size() - 1u;
+    return (u32)app->models.size() - 1u;
+}
 
+void CreateModelFromImport(App* app, u32 modelIdx, ModelImport& modelImport, const char* filename, bool async)
+{
     String directory = GetDirectoryPart(MakeString(filename));
 
-    // Create a list of materials
     u32 baseMeshMaterialIndex = (u32)app->materials.size();
-    for (unsigned int i = 0; i < scene->mNumMaterials; ++i)
+    for (u32 i = 0; i < modelImport.materials.size(); ++i)
     {
-        app->materials.push_back(Material{});
-        Material& material = app->materials.back();
-        ProcessAssimpMaterial(app, scene->mMaterials[i], material, directory);
+        CreateMaterial(app, modelImport.materials[i], directory, async);
     }
 
-    ProcessAssimpNode(scene, scene->mRootNode, &mesh, baseMeshMaterialIndex, model.materialIdx);
-
-    aiReleaseImport(scene);
+    Model& model = app->models[modelIdx];
+    for (u32 i = 0; i < modelImport.submeshMaterialIndices.size(); ++i)
+    {
+        model.materialIdx.push_back(baseMeshMaterialIndex + modelImport.submeshMaterialIndices[i]);
+    }
 
-    u32 vertexBufferSize = 0;
-    u32 indexBufferSize = 0;
+    Mesh& mesh = app->meshes[model.meshIdx];
+    mesh.submeshes.swap(modelImport.mesh.submeshes);
 
     for (u32 i = 0; i < mesh.submeshes.size(); ++i)
     {
-        vertexBufferSize += mesh.submeshes[i].vertices.size() * sizeof(float);
-        indexBufferSize += mesh.submeshes[i].indices.size() * sizeof(u32);
+        Submesh& submesh = mesh.submeshes[i];
+        PackedSubmesh packed;
+        PackSubmesh(submesh, app->compactVertices, packed);
+
+        const u32 stride = packed.layout.stride;
+        submesh.vertexDataSize = packed.vertices.size();
+        submesh.vertexOffset = AllocateGeometry(app->geometry, app->geometry.vertices, submesh.vertexDataSize, stride);
+        submesh.baseVertex = submesh.vertexOffset / stride;
+        UploadGeometry(app->geometry.vertices, submesh.vertexOffset, submesh.vertexDataSize, packed.vertices.data());
+
+        submesh.indexDataSize = packed.indices.size();
+        submesh.indexOffset = AllocateGeometry(app->geometry, app->geometry.indices, submesh.indexDataSize, GEOMETRY_INDEX_ALIGNMENT);
+        submesh.indexCount = submesh.lods.empty() ? submesh.indices.size() : submesh.lods[0].indexCount;
+        UploadGeometry(app->geometry.indices, submesh.indexOffset, submesh.indexDataSize, packed.indices.data());
+
+        // From here on the layout describes the GPU buffer, not the float vertices
+        submesh.vertexBufferLayout = packed.layout;
+        submesh.indexType = packed.indexType;
+        submesh.positionScale = packed.positionScale;
+        submesh.positionOffset = packed.positionOffset;
+
+        // Only the arena copy is drawn from now on
+        submesh.vertices = std::vector<float>();
+        submesh.indices = std::vector<u32>();
     }
+    ComputeMeshLodErrors(mesh);
+    app->gpuScene.dirty = true;
+    app->cullingScene.dirty = true;
+}
 
-    glGenBuffers(1, &mesh.vertexBufferHandle);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBufferHandle);
-    glBufferData(GL_ARRAY_BUFFER, vertexBufferSize, NULL, GL_STATIC_DRAW);
+// The file must have been validated with ParseCookedMesh before
+void CreateModelFromCooked(App* app, u32 modelIdx, const MappedFile& file, const char* filename, bool async)
+{
+    const CookedMeshHeader* header = NULL;
+    const CookedSubmesh* cookedSubmeshes = NULL;
+    const CookedMaterial* cookedMaterials = NULL;
+    const Meshlet* cookedMeshlets = NULL;
+    bool valid = ParseCookedMesh(file, &header, &cookedSubmeshes, &cookedMaterials, &cookedMeshlets);
+    ASSERT(valid, "The cooked mesh has to be validated before creating a model from it");
 
-    glGenBuffers(1, &mesh.indexBufferHandle);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBufferHandle);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBufferSize, NULL, GL_STATIC_DRAW);
+    String directory = GetDirectoryPart(MakeString(filename));
 
-    u32 indicesOffset = 0;
-    u32 verticesOffset = 0;
+    u32 baseMeshMaterialIndex = (u32)app->materials.size();
+    for (u32 i = 0; i < header->materialCount; ++i)
+    {
+        const CookedMaterial& cooked = cookedMaterials[i];
+        MaterialImport material;
+        material.name = cooked.name;
+        material.albedo = vec3(cooked.albedo[0], cooked.albedo[1], cooked.albedo[2]);
+        material.emissive = vec3(cooked.emissive[0], cooked.emissive[1], cooked.emissive[2]);
+        material.smoothness = cooked.smoothness;
+        for (u32 slot = 0; slot < MaterialTexture_Count; ++slot)
+            material.textures[slot] = cooked.textures[slot];
+        CreateMaterial(app, material, directory, async);
+    }
+
+    Model& model = app->models[modelIdx];
+    Mesh& mesh = app->meshes[model.meshIdx];
 
+    // Submeshes only keep their ranges, the vertex and index data never leaves the mapping
+    for (u32 i = 0; i < header->submeshCount; ++i)
+    {
+        const CookedSubmesh& cooked = cookedSubmeshes[i];
+
+        Submesh submesh = {};
+        for (u32 j = 0; j < cooked.attributeCount; ++j)
+        {
+            const CookedAttribute& attribute = cooked.attributes[j];
+            submesh.vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ attribute.location, attribute.componentCount, attribute.offset, attribute.type, attribute.normalized != 0 });
+        }
+        submesh.vertexBufferLayout.stride = (u8)cooked.stride;
+        submesh.vertexDataSize = cooked.vertexSize;
+        submesh.vertexOffset = AllocateGeometry(app->geometry, app->geometry.vertices, submesh.vertexDataSize, cooked.stride);
+        submesh.baseVertex = submesh.vertexOffset / cooked.stride;
+        UploadGeometry(app->geometry.vertices, submesh.vertexOffset, submesh.vertexDataSize, file.data + header->vertexDataOffset + cooked.vertexOffset);
+
+        submesh.indexDataSize = cooked.indexCount * GetIndexSize(cooked.indexType);
+        submesh.indexOffset = AllocateGeometry(app->geometry, app->geometry.indices, submesh.indexDataSize, GEOMETRY_INDEX_ALIGNMENT);
+        UploadGeometry(app->geometry.indices, submesh.indexOffset, submesh.indexDataSize, file.data + header->indexDataOffset + cooked.indexOffset);
+
+        submesh.indexCount = cooked.indexCount;
+        submesh.indexType = cooked.indexType;
+        submesh.positionScale = vec3(cooked.positionScale[0], cooked.positionScale[1], cooked.positionScale[2]);
+        submesh.positionOffset = vec3(cooked.positionOffset[0], cooked.positionOffset[1], cooked.positionOffset[2]);
+        submesh.boundsCenter = vec3(cooked.boundsCenter[0], cooked.boundsCenter[1], cooked.boundsCenter[2]);
+        submesh.boundsExtent = vec3(cooked.boundsExtent[0], cooked.boundsExtent[1], cooked.boundsExtent[2]);
+        submesh.boundsRadius = cooked.boundsRadius;
+        submesh.meshlets.assign(cookedMeshlets + cooked.meshletOffset, cookedMeshlets + cooked.meshletOffset + cooked.meshletCount);
+        submesh.lods.assign(cooked.lods, cooked.lods + cooked.lodCount);
+        if (!submesh.lods.empty())
+            submesh.indexCount = submesh.lods[0].indexCount;
+        mesh.submeshes.push_back(submesh);
+
+        model.materialIdx.push_back(baseMeshMaterialIndex + cooked.materialIndex);
+    }
+
+    ComputeMeshLodErrors(mesh);
+    app->gpuScene.dirty = true;
+    app->cullingScene.dirty = true;
+}
+
+// Gives the arena ranges of a mesh back, its submeshes are left empty
+void FreeMeshGeometry(App* app, Mesh& mesh)
+{
     for (u32 i = 0; i < mesh.submeshes.size(); ++i)
     {
-        const void* verticesData = mesh.submeshes[i].vertices.data();
-        const u32   verticesSize = mesh.submeshes[i].vertices.size() * sizeof(float);
-        glBufferSubData(GL_ARRAY_BUFFER, verticesOffset, verticesSize, verticesData);
-        mesh.submeshes[i].vertexOffset = verticesOffset;
-        verticesOffset += verticesSize;
+        const Submesh& submesh = mesh.submeshes[i];
+        FreeGeometry(app->geometry.vertices, submesh.vertexOffset, submesh.vertexDataSize);
+        FreeGeometry(app->geometry.indices, submesh.indexOffset, submesh.indexDataSize);
+    }
+    mesh.submeshes.clear();
+    mesh.lodErrors.clear();
+    app->gpuScene.dirty = true;
+    app->cullingScene.dirty = true;
+    ASSERT(ValidateGeometryHeap(app->geometry.vertices) && ValidateGeometryHeap(app->geometry.indices), "Freed geometry was not merged with its free neighbours");
+}
+
+// Objects of an unloaded model stay in the scene and draw nothing, like a reserved model
+void UnloadModel(App* app, u32 modelIdx)
+{
+    Model& model = app->models[modelIdx];
+    FreeMeshGeometry(app, app->meshes[model.meshIdx]);
+    model.materialIdx.clear();
+    ILOG("Unloaded model %u, the geometry heaps have %u and %u free blocks", modelIdx,
+        (u32)app->geometry.vertices.freeBlocks.size(), (u32)app->geometry.indices.freeBlocks.size());
+}
 
-        const void* indicesData = mesh.submeshes[i].indices.data();
-        const u32   indicesSize = mesh.submeshes[i].indices.size() * sizeof(u32);
-        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indicesOffset, indicesSize, indicesData);
-        mesh.submeshes[i].indexOffset = indicesOffset;
-        indicesOffset += indicesSize;
+// Packs the geometry of every mesh at the start of the arena heaps
+void DefragmentGeometry(App* app)
+{
+    std::vector<GeometryRange> vertexRanges;
+    std::vector<GeometryRange> indexRanges;
+    for (u32 m = 0; m < app->meshes.size(); ++m)
+    {
+        for (u32 i = 0; i < app->meshes[m].submeshes.size(); ++i)
+        {
+            Submesh& submesh = app->meshes[m].submeshes[i];
+            vertexRanges.push_back(GeometryRange{ &submesh.vertexOffset, submesh.vertexDataSize, submesh.vertexBufferLayout.stride });
+            indexRanges.push_back(GeometryRange{ &submesh.indexOffset, submesh.indexDataSize, GEOMETRY_INDEX_ALIGNMENT });
+        }
+    }
+
+    CompactGeometryHeap(app->geometry, app->geometry.vertices, vertexRanges);
+    CompactGeometryHeap(app->geometry, app->geometry.indices, indexRanges);
+
+    for (u32 m = 0; m < app->meshes.size(); ++m)
+        for (u32 i = 0; i < app->meshes[m].submeshes.size(); ++i)
+            app->meshes[m].submeshes[i].baseVertex = app->meshes[m].submeshes[i].vertexOffset / app->meshes[m].submeshes[i].vertexBufferLayout.stride;
+
+    // Whatever was freed before is one block at the end now
+    ASSERT(app->geometry.vertices.freeBlocks.size() <= 1 && app->geometry.indices.freeBlocks.size() <= 1, "Defragmentation left free blocks between meshes");
+}
+
+u32 LoadModel(App* app, const char* filename)
+{
+    std::string cookedPath = GetCookedMeshPath(filename);
+
+    if (IsCookedMeshUpToDate(filename, cookedPath.c_str(), app->compactVertices))
+    {
+        MappedFile file = MapFile(cookedPath.c_str());
+
+        const CookedMeshHeader* header = NULL;
+        const CookedSubmesh* submeshes = NULL;
+        const CookedMaterial* materials = NULL;
+        const Meshlet* meshlets = NULL;
+        if (ParseCookedMesh(file, &header, &submeshes, &materials, &meshlets))
+        {
+            u32 modelIdx = ReserveModel(app);
+            CreateModelFromCooked(app, modelIdx, file, filename, false);
+            UnmapFile(file);
+            return modelIdx;
+        }
+
+        ILOG("Cooked mesh %s is invalid or outdated, it will be cooked again", cookedPath.c_str());
+        UnmapFile(file);
     }
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    // Missing, outdated or written by an older version: go through the importer
+    // once and leave a cooked file behind so the next launch skips it
+    ModelImport model;
+    if (!ImportModel(filename, model))
+        return UINT32_MAX;
+
+    WriteCookedMesh(model, cookedPath.c_str(), app->compactVertices);
+
+    u32 modelIdx = ReserveModel(app);
+    CreateModelFromImport(app, modelIdx, model, filename, false);
+    return modelIdx;
+}
+
+u32 LoadModelAsync(App* app, const char* filename)
+{
+    u32 modelIdx = ReserveModel(app);
+
+    LoadJob* job = new LoadJob();
+    job->type = LoadJob_Model;
+    job->targetIdx = modelIdx;
+    job->filepath = filename;
+    job->compactVertices = app->compactVertices;
+    SubmitLoadJob(*app->loader, job);
 
     return modelIdx;
 }
+
+static bool IsImageFile(const char* filepath)
+{
+    const char* extensions[] = { ".png", ".jpg", ".jpeg", ".tga", ".bmp", ".psd", ".gif", ".hdr" };
+
+    std::string path = filepath;
+    for (u32 i = 0; i < path.size(); ++i)
+        path[i] = (char)tolower(path[i]);
+
+    for (u32 i = 0; i < ARRAY_COUNT(extensions); ++i)
+    {
+        size_t length = strlen(extensions[i]);
+        if (path.size() > length && path.compare(path.size() - length, length, extensions[i]) == 0)
+            return true;
+    }
+    return false;
+}
+
+bool CookAsset(const char* filepath, const CookOptions& options)
+{
+    if (IsImageFile(filepath))
+    {
+        TextureCookFormat format = TextureCook_Auto;
+        if (options.textureFormat && !ParseTextureCookFormat(options.textureFormat, &format))
+        {
+            ELOG("Unknown texture format '%s'", options.textureFormat);
+            return false;
+        }
+        return CookTexture(filepath, GetCookedTexturePath(filepath).c_str(), format);
+    }
+
+    return CookModel(filepath, GetCookedMeshPath(filepath).c_str(), options.compactVertices);
+}
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-GLuint CreateProgramFromSource(String programSource, const char* shaderName)
+GLuint CreateProgramFromSource(String programSource, const char* shaderName, const char* defines = "")
 {
     GLchar  infoLogBuffer[1024] = {};
     GLsizei infoLogBufferSize = sizeof(infoLogBuffer);
@@ -336,24 +780,28 @@ GLuint CreateProgramFromSource(String programSource, const char* shaderName)
     const GLchar* vertexShaderSource[] = {
         versionString,
         shaderNameDefine,
+        defines,
         vertexShaderDefine,
         programSource.str
     };
     const GLint vertexShaderLengths[] = {
         (GLint) strlen(versionString),
         (GLint) strlen(shaderNameDefine),
+        (GLint) strlen(defines),
         (GLint) strlen(vertexShaderDefine),
         (GLint) programSource.len
     };
     const GLchar* fragmentShaderSource[] = {
         versionString,
         shaderNameDefine,
+        defines,
         fragmentShaderDefine,
         programSource.str
     };
     const GLint fragmentShaderLengths[] = {
         (GLint) strlen(versionString),
         (GLint) strlen(shaderNameDefine),
+        (GLint) strlen(defines),
         (GLint) strlen(fragmentShaderDefine),
         (GLint) programSource.len
     };
@@ -399,15 +847,82 @@ GLuint CreateProgramFromSource(String programSource, const char* shaderName)
     return programHandle;
 }
 
-u32 LoadProgram(App* app, const char* filepath, const char* programName)
+u32 LoadProgram(App* app, const char* filepath, const char* programName, const char* defines = "")
+{
+    String programSource = ReadTextFile(filepath);
+
+    Program program = {};
+    program.handle = CreateProgramFromSource(programSource, programName, defines);
+    program.filepath = filepath;
+    program.programName = programName;
+    program.lastWriteTimestamp = GetFileLastWriteTimestamp(filepath);
+    ReflectProgram(program);
+    app->programs.push_back(program);
+
+    return app->programs.size() - 1;
+}
+
+GLuint CreateComputeProgramFromSource(String programSource, const char* shaderName)
+{
+    GLchar  infoLogBuffer[1024] = {};
+    GLsizei infoLogBufferSize = sizeof(infoLogBuffer);
+    GLsizei infoLogSize;
+    GLint   success;
+
+    char versionString[] = "#version 430\n";
+    char shaderNameDefine[128];
+    sprintf_s(shaderNameDefine, "#define %s\n", shaderName);
+    char computeShaderDefine[] = "#define COMPUTE\n";
+
+    const GLchar* computeShaderSource[] = {
+        versionString,
+        shaderNameDefine,
+        computeShaderDefine,
+        programSource.str
+    };
+    const GLint computeShaderLengths[] = {
+        (GLint) strlen(versionString),
+        (GLint) strlen(shaderNameDefine),
+        (GLint) strlen(computeShaderDefine),
+        (GLint) programSource.len
+    };
+
+    GLuint cshader = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(cshader, ARRAY_COUNT(computeShaderSource), computeShaderSource, computeShaderLengths);
+    glCompileShader(cshader);
+    glGetShaderiv(cshader, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        glGetShaderInfoLog(cshader, infoLogBufferSize, &infoLogSize, infoLogBuffer);
+        ELOG("glCompileShader() failed with compute shader %s\nReported message:\n%s\n", shaderName, infoLogBuffer);
+    }
+
+    GLuint programHandle = glCreateProgram();
+    glAttachShader(programHandle, cshader);
+    glLinkProgram(programHandle);
+    glGetProgramiv(programHandle, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        glGetProgramInfoLog(programHandle, infoLogBufferSize, &infoLogSize, infoLogBuffer);
+        ELOG("glLinkProgram() failed with program %s\nReported message:\n%s\n", shaderName, infoLogBuffer);
+    }
+
+    glDetachShader(programHandle, cshader);
+    glDeleteShader(cshader);
+
+    return programHandle;
+}
+
+u32 LoadComputeProgram(App* app, const char* filepath, const char* programName)
 {
     String programSource = ReadTextFile(filepath);
 
     Program program = {};
-    program.handle = CreateProgramFromSource(programSource, programName);
+    program.handle = CreateComputeProgramFromSource(programSource, programName);
     program.filepath = filepath;
     program.programName = programName;
     program.lastWriteTimestamp = GetFileLastWriteTimestamp(filepath);
+    ReflectProgram(program);
     app->programs.push_back(program);
 
     return app->programs.size() - 1;
@@ -416,7 +931,8 @@ u32 LoadProgram(App* app, const char* filepath, const char* programName)
 Image LoadImage(const char* filename)
 {
     Image img = {};
-    stbi_set_flip_vertically_on_load(true);
+    // per thread flag, images are also decoded by the asset loader workers
+    stbi_set_flip_vertically_on_load_thread(true);
     img.pixels = stbi_load(filename, &img.size.x, &img.size.y, &img.nchannels, 0);
     if (img.pixels)
     {
@@ -451,8 +967,8 @@ GLuint CreateTexture2DFromImage(Image image)
     glGenTextures(1, &texHandle);
     glBindTexture(GL_TEXTURE_2D, texHandle);
     glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.size.x, image.size.y, 0, dataFormat, dataType, image.pixels);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
@@ -462,147 +978,209 @@ GLuint CreateTexture2DFromImage(Image image)
     return texHandle;
 }
 
+// Uploads a cooked texture as it is stored, the mip chain was already built when cooking
+GLuint CreateTexture2DFromCooked(const MappedFile& file)
+{
+    const CookedTextureHeader* header = NULL;
+    const CookedTextureLevel* levels = NULL;
+    bool valid = ParseCookedTexture(file, &header, &levels);
+    ASSERT(valid, "Cooked texture must be validated before uploading it");
+
+    GLuint texHandle;
+    glGenTextures(1, &texHandle);
+    glBindTexture(GL_TEXTURE_2D, texHandle);
+    for (u32 i = 0; i < header->levelCount; ++i)
+        glCompressedTexImage2D(GL_TEXTURE_2D, i, header->internalFormat, levels[i].width, levels[i].height, 0, (GLsizei)levels[i].size, file.data + levels[i].offset);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, header->levelCount - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    return texHandle;
+}
+
 u32 LoadTexture2D(App* app, const char* filepath)
 {
-    for (u32 texIdx = 0; texIdx < app->textures.size(); ++texIdx)
-        if (app->textures[texIdx].filepath == filepath)
-            return texIdx;
+    std::string path = NormalizeTexturePath(filepath);
+    u32 texIdx = FindTextureByPath(app->textureRegistry, path);
+    if (texIdx != TEXTURE_NOT_FOUND)
+        return texIdx;
 
-    Image image = LoadImage(filepath);
+    Texture tex = {};
+    tex.filepath = filepath;
 
-    if (image.pixels)
+    MappedFile cookedFile = MapCookedTexture(filepath, app->supportsS3TC);
+    Image image = {};
+    if (cookedFile.data)
     {
-        Texture tex = {};
-        tex.handle = CreateTexture2DFromImage(image);
-        tex.filepath = filepath;
+        tex.contentHash = HashCookedTextureContent(cookedFile);
+        tex.size = cookedFile.size;
+    }
+    else
+    {
+        image = LoadImage(filepath);
+        if (!image.pixels)
+            return UINT32_MAX;
+
+        tex.contentHash = HashImageContent(image);
+        tex.size = (u64)image.stride * image.size.y;
+    }
 
-        u32 texIdx = app->textures.size();
+    // Same texels under another path, share its GL texture
+    texIdx = FindTextureByContent(app->textureRegistry, app->textures, tex.contentHash, tex.size, &image, cookedFile.data ? &cookedFile : NULL, app->supportsS3TC);
+    if (texIdx == TEXTURE_NOT_FOUND)
+    {
+        tex.handle = cookedFile.data ? CreateTexture2DFromCooked(cookedFile) : CreateTexture2DFromImage(image);
+        texIdx = app->textures.size();
         app->textures.push_back(tex);
+        RegisterTextureContent(app->textureRegistry, tex.contentHash, texIdx);
+    }
+    RegisterTexturePath(app->textureRegistry, path, texIdx);
 
+    if (cookedFile.data)
+        UnmapFile(cookedFile);
+    else
         FreeImage(image);
+
+    return texIdx;
+}
+
+u32 LoadTexture2DAsync(App* app, const char* filepath)
+{
+    std::string path = NormalizeTexturePath(filepath);
+    u32 texIdx = FindTextureByPath(app->textureRegistry, path);
+    if (texIdx != TEXTURE_NOT_FOUND)
         return texIdx;
-    }
-    else
+
+    // Samples the white texture until the image is decoded and uploaded
+    Texture tex = {};
+    tex.handle = app->textures[app->whiteTexIdx].handle;
+    tex.filepath = filepath;
+
+    texIdx = app->textures.size();
+    app->textures.push_back(tex);
+    RegisterTexturePath(app->textureRegistry, path, texIdx);
+
+    LoadJob* job = new LoadJob();
+    job->type = LoadJob_Texture;
+    job->targetIdx = texIdx;
+    job->filepath = filepath;
+    job->supportsS3TC = app->supportsS3TC;
+    SubmitLoadJob(*app->loader, job);
+
+    return texIdx;
+}
+
+// Finishes the jobs the loader workers are done with. Only the GPU uploads are left
+// for the main thread, and they are capped so streaming assets in does not hitch.
+// At least one job is finished every frame so big assets cannot starve.
+void ProcessCompletedLoadJobs(App* app)
+{
+    u64 uploadedBytes = 0;
+    while (uploadedBytes < app->loadUploadBudget)
     {
-        return UINT32_MAX;
+        LoadJob* job = PopCompletedLoadJob(*app->loader);
+        if (!job)
+            break;
+
+        const char* filepath = job->filepath.c_str();
+        switch (job->type)
+        {
+            case LoadJob_Model:
+                if (!job->succeeded)
+                {
+                    ELOG("Failed to load model %s", filepath);
+                }
+                else if (job->cookedFile.data)
+                {
+                    CreateModelFromCooked(app, job->targetIdx, job->cookedFile, filepath, true);
+                }
+                else
+                {
+                    CreateModelFromImport(app, job->targetIdx, job->model, filepath, true);
+                }
+                break;
+
+            case LoadJob_Texture:
+            {
+                Texture& texture = app->textures[job->targetIdx];
+                if (!job->succeeded)
+                {
+                    texture.handle = app->textures[app->magentaTexIdx].handle;
+                    break;
+                }
+
+                texture.contentHash = job->contentHash;
+                texture.size = job->uploadSize;
+                u32 sameContentIdx = FindTextureByContent(app->textureRegistry, app->textures, job->contentHash, job->uploadSize, &job->image, job->cookedFile.data ? &job->cookedFile : NULL, app->supportsS3TC);
+                if (sameContentIdx != TEXTURE_NOT_FOUND)
+                {
+                    texture.handle = app->textures[sameContentIdx].handle;
+                    job->uploadSize = 0;
+                    break;
+                }
+
+                texture.handle = job->cookedFile.data ? CreateTexture2DFromCooked(job->cookedFile) : CreateTexture2DFromImage(job->image);
+                RegisterTextureContent(app->textureRegistry, job->contentHash, job->targetIdx);
+                break;
+            }
+        }
+
+        uploadedBytes += job->uploadSize;
+        FreeLoadJob(job);
     }
 }
+
 void initGBuffer(App* app) {
     
+    // Positions are reconstructed from depth, normals and albedo are all the targets hold
     glGenFramebuffers(1, &app->gBuffer);
     glBindFramebuffer(GL_FRAMEBUFFER, app->gBuffer);
     
-    glGenTextures(1, &app->gPosition);
-    glBindTexture(GL_TEXTURE_2D, app->gPosition);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, app->displaySize.x, app->displaySize.y, 0, GL_RGBA, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, app->gPosition, 0);
-    // normal
+    // normal, octahedral in world space
     glGenTextures(1, &app->gNormal);
     glBindTexture(GL_TEXTURE_2D, app->gNormal);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, app->displaySize.x, app->displaySize.y, 0, GL_RGBA, GL_FLOAT, NULL);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16, app->displaySize.x, app->displaySize.y, 0, GL_RG, GL_UNSIGNED_SHORT, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, app->gNormal, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, app->gNormal, 0);
     
-    // position
-    
-    // color + specular
+    // color + specular, a specular of 1 marks pixels that are not lit
     glGenTextures(1, &app->gAlbedoSpec);
     glBindTexture(GL_TEXTURE_2D, app->gAlbedoSpec);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, app->displaySize.x, app->displaySize.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, app->displaySize.x, app->displaySize.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, app->gAlbedoSpec, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, app->gAlbedoSpec, 0);
 
-   
     // depth buffer
-    /*unsigned int rboDepth;
-    glGenRenderbuffers(1, &rboDepth);
-    glBindRenderbuffer(GL_RENDERBUFFER, rboDepth);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, app->displaySize.x, app->displaySize.y);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rboDepth);
-
-
     glGenTextures(1, &app->gDepth);
     glBindTexture(GL_TEXTURE_2D, app->gDepth);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, app->displaySize.x, app->displaySize.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, GL_TEXTURE_2D, app->gDepth, 0);*/
-
-
-
-    unsigned int rboDepth;
-    glGenRenderbuffers(1, &rboDepth);
-    glBindRenderbuffer(GL_RENDERBUFFER, rboDepth);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, app->displaySize.x, app->displaySize.y);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rboDepth);
-
-
-    glGenTextures(1, &app->gDepth);
-    glBindTexture(GL_TEXTURE_2D, app->gDepth);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, app->displaySize.x, app->displaySize.y, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, app->displaySize.x, app->displaySize.y, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, app->gDepth, 0);
-
-    glGenTextures(1, &app->ggPosition);
-    glBindTexture(GL_TEXTURE_2D, app->ggPosition);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, app->displaySize.x, app->displaySize.y, 0, GL_RGBA, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT4, GL_TEXTURE_2D, app->ggPosition, 0);
-    // normal
-    glGenTextures(1, &app->ggNormal);
-    glBindTexture(GL_TEXTURE_2D, app->ggNormal);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, app->displaySize.x, app->displaySize.y, 0, GL_RGBA, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT5, GL_TEXTURE_2D, app->ggNormal, 0);
+    // With stencil so the light volumes can blit it into their own depth stencil (see lightvolumes.h)
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, app->gDepth, 0);
     
     // tell OpenGL which color attachments we'll use (of this framebuffer) for rendering 
-    unsigned int attachments[6] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3, GL_COLOR_ATTACHMENT4, GL_COLOR_ATTACHMENT5 };
-    glDrawBuffers(6, attachments);
-    
-    /////////////////////////////////////////////////////
-    std::vector<glm::vec3> ssaoNoise;
-    std::uniform_real_distribution<float> randomFloats(0.0, 1.0);
-    std::default_random_engine generator;
-    for (unsigned int i = 0; i < 16; i++)
-    {
-        glm::vec3 noise(
-            randomFloats(generator) * 2.0 - 1.0,
-            randomFloats(generator) * 2.0 - 1.0,
-            0.0f);
-        ssaoNoise.push_back(noise);
-    }
-
-    /*glGenTextures(1, &app->ssao);
-    glBindTexture(GL_TEXTURE_2D, app->ssao);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, 4, 4, 0, GL_RGB, GL_FLOAT, &ssaoNoise[0]);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);*/
-    
-
-
-    
+    unsigned int attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, attachments);
 
     // finally check if framebuffer is complete
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
     Program& texturedMeshPRogram = app->programs[app->texturedQuadProgramIdx];
     glUseProgram(texturedMeshPRogram.handle);
-    glUniform1i(glGetUniformLocation(texturedMeshPRogram.handle, "gPosition"), 0);
-    glUniform1i(glGetUniformLocation(texturedMeshPRogram.handle, "gNormal"), 1);
-    glUniform1i(glGetUniformLocation(texturedMeshPRogram.handle, "gAlbedoSpec"), 2);
-    glUniform1i(glGetUniformLocation(texturedMeshPRogram.handle, "gDepth"), 3);
-    glUniform1i(glGetUniformLocation(texturedMeshPRogram.handle, "ggPosition"),4);
-    glUniform1i(glGetUniformLocation(texturedMeshPRogram.handle, "ggNormal"), 5);
+    glUniform1i(GetProgramResourceLocation(texturedMeshPRogram, ProgramResource_Sampler, "gNormal"), 1);
+    glUniform1i(GetProgramResourceLocation(texturedMeshPRogram, ProgramResource_Sampler, "gAlbedoSpec"), 2);
+    glUniform1i(GetProgramResourceLocation(texturedMeshPRogram, ProgramResource_Sampler, "gDepth"), 3);
+    glUniform1i(GetProgramResourceLocation(texturedMeshPRogram, ProgramResource_Sampler, "lightAccumulation"), 6);
+    glUniform1i(GetProgramResourceLocation(texturedMeshPRogram, ProgramResource_Sampler, "ssaoOcclusion"), 7);
 }
 void initFrontPlane(App* app) {
     float quadVertices[] = {
@@ -653,6 +1231,8 @@ Objects* CreateObject(App* app, int objectIndex, vec3 postion = { 0,0,0 }, vec3
         break;
     }
     app->sceneObjects.push_back(ob1);
+    app->gpuScene.dirty = true;
+    app->cullingScene.dirty = true;
     return ob1;
 }
 void DestroyObject(App* app, Objects* position)
@@ -660,6 +1240,8 @@ void DestroyObject(App* app, Objects* position)
     
     app->sceneObjects.erase(std::remove(app->sceneObjects.begin(), app->sceneObjects.end(), position), app->sceneObjects.end());
     delete position;
+    app->gpuScene.dirty = true;
+    app->cullingScene.dirty = true;
 
 }
 void CreateLight(App* app, LightType type, vec3 postion = { 0,2,0 }, vec3 color = { 1,1,1 }, float intensity = 1) {
@@ -704,72 +1286,75 @@ void DestroyLight(App* app,Light* position) {
     app->lights.erase(std::remove(app->lights.begin(), app->lights.end(), position), app->lights.end());
     delete position;
     
-}
-float lerp(float a, float b, float f)
-{
-    return (a * (1.0 - f)) + (b * f);
-}
-void initRandomFloats(App* app)
-{
-    std::uniform_real_distribution<float> randomFloats(0.0, 1.0);
-    std::default_random_engine generator;
-    
-    for (unsigned int i = 0; i < 64; ++i)
-    {
-        glm::vec3 sample(
-            randomFloats(generator) * 2.0 - 1.0,
-            randomFloats(generator) * 2.0 - 1.0,
-            randomFloats(generator)
-        );
-        sample = glm::normalize(sample);
-        sample *= randomFloats(generator);
-        float scale = (float)i / 64.0;
-      
-        scale = lerp(0.1f, 1.0f, scale * scale);
-        sample *= scale;
-
-        app->ssaoKernel.push_back(sample);
-    }
-
-
 }
 void Init(App* app)
 {
-    GLint maxUniformBufferSize;
-
-    glGetIntegerv(GL_MAX_UNIFORM_BLOCK_SIZE, &maxUniformBufferSize);
-    app->cbuffer = CreateBuffer(maxUniformBufferSize, GL_UNIFORM_BUFFER, GL_DYNAMIC_DRAW);
-    app->cbufferSecond = CreateBuffer(maxUniformBufferSize, GL_UNIFORM_BUFFER, GL_DYNAMIC_DRAW);
-    
-
-
     initFrontPlane(app);
     initGBuffer(app);
-    initRandomFloats(app);
+    app->ssao.programIdx = LoadProgram(app, "ssao.glsl", "SSAO");
+    app->ssao.blurProgramIdx = LoadProgram(app, "ssao.glsl", "SSAO_BLUR");
+    CreateSsao(app);
     app->camera= new Camera({-1.7,1.6f,16},{0,1,0});
-    
-    
-    app->PatrickID= LoadModel(app, "Patrick/Patrick.obj");
-    app->PlaneID = LoadModel(app, "Plane/Plane.obj");
-    app->SphereID = LoadModel(app, "Sphere/Sphere.obj");
-    app->TourusID = LoadModel(app, "Tourus/Tourus.obj");
+
+    app->glinfo.glVversion = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+    app->glinfo.glRender = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+    app->glinfo.glShadingVersion = reinterpret_cast<const char*>(glGetString(GL_SHADING_LANGUAGE_VERSION));
+    app->glinfo.glVendor = reinterpret_cast<const char*>(glGetString(GL_VENDOR));
+
+
+    GLint numExtensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+    for (int a = 0; a < numExtensions; a++) {
+        app->glinfo.glextensions.push_back(reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS,GLuint(a))));
+        if (app->glinfo.glextensions.back() == "GL_EXT_texture_compression_s3tc")
+            app->supportsS3TC = true;
+        if (app->glinfo.glextensions.back() == "GL_ARB_buffer_storage")
+            app->supportsBufferStorage = true;
+    }
+
+    if (app->supportsBufferStorage)
+        BufferStorage = (PFNGLBUFFERSTORAGEPROC)GetGLProcAddress("glBufferStorage");
+    GLint uniformBufferAlignment;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformBufferAlignment);
+    app->uniformBufferAlignment = uniformBufferAlignment;
+    app->cbuffer = CreateRingBuffer(Align(CONSTANT_RING_FRAME_SIZE, app->uniformBufferAlignment), GL_UNIFORM_BUFFER);
+
+    // Fallbacks are loaded right away, they stand in for the textures still loading
+    app->whiteTexIdx = LoadTexture2D(app, "color_white.png");
+    app->blackTexIdx = LoadTexture2D(app, "color_black.png");
+    app->normalTexIdx = LoadTexture2D(app, "color_normal.png");
+    app->magentaTexIdx = LoadTexture2D(app, "color_magenta.png");
+
+    CreateGeometryArena(app->geometry, GEOMETRY_VERTEX_HEAP_SIZE, GEOMETRY_INDEX_HEAP_SIZE);
+
+    u32 workerCount = std::thread::hardware_concurrency() > 1 ? std::thread::hardware_concurrency() - 1 : 1;
+    app->loader = new AssetLoader();
+    StartAssetLoader(*app->loader, workerCount > 4 ? 4 : workerCount);
+
+    app->PatrickID= LoadModelAsync(app, "Patrick/Patrick.obj");
+    app->PlaneID = LoadModelAsync(app, "Plane/Plane.obj");
+    app->SphereID = LoadModelAsync(app, "Sphere/Sphere.obj");
+    app->TourusID = LoadModelAsync(app, "Tourus/Tourus.obj");
    
+    // vertex inputs come from program reflection
     app->LightID = LoadProgram(app, "shaders.glsl","TEXTURED_GEOMETRY");
-    Program& texturedMeshProgram = app->programs[app->LightID];
-    texturedMeshProgram.vertexInputLayout.attributes.push_back({ 3,5 });
-    texturedMeshProgram.vertexInputLayout.attributes.push_back({ 4,4 });
-    texturedMeshProgram.vertexInputLayout.attributes.push_back({ 0,3 });
-    texturedMeshProgram.vertexInputLayout.attributes.push_back({ 2,2 });
-    texturedMeshProgram.vertexInputLayout.attributes.push_back({ 1,1 }); //TEXTURED_EMPTYOBJ
-    
-
     app->EmptyObjID= LoadProgram(app, "EmptyObj.glsl", "TEXTURED_EMPTYOBJ");//
-    Program& EmptyObjProgram = app->programs[app->EmptyObjID];
-    EmptyObjProgram.vertexInputLayout.attributes.push_back({ 3,5 });
-    EmptyObjProgram.vertexInputLayout.attributes.push_back({ 4,4 });
-    EmptyObjProgram.vertexInputLayout.attributes.push_back({ 0,3 });
-    EmptyObjProgram.vertexInputLayout.attributes.push_back({ 2,2 });
-    EmptyObjProgram.vertexInputLayout.attributes.push_back({ 1,1 }); //TEXTURED_EMPTYOBJ
+    u32 instancedProgramIdx = LoadProgram(app, "shaders.glsl", "TEXTURED_GEOMETRY", "#define INSTANCED\n");
+    app->programs[app->LightID].instancedProgramIdx = instancedProgramIdx;
+    instancedProgramIdx = LoadProgram(app, "EmptyObj.glsl", "TEXTURED_EMPTYOBJ", "#define INSTANCED\n");
+    app->programs[app->EmptyObjID].instancedProgramIdx = instancedProgramIdx;
+    CreateInstanceBuffer(app->instanceBuffer);
+    app->gpuScene.cullingProgramIdx = LoadComputeProgram(app, "gpuculling.glsl", "GPU_CULLING");
+    app->depthPyramid.buildProgramIdx = LoadComputeProgram(app, "gpuculling.glsl", "DEPTH_PYRAMID");
+    CreateGpuScene(app->gpuScene);
+    CreateDepthPyramid(app->depthPyramid, app->displaySize);
+    app->gtao.programIdx = LoadComputeProgram(app, "gtao.glsl", "GTAO");
+    CreateGtao(app->gtao, app->displaySize);
+    app->lightClusters.clusteringProgramIdx = LoadComputeProgram(app, "lighting.glsl", "LIGHT_CLUSTERING");
+    CreateLightClusters(app->lightClusters);
+    app->lightVolumes.programIdx = LoadProgram(app, "lighting.glsl", "LIGHT_VOLUME");
+    app->lightVolumes.stencilProgramIdx = LoadProgram(app, "lighting.glsl", "LIGHT_VOLUME", "#define STENCIL_ONLY\n");
+    CreateLightVolumes(app);
 
 
     CreateLight(app,LightType::Point,  {  2,2,2 }, { 1,0,0 },4);
@@ -786,17 +1371,6 @@ void Init(App* app)
     CreateObject(app, 2);
     CreateObject(app, 3, { 0,3.5f,0 });
     ///////////////////////////////////////////////////////////
-    app->glinfo.glVversion = reinterpret_cast<const char*>(glGetString(GL_VERSION));
-    app->glinfo.glRender = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
-    app->glinfo.glShadingVersion = reinterpret_cast<const char*>(glGetString(GL_SHADING_LANGUAGE_VERSION));
-    app->glinfo.glVendor = reinterpret_cast<const char*>(glGetString(GL_VENDOR));
-
-
-    GLint numExtensions = 0;
-    glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
-    for (int a = 0; a < numExtensions; a++) {
-        app->glinfo.glextensions.push_back(reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS,GLuint(a))));
-    }
     app->mode = Mode_TexturedQuad;
 }
 glm::vec3 rotateVector(const glm::vec3 axis, double angle, const glm::vec3 vector) {
@@ -827,12 +1401,68 @@ void Gui(App* app)
 {
     ImGui::Begin("Info");
     ImGui::Text("FPS: %f", 1.0f/app->deltaTime);
+    u32 loadingAssets = GetUnfinishedLoadJobCount(*app->loader);
+    if (loadingAssets > 0)
+        ImGui::Text("Loading assets: %u", loadingAssets);
+    ImGui::Checkbox("Frustum culling", &app->frustumCulling);
+    if (app->frustumCulling && !app->gpuDriven)
+    {
+        ImGui::Text("Objects in frustum: %u / %u, submeshes: %u / %u", (u32)app->visibleObjects.size(), (u32)app->sceneObjects.size(),
+            app->cullingScene.visibleCount, app->cullingScene.entryCount);
+        ImGui::Text("Scene BVH: %u nodes, cost %.1f (%.1f built), %u builds, %u refits", (u32)app->sceneBvh.nodes.size(),
+            app->sceneBvh.cost, app->sceneBvh.buildCost, app->sceneBvh.builds, app->sceneBvh.refits);
+    }
+    ImGui::Checkbox("Meshlet culling", &app->meshletCulling);
+    ImGui::Text("Meshlets: %u / %u", app->meshletsDrawn, app->meshletsTotal);
+    ImGui::Checkbox("Instancing", &app->instancing);
+    ImGui::Checkbox("GPU driven", &app->gpuDriven);
+    if (app->gpuDriven)
+        ImGui::Checkbox("Occlusion culling", &app->occlusionCulling);
+    if (app->gpuDriven)
+        ImGui::Text("GPU draws: %u in %u multi draws", app->gpuScene.drawCount, (u32)app->gpuScene.buckets.size());
+    const char* lightingPaths[LightingPath_Count] = { "All lights", "Clustered", "Light volumes" };
+    ImGui::Combo("Lighting", (int*)&app->lightingPath, lightingPaths, LightingPath_Count);
+    ImGui::Text("Lights: %u, uploaded: %u, buffer capacity: %u", app->lightClusters.lightCount,
+        app->lightClusters.uploadedLights, app->lightClusters.lightCapacity);
+    if (app->lightingPath == LightingPath_Volumes)
+        ImGui::Text("Light volumes drawn: %u", app->lightVolumes.drawnLights);
+    ImGui::Text("Draws: %u, program changes: %u, texture changes: %u",
+        app->renderQueue.drawCount, app->renderQueue.programChanges, app->renderQueue.textureChanges);
+    ImGui::Text("Instanced draws: %u, instances: %u", app->renderQueue.instancedDraws, app->renderQueue.instanceCount);
+    ImGui::Text("VAOs: %u cached, %u lookups missed", (u32)app->vaoCache.vaos.size(), app->vaoCache.misses);
+    const GeometryArena& geometry = app->geometry;
+    ImGui::Text("Geometry: vertices %.1f / %.1f MB, indices %.1f / %.1f MB, %u free blocks",
+        geometry.vertices.usedSize / (f32)MB(1), geometry.vertices.capacity / (f32)MB(1),
+        geometry.indices.usedSize / (f32)MB(1), geometry.indices.capacity / (f32)MB(1),
+        (u32)(geometry.vertices.freeBlocks.size() + geometry.indices.freeBlocks.size()));
+    if (ImGui::Button("Defragment geometry"))
+        DefragmentGeometry(app);
+    if (ImGui::TreeNode("Models"))
+    {
+        for (u32 i = 0; i < app->models.size(); ++i)
+        {
+            u32 submeshCount = (u32)app->meshes[app->models[i].meshIdx].submeshes.size();
+            ImGui::Text("Model %u: %u submeshes", i, submeshCount);
+            if (submeshCount == 0)
+                continue;
+            ImGui::SameLine();
+            std::string label = "Unload##model" + std::to_string(i);
+            if (ImGui::Button(label.c_str()))
+                UnloadModel(app, i);
+        }
+        ImGui::TreePop();
+    }
+    const TextureRegistry& registry = app->textureRegistry;
+    ImGui::Text("Textures: %u uploaded, %u path hits, %u shared (%.1f MB saved)",
+        registry.misses, registry.pathHits, registry.contentHits, registry.bytesSaved / (f32)MB(1));
+    ImGui::Checkbox("LODs", &app->lodEnabled);
+    ImGui::DragFloat("LOD pixel error", &app->lodPixelError, 0.1f, 0.1f, 20.0f);
     if (ImGui::CollapsingHeader("Final Render"))
     {
         ImGui::TextColored({ 1,0,0,1 }, "Final Render Texture");
         if (ImGui::BeginCombo("##custom combo", app->current_item, ImGuiComboFlags_NoArrowButton))
         {
-            for (int n = 0; n < 7; n++)
+            for (u32 n = 0; n < ARRAY_COUNT(app->items); n++)
             {
                 bool is_selected = (app->current_item == app->items[n]);
                 if (ImGui::Selectable(app->items[n], is_selected)) {
@@ -847,6 +1477,26 @@ void Gui(App* app)
             ImGui::EndCombo();
         }
     }
+    if (ImGui::CollapsingHeader("SSAO"))
+    {
+        SsaoPass& ssao = app->ssao;
+        const char* resolutions[] = { "Half", "Quarter" };
+        int resolution = ssao.resolutionDivisor == 4 ? 1 : 0;
+        if (ImGui::Combo("Resolution", &resolution, resolutions, ARRAY_COUNT(resolutions)))
+            ssao.resolutionDivisor = resolution == 1 ? 4 : 2;
+        ImGui::SliderInt("Samples", (int*)&ssao.sampleCount, 1, SSAO_MAX_SAMPLES);
+        ImGui::DragFloat("Radius", &ssao.radius, 0.01f, 0.01f, 5.0f);
+        ImGui::DragFloat("Bias", &ssao.bias, 0.001f, 0.0f, 0.5f);
+        ImGui::Checkbox("Blur", &ssao.blur);
+    }
+    if (ImGui::CollapsingHeader("GTAO"))
+    {
+        GtaoPass& gtao = app->gtao;
+        ImGui::SliderInt("Slices", (int*)&gtao.sliceCount, 1, GTAO_MAX_SLICES);
+        ImGui::SliderInt("Steps", (int*)&gtao.stepCount, 1, 16);
+        ImGui::DragFloat("Radius##gtao", &gtao.radius, 0.01f, 0.01f, 5.0f);
+        ImGui::Checkbox("Temporal", &gtao.temporal);
+    }
     if (ImGui::CollapsingHeader("Objects"))
     {
         if (ImGui::Button("Create Patrick")) {
@@ -1138,99 +1788,110 @@ void processInput(App* app)
 void Update(App* app)
 {
     processInput(app);
+    ProcessCompletedLoadJobs(app);
    
 
 
 
-    MapBuffer(app->cbuffer, GL_WRITE_ONLY);
-    app->globalParamsOffsetSecond = app->cbufferSecond.head;
+    // The draw constants of this frame follow in Render, the ring region stays mapped until then
+    BeginRingBufferFrame(app->cbuffer);
+    AlignHead(app->cbuffer, app->uniformBufferAlignment);
+    app->globalParamsOffset = GetBufferOffset(app->cbuffer);
 
-    
     PushVec3(app->cbuffer, app->camera->Position);
     glm::mat4 matrix = glm::inverse(app->camera->projection);
     PushMat4(app->cbuffer, app->camera->projection);
     PushMat4(app->cbuffer, matrix);
-    PushUInt(app->cbuffer, app->lights.size());
-    for (u32 i = 0; i < app->lights.size(); i++) {
-        AlignHead(app->cbuffer, sizeof(vec4));
-        Light* light = app->lights[i];
-        PushUInt(app->cbuffer, light->type);
-        PushVec3(app->cbuffer, light->color);
-        PushVec3(app->cbuffer, light->direction);
-        PushVec3(app->cbuffer, light->position);
-        PushUFloat(app->cbuffer, light->intensity);
-        PushUFloat(app->cbuffer, light->angle);
-    }
+    glm::mat4 view = app->camera->GetViewMatrix();
+    PushMat4(app->cbuffer, view);
+    PushMat4(app->cbuffer, glm::inverse(view));
+    // Lights live in their own storage buffer (see lighting.h)
     
-    app->globalParamsSize = app->cbuffer.head - app->globalParamsOffset;
-    UnmapBuffer(app->cbuffer);
+    app->globalParamsSize = GetBufferOffset(app->cbuffer) - app->globalParamsOffset;
 
     ////////////////////////////////////////////////////////////////////////////////
 
-    MapBuffer(app->cbufferSecond, GL_WRITE_ONLY);
-    app->globalParamsOffsetSecond = app->cbufferSecond.head;
+    AlignHead(app->cbuffer, app->uniformBufferAlignment);
+    app->globalParamsOffsetSecond = GetBufferOffset(app->cbuffer);
     
-    PushUFloat(app->cbufferSecond, -1);//left
-    PushUFloat(app->cbufferSecond, 1);//right
-    PushUFloat(app->cbufferSecond, -1);//bottom
-    PushUFloat(app->cbufferSecond, 1);//top
-
-    PushUFloat(app->cbufferSecond, app->camera->nearP);
-    PushUFloat(app->cbufferSecond, app->camera->farP);
+    PushUFloat(app->cbuffer, -1);//left
+    PushUFloat(app->cbuffer, 1);//right
+    PushUFloat(app->cbuffer, -1);//bottom
+    PushUFloat(app->cbuffer, 1);//top
+
+    PushUFloat(app->cbuffer, app->camera->nearP);
+    PushUFloat(app->cbuffer, app->camera->farP);
+    UpdateSsaoKernel(app);
     for (u32 i = 0; i < app->ssaoKernel.size(); i++) {
-        AlignHead(app->cbufferSecond, sizeof(vec4));
-        PushVec3(app->cbufferSecond, app->ssaoKernel[i]);
+        AlignHead(app->cbuffer, sizeof(vec4));
+        PushVec3(app->cbuffer, app->ssaoKernel[i]);
     }
-    app->globalParamsSizeSecond = app->cbufferSecond.head - app->globalParamsOffsetSecond;
-    UnmapBuffer(app->cbufferSecond);
+    app->globalParamsSizeSecond = GetBufferOffset(app->cbuffer) - app->globalParamsOffsetSecond;
 
 }
-GLuint FindVAO( Mesh mesh, int submeshIndex, Program program) {
-    Submesh& submesh = mesh.submeshes[submeshIndex];
-    for (u32 i = 0; i < (u32)submesh.vaos.size(); ++i) {
-        if (submesh.vaos[i].programHandle == program.handle) {
-            return submesh.vaos[i].handle;
-        }
-    }
-    GLuint vaoHandle = 0;
-
-    glGenVertexArrays(1, &vaoHandle);
-    
-    
-    glBindVertexArray(vaoHandle);
-
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBufferHandle);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBufferHandle);
-
-    for (u32 i = 0; i < program.vertexInputLayout.attributes.size(); ++i) {
-        bool attributeWasLinked = false;
-        for (u32 j = 0; j < submesh.vertexBufferLayout.attributes.size(); ++j) {
-            if (program.vertexInputLayout.attributes[i].location == submesh.vertexBufferLayout.attributes[j].location) {
-                const u32 index = submesh.vertexBufferLayout.attributes[j].location;
-               
-                const u32 ncomp = submesh.vertexBufferLayout.attributes[j].componenetCount;
-                const u32 offset = submesh.vertexBufferLayout.attributes[j].offset+submesh.vertexOffset;
-                const u32 stride = submesh.vertexBufferLayout.stride;
-                glVertexAttribPointer(index, ncomp, GL_FLOAT, GL_FALSE, stride, (void*)(u64)offset);
-                glEnableVertexAttribArray(index);
-                attributeWasLinked = true;
-                break;
-            }
-        }
-        assert(attributeWasLinked);
+GLuint FindVAO(App* app, Mesh& mesh, int submeshIndex, Program& program) {
+    return FindOrCreateVao(app->vaoCache, app->geometry, app->instanceBuffer.handle, mesh.submeshes[submeshIndex].vertexBufferLayout, program);
+}
+// Draws the meshlets of a submesh that pass the frustum and normal cone tests. Culling
+// happens in world space for the bounding spheres and in object space for the cones.
+// Visible meshlets that are next to each other in the index buffer share a single range.
+void DrawSubmeshMeshlets(App* app, const Submesh& submesh, const glm::mat4& modelMat, const Frustum& frustum)
+{
+    if (!app->meshletCulling || submesh.meshlets.empty())
+    {
+        glDrawElementsBaseVertex(GL_TRIANGLES, submesh.indexCount, submesh.indexType, (void*)(u64)submesh.indexOffset, submesh.baseVertex);
+        return;
     }
-    
-    glBindVertexArray(0);
-
 
+    vec3 axisScale = vec3(glm::length(vec3(modelMat[0])), glm::length(vec3(modelMat[1])), glm::length(vec3(modelMat[2])));
+    f32 maxScale = glm::max(axisScale.x, glm::max(axisScale.y, axisScale.z));
+    f32 minScale = glm::min(axisScale.x, glm::min(axisScale.y, axisScale.z));
 
+    // Cones are only valid while angles are preserved, non uniform scales skip the test
+    bool coneCulling = maxScale - minScale <= maxScale * 0.01f;
+    vec3 cameraPosition = vec3(glm::inverse(modelMat) * vec4(app->camera->Position, 1.0f));
 
+    const u32 indexSize = GetIndexSize(submesh.indexType);
+    app->meshletDrawCounts.clear();
+    app->meshletDrawOffsets.clear();
+    app->meshletDrawBaseVertices.clear();
 
+    u32 rangeStart = 0;
+    u32 rangeEnd = 0;
+    for (u32 i = 0; i < submesh.meshlets.size(); ++i)
+    {
+        const Meshlet& meshlet = submesh.meshlets[i];
+        vec3 center = vec3(modelMat * vec4(meshlet.center, 1.0f));
+        if (!IsSphereInFrustum(frustum, center, meshlet.radius * maxScale))
+            continue;
+        if (coneCulling && IsMeshletBackfacing(meshlet, cameraPosition))
+            continue;
+
+        app->meshletsDrawn++;
+        if (meshlet.indexOffset != rangeEnd)
+        {
+            if (rangeEnd > rangeStart)
+            {
+                app->meshletDrawCounts.push_back(rangeEnd - rangeStart);
+                app->meshletDrawOffsets.push_back((const void*)(u64)(submesh.indexOffset + rangeStart * indexSize));
+                app->meshletDrawBaseVertices.push_back(submesh.baseVertex);
+            }
+            rangeStart = meshlet.indexOffset;
+        }
+        rangeEnd = meshlet.indexOffset + meshlet.indexCount;
+    }
+    if (rangeEnd > rangeStart)
+    {
+        app->meshletDrawCounts.push_back(rangeEnd - rangeStart);
+        app->meshletDrawOffsets.push_back((const void*)(u64)(submesh.indexOffset + rangeStart * indexSize));
+        app->meshletDrawBaseVertices.push_back(submesh.baseVertex);
+    }
+    app->meshletsTotal += submesh.meshlets.size();
 
-    Vao vao = { vaoHandle,program.handle };
-    //submesh.vaos.push_back(vao);
-    return vaoHandle;
+    if (!app->meshletDrawCounts.empty())
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, app->meshletDrawCounts.data(), submesh.indexType, app->meshletDrawOffsets.data(), (GLsizei)app->meshletDrawCounts.size(), app->meshletDrawBaseVertices.data());
 }
+
 void Render(App* app)
 {
     switch (app->mode)
@@ -1242,63 +1903,213 @@ void Render(App* app)
                 glBindFramebuffer(GL_FRAMEBUFFER, app->gBuffer);
                 glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
                 glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(0), app->cbuffer.handle, app->globalParamsOffset, app->globalParamsSize);
-                glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(1), app->cbufferSecond.handle, app->globalParamsOffsetSecond, app->globalParamsSizeSecond);
+                glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(1), app->cbuffer.handle, app->globalParamsOffsetSecond, app->globalParamsSizeSecond);
     
                 glViewport(0, 0, app->displaySize.x, app->displaySize.y);
+
+                Frustum frustum = ExtractFrustum(app->camera->projection * app->camera->GetViewMatrix());
+                f32 pixelsPerUnit = app->displaySize.y / (2.0f * tanf(glm::radians(app->camera->FOV) * 0.5f));
+                app->meshletsTotal = 0;
+                app->meshletsDrawn = 0;
                 
-                for (int a = 0; a < app->sceneObjects.size(); a++) 
+                if (app->gpuDriven)
                 {
-                    Program& texturedMeshPRogram = app->programs[app->sceneObjects[a]->shaderID];
-                    glUseProgram(texturedMeshPRogram.handle);
-
-                    glUniformMatrix4fv(glGetUniformLocation(texturedMeshPRogram.handle, "view"), 1, GL_FALSE, &app->camera->GetViewMatrix()[0][0]);
-                    glUniformMatrix4fv(glGetUniformLocation(texturedMeshPRogram.handle, "projection"), 1, GL_FALSE, &app->camera->projection[0][0]);
-                    
-                    glUniform1i(glGetUniformLocation(texturedMeshPRogram.handle, "lightAffected"), app->sceneObjects[a]->showInGeneralList);
-                    if (!app->sceneObjects[a]->showInGeneralList&&app->lights.size()>0) 
+                    EndRingBufferWrites(app->cbuffer);
+                    UpdateGpuScene(app);
+                    if (app->occlusionCulling)
+                    {
+                        // Last frame's visible draws lay down the depth the rest is tested against
+                        CullGpuDraws(app, frustum, pixelsPerUnit, GpuCullingPhase_Early);
+                        SubmitGpuDraws(app);
+                        BuildDepthPyramid(app, app->gDepth);
+                        CullGpuDraws(app, frustum, pixelsPerUnit, GpuCullingPhase_Late);
+                        SubmitGpuDraws(app);
+                    }
+                    else
+                    {
+                        CullGpuDraws(app, frustum, pixelsPerUnit, GpuCullingPhase_All);
+                        SubmitGpuDraws(app);
+                    }
+                }
+                else
+                {
+                    // The BVH rejects whole objects, the submeshes of the rest are tested on their own
+                    app->visibleObjects.clear();
+                    if (app->frustumCulling)
+                    {
+                        UpdateCullingScene(app);
+                        UpdateSceneBvh(app);
+                        QueryBvhFrustum(app->sceneBvh, frustum, app->visibleObjects);
+                        CullScene(app->cullingScene, frustum);
+                    }
+                    else
                     {
-                        glUniform3fv(glGetUniformLocation(texturedMeshPRogram.handle, "ColorToPass"), 1, &app->sceneObjects[a]->lightAttached->color.x);
+                        for (u32 a = 0; a < app->sceneObjects.size(); a++)
+                            app->visibleObjects.push_back(a);
                     }
 
-                    glUniformMatrix4fv(glGetUniformLocation(texturedMeshPRogram.handle, "model"), 1, GL_FALSE, &app->sceneObjects[a]->modelMat[0][0]);
+                    // Every visible submesh of every object becomes a render item, sorted by the state it needs
+                    RenderQueue& queue = app->renderQueue;
+                    ClearRenderQueue(queue);
+                    for (u32 v = 0; v < app->visibleObjects.size(); v++)
+                    {
+                        u32 a = app->visibleObjects[v];
+                        Objects* object = app->sceneObjects[a];
+                        Model& model = app->models[object->meshID];
+                        Mesh& mesh = app->meshes[model.meshIdx];
+
+                        const glm::mat4& modelMat = object->modelMat;
+                        f32 distance = glm::length(vec3(modelMat[3]) - app->camera->Position);
+                        if (app->lodEnabled)
+                        {
+                            f32 objectScale = glm::max(glm::length(vec3(modelMat[0])), glm::max(glm::length(vec3(modelMat[1])), glm::length(vec3(modelMat[2]))));
+                            object->lod = SelectLod(mesh.lodErrors.data(), mesh.lodErrors.size(), object->lod, distance, pixelsPerUnit * objectScale, app->lodPixelError);
+                        }
+                        else
+                        {
+                            object->lod = 0;
+                        }
 
+                        f32 depth = distance / app->camera->farP;
+                        for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+                            if (!app->frustumCulling || app->cullingScene.visible[app->cullingScene.firstEntry[a] + i])
+                                PushRenderItem(queue, MakeSortKey(RenderPass_GBuffer, object->shaderID, model.materialIdx[i], model.meshIdx, depth), a, i);
+                    }
+                    SortRenderQueue(queue);
+                    BuildRenderBatches(app);
+                    UploadInstances(app->instanceBuffer);
 
-                    Model& model = app->models[app->sceneObjects[a]->meshID];
-                    Mesh& mesh = app->meshes[model.meshIdx];
-                    for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+                    // Single draws read their constants from a range of the ring, written all at once
+                    for (u32 n = 0; n < queue.batches.size(); ++n)
+                    {
+                        RenderBatch& batch = queue.batches[n];
+                        if (batch.itemCount > 1)
+                            continue;
+                        const RenderItem& item = queue.items[batch.firstItem];
+                        const Objects* object = app->sceneObjects[item.objectIdx];
+                        const Mesh& mesh = app->meshes[app->models[object->meshID].meshIdx];
+                        InstanceData constants = MakeInstanceData(app, object, mesh.submeshes[item.submeshIdx]);
+                        AlignHead(app->cbuffer, app->uniformBufferAlignment);
+                        batch.constantsOffset = GetBufferOffset(app->cbuffer);
+                        if (!PushData(app->cbuffer, &constants, sizeof(constants)))
+                            batch.constantsOffset = UINT32_MAX; // skipped this frame, the ring grows for the next one
+                    }
+                    EndRingBufferWrites(app->cbuffer);
+
+                    // Submission in key order, state is only set when it changes
+                    queue.drawCount = 0;
+                    queue.programChanges = 0;
+                    queue.textureChanges = 0;
+                    queue.instancedDraws = 0;
+                    queue.instanceCount = (u32)app->instanceBuffer.instances.size();
+                    u32 currentProgramIdx = UINT32_MAX;
+                    GLuint currentTexture = 0;
+                    GLuint currentVao = 0;
+                    glActiveTexture(GL_TEXTURE0);
+
+                    for (u32 n = 0; n < queue.batches.size(); ++n)
                     {
-                        GLuint vao = FindVAO(mesh, i, texturedMeshPRogram);
-                        glBindVertexArray(vao);
-                        u32 submeshMaterialIdx = model.materialIdx[i];
-                        Material& submeshMaterial = app->materials[submeshMaterialIdx];
-                        glActiveTexture(GL_TEXTURE0);
-                        if (app->textures.size() > 0) {
-
-                            glBindTexture(GL_TEXTURE_2D, app->textures[submeshMaterial.albedoTextureIdx].handle);
+                        const RenderBatch& batch = queue.batches[n];
+                        const RenderItem& item = queue.items[batch.firstItem];
+                        Objects* object = app->sceneObjects[item.objectIdx];
+                        Model& model = app->models[object->meshID];
+                        Mesh& mesh = app->meshes[model.meshIdx];
+
+                        // Instances take their matrix and colour from the instance buffer
+                        bool instanced = batch.itemCount > 1;
+                        if (!instanced && batch.constantsOffset == UINT32_MAX)
+                            continue;
+                        u32 programIdx = instanced ? app->programs[object->shaderID].instancedProgramIdx : object->shaderID;
+                        Program& texturedMeshPRogram = app->programs[programIdx];
+
+                        if (programIdx != currentProgramIdx)
+                        {
+                            currentProgramIdx = programIdx;
+                            queue.programChanges++;
+
+                            glUseProgram(texturedMeshPRogram.handle);
+                            glUniformMatrix4fv(GetProgramUniform(texturedMeshPRogram, ProgramUniform_View), 1, GL_FALSE, &app->camera->GetViewMatrix()[0][0]);
+                            glUniformMatrix4fv(GetProgramUniform(texturedMeshPRogram, ProgramUniform_Projection), 1, GL_FALSE, &app->camera->projection[0][0]);
                         }
 
-             
-                        Submesh& submesh = mesh.submeshes[i];
-                        glDrawElements(GL_TRIANGLES, submesh.indices.size(), GL_UNSIGNED_INT, (void*)(u64)submesh.indexOffset);
+                        if (!instanced)
+                            glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(2), app->cbuffer.handle, batch.constantsOffset, sizeof(InstanceData));
 
-                        if (app->textures.size() > 0) {
-                            glBindTexture(GL_TEXTURE_2D, 0);
+                        Material& submeshMaterial = app->materials[model.materialIdx[item.submeshIdx]];
+                        GLuint texture = app->textures.size() > 0 ? app->textures[submeshMaterial.albedoTextureIdx].handle : 0;
+                        if (texture != currentTexture)
+                        {
+                            currentTexture = texture;
+                            queue.textureChanges++;
+                            glBindTexture(GL_TEXTURE_2D, texture);
                         }
-                        glBindVertexArray(0);
-                        glDeleteVertexArrays(1, &vao);
+
+                        Submesh& submesh = mesh.submeshes[item.submeshIdx];
+                        GLuint vao = FindVAO(app, mesh, item.submeshIdx, texturedMeshPRogram);
+                        if (vao != currentVao)
+                        {
+                            currentVao = vao;
+                            glBindVertexArray(vao);
+                        }
+                        glUniform1i(GetProgramUniform(texturedMeshPRogram, ProgramUniform_OctahedralNormals), HasOctahedralNormals(submesh.vertexBufferLayout));
+
+                        if (instanced)
+                        {
+                            // Meshlet culling needs a single matrix, instances draw the whole LOD
+                            u32 indexCount = submesh.indexCount;
+                            u64 offset = submesh.indexOffset;
+                            if (batch.lod > 0)
+                            {
+                                const SubmeshLod& submeshLod = submesh.lods[batch.lod];
+                                indexCount = submeshLod.indexCount;
+                                offset += submeshLod.indexOffset * GetIndexSize(submesh.indexType);
+                            }
+                            glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, indexCount, submesh.indexType, (void*)offset, batch.itemCount, submesh.baseVertex, batch.firstInstance);
+                            queue.instancedDraws++;
+                        }
+                        else if (batch.lod == 0)
+                        {
+                            DrawSubmeshMeshlets(app, submesh, object->modelMat, frustum);
+                        }
+                        else
+                        {
+                            const SubmeshLod& submeshLod = submesh.lods[batch.lod];
+                            u64 offset = submesh.indexOffset + submeshLod.indexOffset * GetIndexSize(submesh.indexType);
+                            glDrawElementsBaseVertex(GL_TRIANGLES, submeshLod.indexCount, submesh.indexType, (void*)offset, submesh.baseVertex);
+                        }
+                        queue.drawCount++;
                     }
-                    
-                
-                
                 }
+                glBindVertexArray(0);
+                glBindTexture(GL_TEXTURE_2D, 0);
                 glBindFramebuffer(GL_FRAMEBUFFER, 0);
                 /// //////////////////////////////////////////////////////////////////////
                 glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+                UploadLights(app);
+                if (app->lightingPath == LightingPath_Clustered)
+                    AssignLightsToClusters(app);
+                else if (app->lightingPath == LightingPath_Volumes)
+                    RenderLightVolumes(app, frustum);
+                // The ssao view and the final render with ssao
+                bool ambientOcclusion = app->selectedFrameBuffer == 4 || app->selectedFrameBuffer == 6;
+                if (ambientOcclusion)
+                    RenderSsao(app);
+                // The history only follows frames that went through the pass
+                bool groundTruthOcclusion = app->selectedFrameBuffer == 7;
+                if (groundTruthOcclusion)
+                    RenderGtao(app);
+                else
+                    app->gtao.historyValid = false;
+
                 Program& texturedQuadPRogram = app->programs[app->texturedQuadProgramIdx];
 
                 glUseProgram(texturedQuadPRogram.handle);
-                glUniform1i(glGetUniformLocation(texturedQuadPRogram.handle, "FinalRenderID"), app->selectedFrameBuffer);
+                glUniform1i(GetProgramUniform(texturedQuadPRogram, ProgramUniform_FinalRenderID), app->selectedFrameBuffer);
+                glUniform1i(GetProgramUniform(texturedQuadPRogram, ProgramUniform_LightingPath), app->lightingPath);
+                glUniform1i(GetProgramUniform(texturedQuadPRogram, ProgramUniform_SsaoDivisor), groundTruthOcclusion ? GTAO_RESOLUTION_DIVISOR : app->ssao.divisor);
+                glUniform1ui(GetProgramUniform(texturedQuadPRogram, ProgramUniform_LightCount), app->lightClusters.lightCount);
+                glUniform1ui(GetProgramUniform(texturedQuadPRogram, ProgramUniform_DirectionalLightCount), app->lightClusters.directionalLightCount);
 
                 //
                       
@@ -1306,18 +2117,16 @@ void Render(App* app)
 
 
                 //
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, app->gPosition);
                 glActiveTexture(GL_TEXTURE1);
                 glBindTexture(GL_TEXTURE_2D, app->gNormal);
                 glActiveTexture(GL_TEXTURE2);
                 glBindTexture(GL_TEXTURE_2D, app->gAlbedoSpec);
                 glActiveTexture(GL_TEXTURE3);
                 glBindTexture(GL_TEXTURE_2D, app->gDepth);
-                glActiveTexture(GL_TEXTURE4);
-                glBindTexture(GL_TEXTURE_2D, app->ggPosition);
-                glActiveTexture(GL_TEXTURE5);
-                glBindTexture(GL_TEXTURE_2D, app->ggNormal);
+                glActiveTexture(GL_TEXTURE6);
+                glBindTexture(GL_TEXTURE_2D, app->lightVolumes.accumulationTexture);
+                glActiveTexture(GL_TEXTURE7);
+                glBindTexture(GL_TEXTURE_2D, groundTruthOcclusion ? GetGtaoTexture(app->gtao) : app->ssao.occlusionTextures[0]);
                 
                 glBindVertexArray(app->VAO);
                 glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
@@ -1336,7 +2145,6 @@ void Render(App* app)
                 glBindTexture(GL_TEXTURE2, 0);
                 glBindTexture(GL_TEXTURE2, 0);
                 glBindTexture(GL_TEXTURE2, 0);
-                glUnmapBuffer(GL_UNIFORM_BUFFER);
                 glBindBuffer(GL_UNIFORM_BUFFER, 0);
                 
             }
@@ -1344,5 +2152,24 @@ void Render(App* app)
 
         default:;
     }
+
+    FenceRingBufferFrame(app->cbuffer);
+}
+void Shutdown(App* app)
+{
+    StopAssetLoader(*app->loader);
+    delete app->loader;
+    app->loader = nullptr;
+
+    DestroyVaoCache(app->vaoCache);
+    DestroyInstanceBuffer(app->instanceBuffer);
+    DestroyGpuScene(app->gpuScene);
+    DestroyDepthPyramid(app->depthPyramid);
+    DestroyLightClusters(app->lightClusters);
+    DestroyLightVolumes(app->lightVolumes);
+    DestroySsao(app->ssao);
+    DestroyGtao(app->gtao);
+    DestroyRingBuffer(app->cbuffer);
+    DestroyGeometryArena(app->geometry);
 }
 
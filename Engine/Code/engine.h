@@ -15,6 +15,7 @@
 #include <vector>
 #include <string>
 #include <random>
+#include <unordered_map>
 #define BINDING(b) b
 typedef glm::vec2  vec2;
 typedef glm::vec3  vec3;
@@ -23,10 +24,13 @@ typedef glm::ivec2 ivec2;
 typedef glm::ivec3 ivec3;
 typedef glm::ivec4 ivec4;
 class Objects;
+struct AssetLoader;
 struct VertexBufferAttribute {
     u8 location;
     u8 componenetCount;
     u8 offset;
+    GLenum type = GL_FLOAT;
+    bool normalized = false;
 };
 struct VertexBufferLayout {
     std::vector<VertexBufferAttribute> attributes;
@@ -34,25 +38,80 @@ struct VertexBufferLayout {
 };
 struct Vao {
     GLuint handle;
-    GLuint programHandle;
+};
+// VAOs shared by every submesh with the same vertex format and program inputs (see vaocache.h)
+struct VaoCache {
+    std::unordered_map<u64, Vao> vaos; // hash of formats and buffers -> VAO
+    u32 geometryGeneration;            // arena generation the buffers were bound at
+    u32 hits;
+    u32 misses;
 };
 struct Model {
     u32 meshIdx;
     std::vector<u32> materialIdx;
 };
+// Cluster of at most MESHLET_MAX_VERTICES vertices and MESHLET_MAX_TRIANGLES triangles
+// that occupies a contiguous range of the submesh indices (see meshlet.h)
+struct Meshlet {
+    u32 indexOffset; // relative to the first index of the submesh
+    u32 indexCount;
+    vec3 center;     // bounding sphere, object space
+    f32 radius;
+    vec3 coneApex;   // normal cone, object space
+    f32 coneCutoff;
+    vec3 coneAxis;
+    u32 padding;
+};
+// Simplified version of a submesh, an index range over the same vertices (see simplify.h)
+struct SubmeshLod {
+    u32 indexOffset; // relative to the first index of the submesh
+    u32 indexCount;
+    f32 error;       // object space distance to the full detail surface
+};
 struct Submesh {
     VertexBufferLayout vertexBufferLayout;
     std::vector<float> vertices;
     std::vector<u32> indices;
-    u32 vertexOffset;
-    u32 indexOffset;
-    std::vector<Vao> vaos;
+    u32 vertexOffset;   // bytes into the vertex heap of the geometry arena, a multiple of the stride
+    u32 vertexDataSize;
+    u32 baseVertex;     // vertexOffset / stride, passed to the BaseVertex draws
+    u32 indexOffset;    // bytes into the index heap of the geometry arena
+    u32 indexDataSize;  // full detail mesh and all its LODs
+    u32 indexCount;  // full detail mesh, the LODs follow it in the index buffer
+    GLenum indexType = GL_UNSIGNED_INT;
+    // Compact vertices (see vertexformat.h) store positions relative to the submesh bounds
+    vec3 positionScale = vec3(1.0f);
+    vec3 positionOffset = vec3(0.0f);
+    std::vector<Meshlet> meshlets;     // full detail mesh only
+    std::vector<SubmeshLod> lods;      // lods[0] is the full detail mesh, empty if there are none
+    // Object space bounds of the decoded positions, the sphere shares the center of the box
+    vec3 boundsCenter = vec3(0.0f);
+    vec3 boundsExtent = vec3(0.0f);
+    f32 boundsRadius = 0.0f;
 
 };
 struct Mesh {
     std::vector<Submesh> submeshes;
-    GLuint vertexBufferHandle;
-    GLuint indexBufferHandle;
+    std::vector<f32> lodErrors; // largest error of every LOD among the submeshes
+};
+// Free range of a geometry heap
+struct GeometryBlock {
+    u32 offset;
+    u32 size;
+};
+// One GL buffer sub-allocated with a free list (see geometryarena.h)
+struct GeometryHeap {
+    GLuint handle;
+    GLenum target;
+    u32 capacity;
+    u32 usedSize;
+    std::vector<GeometryBlock> freeBlocks; // sorted by offset, adjacent blocks are merged
+};
+// Vertices and indices of every mesh live in two shared buffers
+struct GeometryArena {
+    GeometryHeap vertices;
+    GeometryHeap indices;
+    u32 generation; // changes whenever the buffers are recreated, VAOs made before are stale
 };
 struct Material {
     std::string name;
@@ -65,6 +124,30 @@ struct Material {
     u32 normalsTextureIdx;
     u32 bumpTextureIdx;
 };
+enum MaterialTextureSlot {
+    MaterialTexture_Albedo,
+    MaterialTexture_Emissive,
+    MaterialTexture_Specular,
+    MaterialTexture_Normals,
+    MaterialTexture_Bump,
+    MaterialTexture_Count
+};
+// CPU side description of a material as it comes out of an importer. Texture
+// paths are relative to the model directory and empty when the slot is unused.
+struct MaterialImport {
+    std::string name;
+    vec3 albedo;
+    vec3 emissive;
+    f32 smoothness;
+    std::string textures[MaterialTexture_Count];
+};
+// Everything an importer produces for a model before touching OpenGL, so it can
+// be either uploaded straight away or written to a cooked mesh file.
+struct ModelImport {
+    Mesh mesh;
+    std::vector<MaterialImport> materials;
+    std::vector<u32> submeshMaterialIndices;
+};
 struct Image
 {
     void* pixels;
@@ -77,6 +160,22 @@ struct Texture
 {
     GLuint      handle;
     std::string filepath;
+    u64         contentHash; // 0 until the texels are known (see textureregistry.h)
+    u64         size;        // bytes uploaded to the GPU
+};
+struct TexturePathEntry
+{
+    std::string path;  // normalized
+    u32         texIdx;
+};
+struct TextureRegistry
+{
+    std::unordered_map<u64, TexturePathEntry> pathToTexture; // normalized path hash -> texture
+    std::unordered_map<u64, u32> contentToTexture; // texel hash -> texture owning the GL object
+    u32 pathHits;
+    u32 contentHits;
+    u32 misses;
+    u64 bytesSaved;
 };
 struct VertexShaderAttribute
 {
@@ -87,13 +186,66 @@ struct VertexShaderLayout
 {
     std::vector<VertexShaderAttribute> attributes;
 };
+enum ProgramResourceKind
+{
+    ProgramResource_Uniform,
+    ProgramResource_Sampler,
+    ProgramResource_UniformBlock,
+    ProgramResource_Input,
+    ProgramResource_Count
+};
+// Uniforms the renderer sets every frame, their locations are resolved once at link time
+enum ProgramUniform
+{
+    ProgramUniform_View,
+    ProgramUniform_Projection,
+    ProgramUniform_OctahedralNormals,
+    ProgramUniform_FinalRenderID,
+    ProgramUniform_FrustumPlanes,
+    ProgramUniform_CameraPosition,
+    ProgramUniform_PixelsPerUnit,
+    ProgramUniform_LodPixelError,
+    ProgramUniform_DrawCount,
+    ProgramUniform_CullingPhase,
+    ProgramUniform_SourceLevel,
+    ProgramUniform_LightCount,
+    ProgramUniform_DirectionalLightCount,
+    ProgramUniform_LightingPath,
+    ProgramUniform_Model,
+    ProgramUniform_LightIndex,
+    ProgramUniform_SsaoSampleCount,
+    ProgramUniform_SsaoRadius,
+    ProgramUniform_SsaoBias,
+    ProgramUniform_SsaoDivisor,
+    ProgramUniform_BlurDirection,
+    ProgramUniform_PreviousViewProjection,
+    ProgramUniform_GtaoSliceCount,
+    ProgramUniform_GtaoStepCount,
+    ProgramUniform_GtaoRadius,
+    ProgramUniform_FrameIndex,
+    ProgramUniform_HistoryValid,
+    ProgramUniform_Count
+};
+struct ProgramResource
+{
+    std::string         name;
+    ProgramResourceKind kind;
+    GLenum              type;     // GL_FLOAT_MAT4, GL_SAMPLER_2D... GL_UNIFORM_BLOCK for blocks
+    GLint               location; // binding point for blocks
+    u32                 size;     // array elements, bytes for blocks
+};
 struct Program
 {
     GLuint             handle;
     std::string        filepath;
     std::string        programName;
     u64                lastWriteTimestamp; // What is this for?
-    VertexShaderLayout vertexInputLayout;
+    VertexShaderLayout vertexInputLayout;  // active inputs, filled by reflection
+    u32                instancedProgramIdx = UINT32_MAX; // same shader built with INSTANCED
+
+    std::vector<ProgramResource>  resources;        // see programreflection.h
+    std::unordered_map<u64, u32>  resourceByName;   // hash of kind and name -> resource index
+    GLint                         uniformLocations[ProgramUniform_Count];
 };
 
 enum Mode
@@ -123,6 +275,9 @@ const u16 indices[] = {
     0,1,2,
     0,2,3
 };
+#define BUFFER_RING_FRAMES 3 // frames the CPU may write ahead of the GPU
+#define CONSTANT_RING_FRAME_SIZE MB(1)
+
 class Buffer {
 public:
     u32 size;
@@ -130,7 +285,13 @@ public:
     GLuint handle;
     int head;
     u8* data;
-
+    // Ring buffers (see CreateRingBuffer) are split in one region per frame in flight, head
+    // and data are relative to the region of the current frame
+    u32 frameSize;  // 0 for plain buffers
+    u32 frameIndex;
+    u32 overflowSize; // bytes that did not fit in the region this frame, the ring grows by the next one
+    GLsync fences[BUFFER_RING_FRAMES];
+    u8* persistentData; // whole buffer, mapped for its lifetime when there is buffer storage
 };
 
 enum LightType {
@@ -177,12 +338,208 @@ public:
     int showInGeneralList;
     int shaderID;
     int meshID;
+    u32 lod = 0;
     glm::mat4 modelMat;
     vec3 position = { 0,0,0 };
     vec3 scale = { 1,1,1 };
     vec3 rotation = { 0,0,0 };
     Light* lightAttached=nullptr;
 };
+// Draw of one submesh of a scene object, ordered by its sort key (see renderqueue.h)
+struct RenderItem
+{
+    u64 key;
+    u32 objectIdx;
+    u32 submeshIdx;
+};
+// Adjacent render items drawn with a single call, more than one item makes an instanced draw
+struct RenderBatch
+{
+    u32 firstItem;
+    u32 itemCount;
+    u32 lod;
+    u32 firstInstance;   // into the instance buffer, unused for a single item
+    u32 constantsOffset; // LocalParams of a single item in the constant ring buffer
+};
+// World space bounds of every submesh of every scene object as a structure of arrays, padded
+// so the culling kernel loads several of them per instruction (see culling.h)
+struct CullingScene
+{
+    std::vector<u32> firstEntry;       // per scene object, its submeshes follow in order
+    std::vector<glm::mat4> transforms; // per scene object, modelMat the bounds were computed with
+    std::vector<f32> centerX, centerY, centerZ;
+    std::vector<f32> extentX, extentY, extentZ;
+    std::vector<f32> radius;
+    std::vector<u8> visible;
+    std::vector<u32> movedObjects; // objects whose bounds were transformed by the last update
+    u32 entryCount;
+    u32 visibleCount;
+    u32 layoutVersion; // changes whenever the entries are laid out again
+    bool dirty = true; // objects or meshes changed, the entries have to be laid out again
+};
+// Node of the scene BVH, the two children of an inner node are next to each other
+struct BvhNode
+{
+    vec3 boundsMin;
+    u32  first;       // first child for inner nodes, first entry of SceneBvh::objects for leaves
+    vec3 boundsMax;
+    u32  objectCount; // 0 for inner nodes
+};
+// Bounding volume hierarchy over the world boxes of the scene objects (see scenebvh.h)
+struct SceneBvh
+{
+    std::vector<BvhNode> nodes;      // nodes[0] is the root
+    std::vector<u32> parents;        // per node
+    std::vector<u32> objects;        // scene object indices, each leaf owns a contiguous range
+    std::vector<u32> objectLeaves;   // per scene object, the leaf that holds it
+    std::vector<vec3> objectMin;     // per scene object, world box
+    std::vector<vec3> objectMax;
+    u32 layoutVersion;               // CullingScene::layoutVersion the tree was built for
+    f32 buildCost;                   // SAH cost right after the last build
+    f32 cost;                        // SAH cost after the last refit
+    u32 builds;
+    u32 refits;
+};
+struct RenderQueue
+{
+    std::vector<RenderItem> items;
+    std::vector<RenderItem> sortBuffer;
+    std::vector<RenderBatch> batches;
+    // Last frame
+    u32 drawCount;
+    u32 programChanges;
+    u32 textureChanges;
+    u32 instancedDraws;
+    u32 instanceCount;
+};
+// GPU driven G-buffer pass, draws are culled and written by a compute shader (see gpudriven.h)
+struct GpuDrawBucket
+{
+    u32    programIdx;    // instanced variant
+    u32    materialIdx;
+    u32    meshIdx;       // first draw of the bucket, its submesh gives the vertex format
+    u32    submeshIdx;
+    GLenum indexType;
+    u32    firstCommand;
+    u32    commandCount;
+};
+struct GpuScene
+{
+    GLuint objectBuffer;   // GpuObject per scene object
+    GLuint drawBuffer;     // GpuDraw per object submesh
+    GLuint commandBuffer;  // DrawElementsIndirectCommand per draw, written by the culling
+    GLuint instanceBuffer; // InstanceData per draw, written by the culling
+    GLuint visibilityBuffer; // u32 per draw, whether it passed the occlusion test last frame
+    u32    objectCapacity; // elements
+    u32    drawCapacity;
+    u32    drawCount;
+    u32    cullingProgramIdx;
+    u32    geometryGeneration;
+    bool   dirty;          // objects or meshes changed, the draws have to be rebuilt
+    std::vector<GpuDrawBucket> buckets;
+};
+// Max depth mip chain of the G-buffer depth, for occlusion culling (see depthpyramid.h)
+struct DepthPyramid
+{
+    GLuint texture;
+    ivec2  size;       // level 0, the largest powers of two that fit in the source
+    ivec2  sourceSize;
+    u32    levelCount;
+    u32    buildProgramIdx;
+};
+// std430 layout of a light in the light buffer (see lighting.h)
+struct GpuLight
+{
+    vec4 positionRange;     // world space, w = distance at which the light is cut off
+    vec4 colorIntensity;
+    vec4 directionCosAngle; // normalized, w = cosine of the spot cone half angle, -2 otherwise
+};
+// Lights in a storage buffer and their per cluster lists (see lighting.h)
+struct LightClusters
+{
+    GLuint lightBuffer;        // GpuLight per light, directional ones first
+    GLuint clusterCountBuffer; // u32 per cluster
+    GLuint clusterIndexBuffer; // CLUSTER_MAX_LIGHTS light indices per cluster
+    u32    lightCapacity;      // elements
+    u32    lightCount;
+    u32    directionalLightCount;
+    u32    clusteringProgramIdx;
+    u32    uploadedLights;     // last frame
+    std::vector<GpuLight> lights;         // packed this frame
+    std::vector<GpuLight> bufferContents; // what the light buffer holds, to upload only the changes
+};
+// Point and spot lights drawn as stencil tested volumes (see lightvolumes.h)
+struct LightVolumes
+{
+    GLuint framebuffer;         // accumulation color, depth stencil
+    GLuint accumulationTexture; // RGBA16F
+    GLuint depthStencil;        // G-buffer depth, copied every frame
+    GLuint vao;
+    GLuint vertexBuffer;
+    GLuint indexBuffer;         // u16, the sphere then the cone
+    u32    sphereIndexCount;
+    u32    coneFirstIndex;
+    u32    coneIndexCount;
+    u32    coneBaseVertex;
+    u32    programIdx;
+    u32    stencilProgramIdx;
+    u32    drawnLights;         // last frame
+};
+// Ambient occlusion at a fraction of the display resolution (see ssao.h)
+struct SsaoPass
+{
+    GLuint framebuffers[2];
+    GLuint occlusionTextures[2]; // R8, the result ends in the first one, the blur goes through the second
+    GLuint noiseTexture;         // RG16F rotations, SSAO_NOISE_SIZE squared
+    ivec2  size;
+    u32    divisor;              // of the current targets
+    u32    kernelSampleCount;    // samples in app->ssaoKernel
+    u32    programIdx;
+    u32    blurProgramIdx;
+    // Settings
+    u32    resolutionDivisor = 2; // 2 or 4
+    u32    sampleCount = 16;
+    f32    radius = 0.5f;         // view space
+    f32    bias = 0.025f;
+    bool   blur = true;
+};
+// Compute ground truth ambient occlusion with temporal accumulation (see gtao.h)
+struct GtaoPass
+{
+    GLuint    historyTextures[2];  // RG16F occlusion and view depth, written in turns
+    ivec2     size;
+    u32       frameIndex;
+    bool      historyValid;        // false until a frame is written and whenever a frame skips the pass
+    glm::mat4 previousViewProjection = glm::mat4(1.0f);
+    u32       programIdx;
+    // Settings
+    u32       sliceCount = 2;      // up to GTAO_MAX_SLICES
+    u32       stepCount = 4;       // per side of every slice
+    f32       radius = 0.5f;       // view space
+    bool      temporal = true;
+};
+// How the deferred pass gathers the lights of a pixel, the values are read by quad.glsl
+enum LightingPath
+{
+    LightingPath_AllLights, // every light of GlobalParams for every pixel
+    LightingPath_Clustered,
+    LightingPath_Volumes,
+    LightingPath_Count
+};
+// Per instance vertex inputs of the instanced programs (see instancing.h)
+struct InstanceData
+{
+    glm::mat4 model;
+    vec4      color;          // ColorToPass in rgb, lightAffected in a
+    vec4      positionScale;  // dequantization of compact vertices, per submesh
+    vec4      positionOffset;
+};
+struct InstanceBuffer
+{
+    GLuint handle;
+    u32    capacity; // bytes
+    std::vector<InstanceData> instances;
+};
 struct App
 {
 
@@ -202,25 +559,58 @@ struct App
     int globalParamsSize;
     int globalParamsOffsetSecond;
     int globalParamsSizeSecond;
-    Buffer cbuffer;
-    Buffer cbufferSecond;
+    Buffer cbuffer; // ring of global, per pass and per draw constants
+    u32 uniformBufferAlignment;
     int selectedFrameBuffer = 6;
     const char* current_item="Final Render SSAO";
-    const char* items[7] = { "Albedo", "Normal", "Position","Depth","ssao","Final Render NO SSAO","Final Render SSAO" };
+    const char* items[8] = { "Albedo", "Normal", "Position","Depth","ssao","Final Render NO SSAO","Final Render SSAO","Final Render GTAO" };
     unsigned int gBuffer;
-    unsigned int gPosition, gNormal, gAlbedoSpec,gDepth, ssao, ggPosition, ggNormal;
+    unsigned int gNormal, gAlbedoSpec, gDepth;
     /// ////////////////////////////
     /// ////////////////////////////
     std::vector<Texture> textures;
+    TextureRegistry textureRegistry;
     std::vector<Material> materials;
     std::vector<Mesh> meshes;
+    GeometryArena geometry;
+    RenderQueue renderQueue;
+    VaoCache vaoCache;
+    InstanceBuffer instanceBuffer;
+    GpuScene gpuScene;
+    DepthPyramid depthPyramid;
+    LightClusters lightClusters;
+    LightVolumes lightVolumes;
+    SsaoPass ssao;
+    GtaoPass gtao;
+    CullingScene cullingScene;
+    SceneBvh sceneBvh;
+    std::vector<u32> visibleObjects; // scene objects whose box intersects the frustum, last frame
     std::vector<Model> models;
     std::vector<Program> programs;
+    // Asset streaming
+    AssetLoader* loader;
+    u64 loadUploadBudget = MB(4); // bytes uploaded per frame for finished loads
+    bool compactVertices = true;  // quantized vertices and 16 bit indices (see vertexformat.h)
+    // Culling
+    bool frustumCulling = true;
+    bool meshletCulling = true;
+    bool instancing = true;
+    bool gpuDriven = false;
+    bool occlusionCulling = true; // two phase Hi-Z culling of the GPU driven pass
+    u32 meshletsTotal;   // meshlets of the drawn submeshes, last frame
+    u32 meshletsDrawn;   // meshlets that passed the frustum and cone tests, last frame
+    std::vector<GLsizei> meshletDrawCounts;
+    std::vector<const void*> meshletDrawOffsets;
+    std::vector<GLint> meshletDrawBaseVertices;
+    // LOD selection
+    bool lodEnabled = true;
+    f32 lodPixelError = 1.0f; // projected error allowed before switching to a finer LOD
     // Loop
     f32  deltaTime;
     bool isRunning;
     //lights
     std::vector<Light*>lights;
+    LightingPath lightingPath = LightingPath_Clustered;
     
     // Input
     Input input;
@@ -229,6 +619,8 @@ struct App
     char gpuName[64];
     char openGlVersion[64];
     OpenGlInfo glinfo;
+    bool supportsS3TC; // BC1/BC3 cooked textures are only used when the driver exposes them
+    bool supportsBufferStorage; // GL_ARB_buffer_storage, persistently mapped ring buffers
     ivec2 displaySize;
 
     Camera* camera;
@@ -255,7 +647,10 @@ struct App
     // Location of the texture uniform in the textured quad shader
     // VAO object to link our screen filling quad with our textured quad shader
 };
+Image LoadImage(const char* filename);
+void FreeImage(Image image);
 u32 LoadTexture2D(App* app, const char* filepath);
+u32 LoadTexture2DAsync(App* app, const char* filepath);
 void Init(App* app);
 
 void Gui(App* app);
@@ -264,8 +659,28 @@ void Update(App* app);
 
 void Render(App* app);
 
+void Shutdown(App* app);
+
 void ProcessAssimpMesh(const aiScene* scene, aiMesh* mesh, Mesh* myMesh, u32 baseMeshMaterialIndex, std::vector<u32>& submeshMaterialIndices);
-void ProcessAssimpMaterial(App* app, aiMaterial* material, Material& myMaterial, String directory);
+void ProcessAssimpMaterial(aiMaterial* material, MaterialImport& myMaterial);
 void ProcessAssimpNode(const aiScene* scene, aiNode* node, Mesh* myMesh, u32 baseMeshMaterialIndex, std::vector<u32>& submeshMaterialIndices);
+bool ImportModelAssimp(const char* filename, ModelImport& model);
+bool ImportModel(const char* filename, ModelImport& model);
+void ProcessModelImport(ModelImport& model, const char* name);
+
+void FreeMeshGeometry(App* app, Mesh& mesh);
+void UnloadModel(App* app, u32 modelIdx);
+void DefragmentGeometry(App* app);
 u32 LoadModel(App* app, const char* filename);
+u32 LoadModelAsync(App* app, const char* filename);
+
+struct CookOptions
+{
+    const char* textureFormat = NULL; // only applies to images, NULL lets the cooker pick one
+    bool compactVertices = true;      // only applies to models (see vertexformat.h)
+};
+
+// Cooks a source asset into its engine ready binary form (see meshcook.h and texturecook.h).
+// It does not need an OpenGL context, so it can run from the command line.
+bool CookAsset(const char* filepath, const CookOptions& options);
 
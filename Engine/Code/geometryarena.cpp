@@ -0,0 +1,187 @@
+//
+// geometryarena.cpp : Shared vertex and index buffers (see geometryarena.h).
+//
+// Heaps are only touched through the copy targets, so uploading or moving geometry never
+// changes the element buffer of whichever VAO happens to be bound.
+//
+
+#include "geometryarena.h"
+#include <algorithm>
+
+static GLuint CreateHeapBuffer(u32 capacity)
+{
+    GLuint handle;
+    glGenBuffers(1, &handle);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, handle);
+    glBufferData(GL_COPY_WRITE_BUFFER, capacity, NULL, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    return handle;
+}
+
+static void CreateGeometryHeap(GeometryHeap& heap, GLenum target, u32 capacity)
+{
+    heap.handle = CreateHeapBuffer(capacity);
+    heap.target = target;
+    heap.capacity = capacity;
+    heap.usedSize = 0;
+    heap.freeBlocks.clear();
+    heap.freeBlocks.push_back(GeometryBlock{ 0, capacity });
+}
+
+void CreateGeometryArena(GeometryArena& arena, u32 vertexCapacity, u32 indexCapacity)
+{
+    CreateGeometryHeap(arena.vertices, GL_ARRAY_BUFFER, vertexCapacity);
+    CreateGeometryHeap(arena.indices, GL_ELEMENT_ARRAY_BUFFER, indexCapacity);
+    arena.generation++;
+}
+
+void DestroyGeometryArena(GeometryArena& arena)
+{
+    glDeleteBuffers(1, &arena.vertices.handle);
+    glDeleteBuffers(1, &arena.indices.handle);
+    arena.vertices = {};
+    arena.indices = {};
+    arena.generation++;
+}
+
+static u32 AlignUp(u32 value, u32 alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static void GrowGeometryHeap(GeometryArena& arena, GeometryHeap& heap, u32 minCapacity)
+{
+    u32 capacity = heap.capacity * 2;
+    while (capacity < minCapacity)
+        capacity *= 2;
+
+    GLuint handle = CreateHeapBuffer(capacity);
+    glBindBuffer(GL_COPY_READ_BUFFER, heap.handle);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, handle);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, heap.capacity);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glDeleteBuffers(1, &heap.handle);
+
+    ILOG("Geometry heap grown from %u to %u bytes", heap.capacity, capacity);
+
+    u32 oldCapacity = heap.capacity;
+    heap.handle = handle;
+    heap.capacity = capacity;
+    FreeGeometry(heap, oldCapacity, capacity - oldCapacity);
+    heap.usedSize += capacity - oldCapacity; // FreeGeometry accounts for it as released
+    arena.generation++;
+}
+
+u32 AllocateGeometry(GeometryArena& arena, GeometryHeap& heap, u32 size, u32 alignment)
+{
+    ASSERT(alignment > 0, "Geometry allocations need an alignment");
+    if (size == 0)
+        return 0; // nothing to free later either
+
+    for (;;)
+    {
+        for (u32 i = 0; i < heap.freeBlocks.size(); ++i)
+        {
+            GeometryBlock block = heap.freeBlocks[i];
+            u32 offset = AlignUp(block.offset, alignment);
+            if (offset + size > block.offset + block.size)
+                continue;
+
+            // Whatever is left on both sides of the allocation stays free
+            heap.freeBlocks.erase(heap.freeBlocks.begin() + i);
+            u32 blockEnd = block.offset + block.size;
+            if (blockEnd > offset + size)
+                heap.freeBlocks.insert(heap.freeBlocks.begin() + i, GeometryBlock{ offset + size, blockEnd - offset - size });
+            if (offset > block.offset)
+                heap.freeBlocks.insert(heap.freeBlocks.begin() + i, GeometryBlock{ block.offset, offset - block.offset });
+
+            heap.usedSize += size;
+            return offset;
+        }
+
+        GrowGeometryHeap(arena, heap, heap.capacity + size + alignment);
+    }
+}
+
+void FreeGeometry(GeometryHeap& heap, u32 offset, u32 size)
+{
+    if (size == 0)
+        return;
+
+    auto next = std::lower_bound(heap.freeBlocks.begin(), heap.freeBlocks.end(), offset,
+        [](const GeometryBlock& block, u32 offset) { return block.offset < offset; });
+    u32 i = (u32)(next - heap.freeBlocks.begin());
+    heap.freeBlocks.insert(next, GeometryBlock{ offset, size });
+    heap.usedSize -= size;
+
+    // Merge with the following and the preceding blocks
+    if (i + 1 < heap.freeBlocks.size() && offset + size == heap.freeBlocks[i + 1].offset)
+    {
+        heap.freeBlocks[i].size += heap.freeBlocks[i + 1].size;
+        heap.freeBlocks.erase(heap.freeBlocks.begin() + i + 1);
+    }
+    if (i > 0 && heap.freeBlocks[i - 1].offset + heap.freeBlocks[i - 1].size == offset)
+    {
+        heap.freeBlocks[i - 1].size += heap.freeBlocks[i].size;
+        heap.freeBlocks.erase(heap.freeBlocks.begin() + i);
+    }
+}
+
+bool ValidateGeometryHeap(const GeometryHeap& heap)
+{
+    u64 freeSize = 0;
+    for (u32 i = 0; i < heap.freeBlocks.size(); ++i)
+    {
+        const GeometryBlock& block = heap.freeBlocks[i];
+        if (block.size == 0 || (u64)block.offset + block.size > heap.capacity)
+            return false;
+        if (i > 0 && heap.freeBlocks[i - 1].offset + heap.freeBlocks[i - 1].size >= block.offset)
+            return false;
+        freeSize += block.size;
+    }
+    return freeSize + heap.usedSize <= heap.capacity;
+}
+
+void UploadGeometry(GeometryHeap& heap, u32 offset, u32 size, const void* data)
+{
+    ASSERT((u64)offset + size <= heap.capacity, "Geometry upload out of the heap");
+    glBindBuffer(GL_COPY_WRITE_BUFFER, heap.handle);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void CompactGeometryHeap(GeometryArena& arena, GeometryHeap& heap, std::vector<GeometryRange>& ranges)
+{
+    std::sort(ranges.begin(), ranges.end(), [](const GeometryRange& a, const GeometryRange& b) { return *a.offset < *b.offset; });
+
+    // Copying within a buffer is undefined when the ranges overlap, move into a new one
+    GLuint handle = CreateHeapBuffer(heap.capacity);
+    glBindBuffer(GL_COPY_READ_BUFFER, heap.handle);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, handle);
+
+    u32 end = 0;
+    u32 usedSize = 0;
+    for (u32 i = 0; i < ranges.size(); ++i)
+    {
+        GeometryRange& range = ranges[i];
+        if (range.size == 0)
+            continue;
+        u32 offset = AlignUp(end, range.alignment);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, *range.offset, offset, range.size);
+        *range.offset = offset;
+        end = offset + range.size;
+        usedSize += range.size;
+    }
+
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glDeleteBuffers(1, &heap.handle);
+
+    heap.handle = handle;
+    heap.usedSize = usedSize;
+    heap.freeBlocks.clear();
+    if (end < heap.capacity)
+        heap.freeBlocks.push_back(GeometryBlock{ end, heap.capacity - end });
+    arena.generation++;
+}
@@ -0,0 +1,47 @@
+//
+// geometryarena.h: Vertices and indices of every mesh are sub-allocated from two large
+// GL buffers instead of one pair of buffers per mesh, so any submesh can be drawn without
+// binding other buffers, by its base vertex and first index. Free ranges are kept in an
+// offset ordered free list, allocation is first fit and freed ranges merge with their
+// neighbours. When a heap runs out of space it is recreated twice as big.
+//
+
+#pragma once
+#include "engine.h"
+
+#define GEOMETRY_VERTEX_HEAP_SIZE MB(32)
+#define GEOMETRY_INDEX_HEAP_SIZE  MB(16)
+#define GEOMETRY_INDEX_ALIGNMENT  4 // 32 bit indices after 16 bit ones have to stay aligned
+
+// Live allocation handed to CompactGeometryHeap, offset is updated in place
+struct GeometryRange
+{
+    u32* offset;
+    u32  size;
+    u32  alignment;
+};
+
+void CreateGeometryArena(GeometryArena& arena, u32 vertexCapacity, u32 indexCapacity);
+void DestroyGeometryArena(GeometryArena& arena);
+
+/**
+ * Returns the offset of size bytes starting at a multiple of alignment, which does not
+ * need to be a power of two so vertex ranges can be aligned to their stride.
+ */
+u32 AllocateGeometry(GeometryArena& arena, GeometryHeap& heap, u32 size, u32 alignment);
+
+void FreeGeometry(GeometryHeap& heap, u32 offset, u32 size);
+
+/**
+ * True if the free list is ordered by offset, inside the heap and has no two blocks
+ * touching, which FreeGeometry would have merged.
+ */
+bool ValidateGeometryHeap(const GeometryHeap& heap);
+
+void UploadGeometry(GeometryHeap& heap, u32 offset, u32 size, const void* data);
+
+/**
+ * Moves the given ranges, which must be all the live allocations of the heap, to its
+ * start so the free space becomes a single block at the end.
+ */
+void CompactGeometryHeap(GeometryArena& arena, GeometryHeap& heap, std::vector<GeometryRange>& ranges);
@@ -0,0 +1,298 @@
+//
+// gpudriven.cpp : GPU culled, multi draw indirect G-buffer pass (see gpudriven.h).
+//
+
+#include "gpudriven.h"
+#include "instancing.h"
+#include "programreflection.h"
+#include "vaocache.h"
+#include "vertexformat.h"
+#include <algorithm>
+
+static_assert(sizeof(GpuObject) == 80, "GpuObject must match the std430 layout of gpuculling.glsl");
+static_assert(sizeof(GpuDraw) == 64 + SUBMESH_MAX_LODS * sizeof(GpuLodRange), "GpuDraw must match the std430 layout of gpuculling.glsl");
+static_assert(sizeof(DrawElementsIndirectCommand) == 20, "Commands are read tightly packed");
+
+// Draw while the list is built, before it is ordered by state
+struct GpuDrawSource
+{
+    u32    objectIdx;
+    u32    meshIdx;
+    u32    submeshIdx;
+    u32    programIdx;
+    u32    materialIdx;
+    u64    formatHash;
+    GLenum indexType;
+};
+
+static GLuint CreateStorageBuffer(u32 size)
+{
+    GLuint handle;
+    glGenBuffers(1, &handle);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, handle);
+    glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    return handle;
+}
+
+// Reallocates in place, the VAOs reading the instance buffer keep a valid handle
+static void ResizeStorage(GLuint handle, u32 size)
+{
+    glBindBuffer(GL_COPY_WRITE_BUFFER, handle);
+    glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+static u32 GrowCapacity(u32 capacity, u32 count)
+{
+    while (capacity < count)
+        capacity *= 2;
+    return capacity;
+}
+
+void CreateGpuScene(GpuScene& scene)
+{
+    scene.objectCapacity = 256;
+    scene.drawCapacity = 1024;
+    scene.objectBuffer = CreateStorageBuffer(scene.objectCapacity * sizeof(GpuObject));
+    scene.drawBuffer = CreateStorageBuffer(scene.drawCapacity * sizeof(GpuDraw));
+    scene.commandBuffer = CreateStorageBuffer(scene.drawCapacity * sizeof(DrawElementsIndirectCommand));
+    scene.instanceBuffer = CreateStorageBuffer(scene.drawCapacity * sizeof(InstanceData));
+    scene.visibilityBuffer = CreateStorageBuffer(scene.drawCapacity * sizeof(u32));
+    scene.drawCount = 0;
+    scene.dirty = true;
+}
+
+void DestroyGpuScene(GpuScene& scene)
+{
+    GLuint buffers[] = { scene.objectBuffer, scene.drawBuffer, scene.commandBuffer, scene.instanceBuffer, scene.visibilityBuffer };
+    glDeleteBuffers(ARRAY_COUNT(buffers), buffers);
+    scene.objectBuffer = scene.drawBuffer = scene.commandBuffer = scene.instanceBuffer = scene.visibilityBuffer = 0;
+    scene.buckets.clear();
+    scene.drawCount = 0;
+}
+
+static u64 HashVertexFormat(const VertexBufferLayout& layout)
+{
+    u64 hash = HashBytes(&layout.stride, sizeof(layout.stride));
+    for (u32 i = 0; i < layout.attributes.size(); ++i)
+    {
+        const VertexBufferAttribute& attribute = layout.attributes[i];
+        u64 packed = (u64)attribute.location | (u64)attribute.componenetCount << 8 |
+                     (u64)attribute.offset << 16 | (u64)attribute.normalized << 24 | (u64)attribute.type << 32;
+        hash = HashBytes(&packed, sizeof(packed), hash);
+    }
+    return hash;
+}
+
+static GpuDraw MakeGpuDraw(const GpuDrawSource& source, const Submesh& submesh)
+{
+    GpuDraw draw = {};
+    draw.bounds = vec4(submesh.boundsCenter, submesh.boundsRadius);
+    draw.positionScale = vec4(submesh.positionScale, 0.0f);
+    draw.positionOffset = vec4(submesh.positionOffset, 0.0f);
+    draw.objectIdx = source.objectIdx;
+    draw.baseVertex = (i32)submesh.baseVertex;
+
+    const u32 firstIndex = submesh.indexOffset / GetIndexSize(submesh.indexType);
+    if (submesh.lods.empty())
+    {
+        draw.lodCount = 1;
+        draw.lods[0] = GpuLodRange{ submesh.indexCount, firstIndex, 0.0f, 0 };
+        return draw;
+    }
+
+    draw.lodCount = glm::min((u32)submesh.lods.size(), (u32)SUBMESH_MAX_LODS);
+    for (u32 l = 0; l < draw.lodCount; ++l)
+    {
+        const SubmeshLod& lod = submesh.lods[l];
+        draw.lods[l] = GpuLodRange{ lod.indexCount, firstIndex + lod.indexOffset, lod.error, 0 };
+    }
+    return draw;
+}
+
+static void RebuildGpuDraws(App* app)
+{
+    GpuScene& scene = app->gpuScene;
+
+    std::vector<GpuDrawSource> sources;
+    u32 skippedObjects = 0;
+    for (u32 a = 0; a < app->sceneObjects.size(); ++a)
+    {
+        const Objects* object = app->sceneObjects[a];
+        const Model& model = app->models[object->meshID];
+        const Mesh& mesh = app->meshes[model.meshIdx];
+
+        // Only the instanced programs read the per draw data
+        u32 programIdx = app->programs[object->shaderID].instancedProgramIdx;
+        if (programIdx == UINT32_MAX)
+        {
+            skippedObjects++;
+            continue;
+        }
+
+        for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+        {
+            const Submesh& submesh = mesh.submeshes[i];
+            sources.push_back(GpuDrawSource{ a, model.meshIdx, i, programIdx, model.materialIdx[i], HashVertexFormat(submesh.vertexBufferLayout), submesh.indexType });
+        }
+    }
+
+    if (skippedObjects > 0)
+        ELOG("GPU driven path: %u objects have a program without an instanced variant and are not drawn, use the CPU path for them", skippedObjects);
+
+    std::sort(sources.begin(), sources.end(), [](const GpuDrawSource& a, const GpuDrawSource& b) {
+        if (a.programIdx != b.programIdx) return a.programIdx < b.programIdx;
+        if (a.materialIdx != b.materialIdx) return a.materialIdx < b.materialIdx;
+        if (a.formatHash != b.formatHash) return a.formatHash < b.formatHash;
+        return a.indexType < b.indexType;
+    });
+
+    std::vector<GpuDraw> draws(sources.size());
+    scene.buckets.clear();
+    for (u32 i = 0; i < sources.size(); ++i)
+    {
+        const GpuDrawSource& source = sources[i];
+        draws[i] = MakeGpuDraw(source, app->meshes[source.meshIdx].submeshes[source.submeshIdx]);
+
+        const GpuDrawSource* previous = i > 0 ? &sources[i - 1] : NULL;
+        if (previous && previous->programIdx == source.programIdx && previous->materialIdx == source.materialIdx &&
+            previous->formatHash == source.formatHash && previous->indexType == source.indexType)
+        {
+            scene.buckets.back().commandCount++;
+        }
+        else
+        {
+            scene.buckets.push_back(GpuDrawBucket{ source.programIdx, source.materialIdx, source.meshIdx, source.submeshIdx, source.indexType, i, 1 });
+        }
+    }
+
+    // Draws, commands, instances and visibility have one element per draw each
+    scene.drawCount = (u32)draws.size();
+    if (scene.drawCount > scene.drawCapacity)
+    {
+        scene.drawCapacity = GrowCapacity(scene.drawCapacity, scene.drawCount);
+        ResizeStorage(scene.drawBuffer, scene.drawCapacity * sizeof(GpuDraw));
+        ResizeStorage(scene.commandBuffer, scene.drawCapacity * sizeof(DrawElementsIndirectCommand));
+        ResizeStorage(scene.instanceBuffer, scene.drawCapacity * sizeof(InstanceData));
+        ResizeStorage(scene.visibilityBuffer, scene.drawCapacity * sizeof(u32));
+    }
+
+    // Draws are in a new order, they all start visible and the late phase sorts them out
+    if (scene.drawCount > 0)
+    {
+        const u32 visible = 1;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, scene.drawBuffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, 0, scene.drawCount * sizeof(GpuDraw), draws.data());
+        glBindBuffer(GL_COPY_WRITE_BUFFER, scene.visibilityBuffer);
+        glClearBufferData(GL_COPY_WRITE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &visible);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    scene.geometryGeneration = app->geometry.generation;
+    scene.dirty = false;
+}
+
+void UpdateGpuScene(App* app)
+{
+    GpuScene& scene = app->gpuScene;
+    if (scene.dirty || scene.geometryGeneration != app->geometry.generation)
+        RebuildGpuDraws(app);
+
+    u32 objectCount = (u32)app->sceneObjects.size();
+    if (objectCount == 0)
+        return;
+    if (objectCount > scene.objectCapacity)
+    {
+        scene.objectCapacity = GrowCapacity(scene.objectCapacity, objectCount);
+        ResizeStorage(scene.objectBuffer, scene.objectCapacity * sizeof(GpuObject));
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, scene.objectBuffer);
+    GpuObject* objects = (GpuObject*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, objectCount * sizeof(GpuObject), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    for (u32 i = 0; i < objectCount; ++i)
+    {
+        objects[i].model = app->sceneObjects[i]->modelMat;
+        objects[i].color = GetInstanceColor(app, app->sceneObjects[i]);
+    }
+    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void CullGpuDraws(App* app, const Frustum& frustum, f32 pixelsPerUnit, GpuCullingPhase phase)
+{
+    GpuScene& scene = app->gpuScene;
+    if (scene.drawCount == 0)
+        return;
+
+    Program& program = app->programs[scene.cullingProgramIdx];
+    glUseProgram(program.handle);
+    glUniform4fv(GetProgramUniform(program, ProgramUniform_FrustumPlanes), FrustumPlane_Count, &frustum.planes[0].x);
+    glUniform3fv(GetProgramUniform(program, ProgramUniform_CameraPosition), 1, &app->camera->Position.x);
+    glUniform1f(GetProgramUniform(program, ProgramUniform_PixelsPerUnit), pixelsPerUnit);
+    glUniform1f(GetProgramUniform(program, ProgramUniform_LodPixelError), app->lodEnabled ? app->lodPixelError : 0.0f);
+    glUniform1ui(GetProgramUniform(program, ProgramUniform_DrawCount), scene.drawCount);
+    glUniform1ui(GetProgramUniform(program, ProgramUniform_CullingPhase), phase);
+    glUniformMatrix4fv(GetProgramUniform(program, ProgramUniform_View), 1, GL_FALSE, &app->camera->GetViewMatrix()[0][0]);
+    glUniformMatrix4fv(GetProgramUniform(program, ProgramUniform_Projection), 1, GL_FALSE, &app->camera->projection[0][0]);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, scene.objectBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, scene.drawBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, scene.commandBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, scene.instanceBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, scene.visibilityBuffer);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, app->depthPyramid.texture);
+    glDispatchCompute((scene.drawCount + GPU_CULLING_GROUP_SIZE - 1) / GPU_CULLING_GROUP_SIZE, 1, 1);
+
+    // Commands are read by the multi draws, instances as vertex attributes and the
+    // visibility by the next frame
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glUseProgram(0);
+}
+
+u32 SubmitGpuDraws(App* app)
+{
+    GpuScene& scene = app->gpuScene;
+    if (scene.drawCount == 0)
+        return 0;
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, scene.commandBuffer);
+    glActiveTexture(GL_TEXTURE0);
+
+    u32 currentProgramIdx = UINT32_MAX;
+    GLuint currentVao = 0;
+    for (u32 i = 0; i < scene.buckets.size(); ++i)
+    {
+        const GpuDrawBucket& bucket = scene.buckets[i];
+        Program& program = app->programs[bucket.programIdx];
+        if (bucket.programIdx != currentProgramIdx)
+        {
+            currentProgramIdx = bucket.programIdx;
+            glUseProgram(program.handle);
+            glUniformMatrix4fv(GetProgramUniform(program, ProgramUniform_View), 1, GL_FALSE, &app->camera->GetViewMatrix()[0][0]);
+            glUniformMatrix4fv(GetProgramUniform(program, ProgramUniform_Projection), 1, GL_FALSE, &app->camera->projection[0][0]);
+        }
+
+        if (app->textures.size() > 0)
+            glBindTexture(GL_TEXTURE_2D, app->textures[app->materials[bucket.materialIdx].albedoTextureIdx].handle);
+
+        const Submesh& submesh = app->meshes[bucket.meshIdx].submeshes[bucket.submeshIdx];
+        GLuint vao = FindOrCreateVao(app->vaoCache, app->geometry, scene.instanceBuffer, submesh.vertexBufferLayout, program);
+        if (vao != currentVao)
+        {
+            currentVao = vao;
+            glBindVertexArray(vao);
+        }
+        glUniform1i(GetProgramUniform(program, ProgramUniform_OctahedralNormals), HasOctahedralNormals(submesh.vertexBufferLayout));
+
+        u64 offset = bucket.firstCommand * sizeof(DrawElementsIndirectCommand);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, bucket.indexType, (const void*)offset, bucket.commandCount, 0);
+    }
+
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    return (u32)scene.buckets.size();
+}
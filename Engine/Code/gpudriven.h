@@ -0,0 +1,92 @@
+//
+// gpudriven.h: GPU driven G-buffer pass. Every submesh of every scene object is a draw
+// whose bounds, LOD ranges and object index live in a storage buffer, next to the object
+// transforms. A compute shader (gpuculling.glsl) frustum culls the draws, picks their LOD
+// and writes one DrawElementsIndirectCommand and one InstanceData per draw, culled draws
+// keep their slot with an instance count of 0.
+//
+// Draws are ordered by program, material and vertex format, and each run of equal state
+// is submitted with a single glMultiDrawElementsIndirect. GL 4.3 has neither the draw
+// count variant nor bindless textures, so there is one multi draw per material instead of
+// one for the whole pass. The base instance of each command selects its InstanceData,
+// which the instanced programs read like in instancing.h.
+//
+// The draw list only changes with the scene: creating or destroying objects and creating,
+// freeing or moving mesh geometry mark it dirty. Object transforms are uploaded each frame.
+//
+// With occlusion culling the pass runs in two phases. The early phase draws what passed the
+// occlusion test last frame, then a depth pyramid is built from that depth (see
+// depthpyramid.h) and the late phase tests every draw in the frustum against it, draws the
+// visible ones the early phase skipped and stores the result for the next frame. Draws that
+// stop being occluded show up in the same frame, at the cost of a second set of multi draws.
+//
+
+#pragma once
+#include "engine.h"
+#include "culling.h"
+#include "simplify.h"
+
+#define GPU_CULLING_GROUP_SIZE 64 // local_size_x of gpuculling.glsl
+
+// Same values as the PHASE_ defines of gpuculling.glsl
+enum GpuCullingPhase
+{
+    GpuCullingPhase_All,   // frustum only
+    GpuCullingPhase_Early, // visible last frame
+    GpuCullingPhase_Late   // not occluded by the depth pyramid, not drawn by the early phase
+};
+
+struct GpuObject
+{
+    glm::mat4 model;
+    vec4      color; // same as InstanceData::color
+};
+
+struct GpuLodRange
+{
+    u32 indexCount;
+    u32 firstIndex; // in indices from the start of the index heap
+    f32 error;
+    u32 padding;
+};
+
+struct GpuDraw
+{
+    vec4        bounds; // object space bounding sphere
+    vec4        positionScale;
+    vec4        positionOffset;
+    u32         objectIdx;
+    i32         baseVertex;
+    u32         lodCount;
+    u32         padding;
+    GpuLodRange lods[SUBMESH_MAX_LODS];
+};
+
+struct DrawElementsIndirectCommand
+{
+    u32 count;
+    u32 instanceCount;
+    u32 firstIndex;
+    i32 baseVertex;
+    u32 baseInstance;
+};
+
+void CreateGpuScene(GpuScene& scene);
+void DestroyGpuScene(GpuScene& scene);
+
+/**
+ * Rebuilds the draws and their buckets when the scene is dirty or the geometry moved,
+ * then uploads the object transforms.
+ */
+void UpdateGpuScene(App* app);
+
+/**
+ * Dispatches the culling compute shader, the commands are ready for SubmitGpuDraws after it.
+ * The late phase reads app->depthPyramid.
+ */
+void CullGpuDraws(App* app, const Frustum& frustum, f32 pixelsPerUnit, GpuCullingPhase phase);
+
+/**
+ * Issues one multi draw indirect per bucket, returns the number of multi draws.
+ */
+u32 SubmitGpuDraws(App* app);
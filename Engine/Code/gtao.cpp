@@ -0,0 +1,79 @@
+//
+// gtao.cpp : Ground truth ambient occlusion with temporal accumulation (see gtao.h).
+//
+
+#include "gtao.h"
+#include "programreflection.h"
+
+void CreateGtao(GtaoPass& gtao, ivec2 displaySize)
+{
+    gtao.size = glm::max((displaySize + ivec2(GTAO_RESOLUTION_DIVISOR - 1)) / ivec2(GTAO_RESOLUTION_DIVISOR), ivec2(1));
+
+    // Occlusion and the view depth it was computed at, for the rejection of the next frame
+    glGenTextures(ARRAY_COUNT(gtao.historyTextures), gtao.historyTextures);
+    for (u32 i = 0; i < ARRAY_COUNT(gtao.historyTextures); ++i)
+    {
+        glBindTexture(GL_TEXTURE_2D, gtao.historyTextures[i]);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RG16F, gtao.size.x, gtao.size.y);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    gtao.frameIndex = 0;
+    gtao.historyValid = false;
+}
+
+void DestroyGtao(GtaoPass& gtao)
+{
+    glDeleteTextures(ARRAY_COUNT(gtao.historyTextures), gtao.historyTextures);
+    for (u32 i = 0; i < ARRAY_COUNT(gtao.historyTextures); ++i)
+        gtao.historyTextures[i] = 0;
+}
+
+GLuint GetGtaoTexture(const GtaoPass& gtao)
+{
+    // The one written by the last RenderGtao
+    return gtao.historyTextures[(gtao.frameIndex + 1) % 2];
+}
+
+void RenderGtao(App* app)
+{
+    GtaoPass& gtao = app->gtao;
+    Program& program = app->programs[gtao.programIdx];
+    gtao.sliceCount = glm::clamp(gtao.sliceCount, 1u, (u32)GTAO_MAX_SLICES);
+
+    GLuint history = gtao.historyTextures[(gtao.frameIndex + 1) % 2];
+    GLuint target = gtao.historyTextures[gtao.frameIndex % 2];
+    glm::mat4 viewProjection = app->camera->projection * app->camera->GetViewMatrix();
+
+    glUseProgram(program.handle);
+    glUniformMatrix4fv(GetProgramUniform(program, ProgramUniform_PreviousViewProjection), 1, GL_FALSE, &gtao.previousViewProjection[0][0]);
+    glUniform1ui(GetProgramUniform(program, ProgramUniform_GtaoSliceCount), gtao.sliceCount);
+    glUniform1ui(GetProgramUniform(program, ProgramUniform_GtaoStepCount), gtao.stepCount);
+    glUniform1f(GetProgramUniform(program, ProgramUniform_GtaoRadius), gtao.radius);
+    glUniform1ui(GetProgramUniform(program, ProgramUniform_FrameIndex), gtao.frameIndex);
+    glUniform1i(GetProgramUniform(program, ProgramUniform_HistoryValid), gtao.historyValid && gtao.temporal);
+    glUniform1i(GetProgramUniform(program, ProgramUniform_SsaoDivisor), GTAO_RESOLUTION_DIVISOR);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, app->gDepth);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, app->gNormal);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, history);
+    glBindImageTexture(0, target, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG16F);
+    glDispatchCompute((gtao.size.x + GTAO_GROUP_SIZE - 1) / GTAO_GROUP_SIZE, (gtao.size.y + GTAO_GROUP_SIZE - 1) / GTAO_GROUP_SIZE, 1);
+
+    // Read by the lighting pass and by the next frame
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG16F);
+    glActiveTexture(GL_TEXTURE0);
+    glUseProgram(0);
+
+    gtao.previousViewProjection = viewProjection;
+    gtao.historyValid = true;
+    gtao.frameIndex++;
+}
@@ -0,0 +1,34 @@
+//
+// gtao.h: Ground truth ambient occlusion (Jimenez et al. 2016) in a compute shader, as an
+// alternative to the hemisphere kernel of ssao.h.
+//
+// Each pixel, at GTAO_RESOLUTION_DIVISOR of the display resolution, searches the depth
+// buffer for the horizons on both sides of a few screen space slices and integrates the
+// visible arc around its normal analytically. The slice directions are rotated every
+// frame, with a 4x4 interleaved pattern across pixels, and the result is blended with
+// the previous frames: the history is reprojected through the previous view projection
+// and dropped where the depth it was computed at does not match.
+//
+// The lighting pass of quad.glsl reads the result with the same depth aware upsample as
+// the SSAO.
+//
+
+#pragma once
+#include "engine.h"
+
+#define GTAO_GROUP_SIZE         8 // local_size_x and local_size_y of gtao.glsl
+#define GTAO_RESOLUTION_DIVISOR 2
+#define GTAO_MAX_SLICES         4
+
+void CreateGtao(GtaoPass& gtao, ivec2 displaySize);
+void DestroyGtao(GtaoPass& gtao);
+
+/**
+ * Computes this frame's occlusion and blends it into the history.
+ */
+void RenderGtao(App* app);
+
+/**
+ * R is the occlusion, one texel per GTAO_RESOLUTION_DIVISOR display pixels.
+ */
+GLuint GetGtaoTexture(const GtaoPass& gtao);
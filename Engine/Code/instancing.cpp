@@ -0,0 +1,130 @@
+//
+// instancing.cpp : Render batches and the per instance buffer (see instancing.h).
+//
+
+#include "instancing.h"
+#include "renderqueue.h"
+#include <algorithm>
+
+static u32 GetItemLod(App* app, const RenderItem& item)
+{
+    const Objects* object = app->sceneObjects[item.objectIdx];
+    const Submesh& submesh = app->meshes[app->models[object->meshID].meshIdx].submeshes[item.submeshIdx];
+    return submesh.lods.empty() ? 0 : glm::min(object->lod, (u32)submesh.lods.size() - 1);
+}
+
+static bool CanShareDraw(App* app, const RenderItem& a, const RenderItem& b)
+{
+    const Objects* objectA = app->sceneObjects[a.objectIdx];
+    const Objects* objectB = app->sceneObjects[b.objectIdx];
+    const Model& modelA = app->models[objectA->meshID];
+    const Model& modelB = app->models[objectB->meshID];
+
+    // The key fields wrap, the indices themselves decide
+    return objectA->shaderID == objectB->shaderID &&
+           modelA.meshIdx == modelB.meshIdx &&
+           a.submeshIdx == b.submeshIdx &&
+           modelA.materialIdx[a.submeshIdx] == modelB.materialIdx[b.submeshIdx] &&
+           GetItemLod(app, a) == GetItemLod(app, b);
+}
+
+vec4 GetInstanceColor(App* app, const Objects* object)
+{
+    if (!object->showInGeneralList && app->lights.size() > 0)
+        return vec4(object->lightAttached->color, 0.0f);
+    return vec4(0.0f, 0.0f, 0.0f, object->showInGeneralList ? 1.0f : 0.0f);
+}
+
+InstanceData MakeInstanceData(App* app, const Objects* object, const Submesh& submesh)
+{
+    InstanceData instance;
+    instance.model = object->modelMat;
+    instance.color = GetInstanceColor(app, object);
+    instance.positionScale = vec4(submesh.positionScale, 0.0f);
+    instance.positionOffset = vec4(submesh.positionOffset, 0.0f);
+    return instance;
+}
+
+void BuildRenderBatches(App* app)
+{
+    RenderQueue& queue = app->renderQueue;
+    InstanceBuffer& instanceBuffer = app->instanceBuffer;
+    queue.batches.clear();
+    instanceBuffer.instances.clear();
+
+    u32 itemCount = (u32)queue.items.size();
+    for (u32 runStart = 0; runStart < itemCount;)
+    {
+        // Items of the same program, material and mesh only differ in depth. Submeshes sharing
+        // a material and different LODs interleave there, group them keeping the depth order.
+        u64 runKey = queue.items[runStart].key >> SORT_KEY_DEPTH_BITS;
+        u32 runEnd = runStart + 1;
+        while (runEnd < itemCount && queue.items[runEnd].key >> SORT_KEY_DEPTH_BITS == runKey)
+            runEnd++;
+        if (app->instancing && runEnd - runStart > 1)
+        {
+            std::stable_sort(queue.items.begin() + runStart, queue.items.begin() + runEnd, [app](const RenderItem& a, const RenderItem& b) {
+                return a.submeshIdx != b.submeshIdx ? a.submeshIdx < b.submeshIdx : GetItemLod(app, a) < GetItemLod(app, b);
+            });
+        }
+
+        for (u32 first = runStart; first < runEnd;)
+        {
+            RenderBatch batch = { first, 1, GetItemLod(app, queue.items[first]), 0, 0 };
+            if (app->instancing && app->programs[app->sceneObjects[queue.items[first].objectIdx]->shaderID].instancedProgramIdx != UINT32_MAX)
+            {
+                while (first + batch.itemCount < runEnd && CanShareDraw(app, queue.items[first], queue.items[first + batch.itemCount]))
+                    batch.itemCount++;
+            }
+
+            if (batch.itemCount > 1)
+            {
+                const RenderItem& item = queue.items[first];
+                const Submesh& submesh = app->meshes[app->models[app->sceneObjects[item.objectIdx]->meshID].meshIdx].submeshes[item.submeshIdx];
+                batch.firstInstance = (u32)instanceBuffer.instances.size();
+                for (u32 i = 0; i < batch.itemCount; ++i)
+                    instanceBuffer.instances.push_back(MakeInstanceData(app, app->sceneObjects[queue.items[first + i].objectIdx], submesh));
+            }
+            queue.batches.push_back(batch);
+            first += batch.itemCount;
+        }
+        runStart = runEnd;
+    }
+}
+
+void CreateInstanceBuffer(InstanceBuffer& buffer)
+{
+    buffer.capacity = INSTANCE_BUFFER_MIN_SIZE;
+    glGenBuffers(1, &buffer.handle);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer.handle);
+    glBufferData(GL_COPY_WRITE_BUFFER, buffer.capacity, NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void UploadInstances(InstanceBuffer& buffer)
+{
+    u32 size = (u32)(buffer.instances.size() * sizeof(InstanceData));
+    if (size == 0)
+        return;
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer.handle);
+    if (size > buffer.capacity)
+    {
+        u32 capacity = buffer.capacity;
+        while (capacity < size)
+            capacity *= 2;
+        buffer.capacity = capacity;
+    }
+    // Orphan the storage the previous frame may still be reading
+    glBufferData(GL_COPY_WRITE_BUFFER, buffer.capacity, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, 0, size, buffer.instances.data());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void DestroyInstanceBuffer(InstanceBuffer& buffer)
+{
+    glDeleteBuffers(1, &buffer.handle);
+    buffer.handle = 0;
+    buffer.capacity = 0;
+    buffer.instances.clear();
+}
@@ -0,0 +1,43 @@
+//
+// instancing.h: Objects sharing a program, a material and a mesh are drawn with one
+// instanced call per submesh and LOD. The sorted render queue already keeps their items
+// together, only their depth differs, so batches are runs of the queue. The model matrix
+// and the per object colour of every instance are streamed into one buffer each frame and
+// read by the instanced programs as vertex inputs advancing once per instance.
+//
+// A batch of a single object keeps the regular program and its meshlet culling, which
+// needs the matrix of one object at a time.
+//
+
+#pragma once
+#include "engine.h"
+
+#define INSTANCE_ATTRIBUTE_LOCATION 5 // model matrix columns in 5 to 8, colour in 9, then scale and offset
+#define INSTANCE_BUFFER_BINDING     1 // vertex buffer binding point, 0 is the geometry
+#define INSTANCE_BUFFER_MIN_SIZE    KB(64)
+
+void CreateInstanceBuffer(InstanceBuffer& buffer);
+
+/**
+ * ColorToPass and lightAffected of an object as the instanced programs read them.
+ */
+vec4 GetInstanceColor(App* app, const Objects* object);
+
+/**
+ * Also the LocalParams uniform block of the programs drawing one object at a time.
+ */
+InstanceData MakeInstanceData(App* app, const Objects* object, const Submesh& submesh);
+
+/**
+ * Groups app->renderQueue.items into app->renderQueue.batches and fills the instance data
+ * of the batches of more than one item. The items must be sorted.
+ */
+void BuildRenderBatches(App* app);
+
+/**
+ * Streams the instances of this frame, the buffer keeps its handle when it grows so the
+ * VAOs referencing it stay valid.
+ */
+void UploadInstances(InstanceBuffer& buffer);
+
+void DestroyInstanceBuffer(InstanceBuffer& buffer);
@@ -0,0 +1,148 @@
+//
+// lighting.cpp : Lights on the GPU and clustered light assignment (see lighting.h).
+//
+
+#include "lighting.h"
+#include "programreflection.h"
+
+static_assert(sizeof(GpuLight) == 48, "GpuLight must match the std430 layout of lighting.glsl and quad.glsl");
+
+static GLuint CreateStorageBuffer(u32 size)
+{
+    GLuint handle;
+    glGenBuffers(1, &handle);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, handle);
+    glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    return handle;
+}
+
+f32 ComputeLightRange(f32 intensity)
+{
+    // Positive root of quadratic * d^2 + linear * d + 1 - intensity / cutoff
+    f32 constant = 1.0f - intensity / LIGHT_ATTENUATION_CUTOFF;
+    if (constant >= 0.0f)
+        return 0.0f;
+    f32 discriminant = LIGHT_ATTENUATION_LINEAR * LIGHT_ATTENUATION_LINEAR - 4.0f * LIGHT_ATTENUATION_QUADRATIC * constant;
+    return (-LIGHT_ATTENUATION_LINEAR + sqrtf(discriminant)) / (2.0f * LIGHT_ATTENUATION_QUADRATIC);
+}
+
+void CreateLightClusters(LightClusters& clusters)
+{
+    clusters.lightCapacity = LIGHT_BUFFER_MIN_CAPACITY;
+    clusters.lightBuffer = CreateStorageBuffer(clusters.lightCapacity * sizeof(GpuLight));
+    clusters.clusterCountBuffer = CreateStorageBuffer(CLUSTER_COUNT * sizeof(u32));
+    clusters.clusterIndexBuffer = CreateStorageBuffer(CLUSTER_COUNT * CLUSTER_MAX_LIGHTS * sizeof(u32));
+    clusters.lightCount = 0;
+    clusters.directionalLightCount = 0;
+    clusters.uploadedLights = 0;
+    clusters.bufferContents.clear();
+}
+
+void DestroyLightClusters(LightClusters& clusters)
+{
+    GLuint buffers[] = { clusters.lightBuffer, clusters.clusterCountBuffer, clusters.clusterIndexBuffer };
+    glDeleteBuffers(ARRAY_COUNT(buffers), buffers);
+    clusters.lightBuffer = clusters.clusterCountBuffer = clusters.clusterIndexBuffer = 0;
+}
+
+static GpuLight MakeGpuLight(const Light* light)
+{
+    // Point lights pass the cone test of the shaders for any direction
+    vec3 direction = glm::length(light->direction) > 0.0f ? glm::normalize(light->direction) : vec3(0.0f, -1.0f, 0.0f);
+    f32 cosAngle = light->type == Spot ? cosf(glm::radians(light->angle)) : -2.0f;
+
+    GpuLight gpuLight;
+    gpuLight.positionRange = vec4(light->position, light->type == Directional ? 0.0f : ComputeLightRange(light->intensity));
+    gpuLight.colorIntensity = vec4(light->color, light->intensity);
+    gpuLight.directionCosAngle = vec4(direction, cosAngle);
+    return gpuLight;
+}
+
+static u32 GetLightBufferCapacity(u32 capacity, u32 lightCount)
+{
+    while (capacity < lightCount)
+        capacity *= 2;
+    while (capacity > LIGHT_BUFFER_MIN_CAPACITY && lightCount < capacity / 4)
+        capacity /= 2;
+    return capacity;
+}
+
+static bool IsSameLight(const GpuLight& a, const GpuLight& b)
+{
+    return memcmp(&a, &b, sizeof(GpuLight)) == 0;
+}
+
+void UploadLights(App* app)
+{
+    LightClusters& clusters = app->lightClusters;
+
+    std::vector<GpuLight>& lights = clusters.lights;
+    lights.clear();
+    for (u32 i = 0; i < app->lights.size(); ++i)
+        if (app->lights[i]->type == Directional)
+            lights.push_back(MakeGpuLight(app->lights[i]));
+    clusters.directionalLightCount = (u32)lights.size();
+    for (u32 i = 0; i < app->lights.size(); ++i)
+        if (app->lights[i]->type != Directional)
+            lights.push_back(MakeGpuLight(app->lights[i]));
+    clusters.lightCount = (u32)lights.size();
+    clusters.uploadedLights = 0;
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, clusters.lightBuffer);
+    u32 capacity = GetLightBufferCapacity(clusters.lightCapacity, clusters.lightCount);
+    if (capacity != clusters.lightCapacity)
+    {
+        clusters.lightCapacity = capacity;
+        clusters.bufferContents.clear();
+        glBufferData(GL_COPY_WRITE_BUFFER, capacity * sizeof(GpuLight), NULL, GL_DYNAMIC_DRAW);
+    }
+
+    // Lights past the end of what the buffer holds always count as changed
+    std::vector<GpuLight>& contents = clusters.bufferContents;
+    u32 knownCount = glm::min((u32)contents.size(), clusters.lightCount);
+    u32 i = 0;
+    while (i < clusters.lightCount)
+    {
+        if (i < knownCount && IsSameLight(lights[i], contents[i]))
+        {
+            i++;
+            continue;
+        }
+
+        // Extend the run over changed lights and short stretches of unchanged ones
+        u32 first = i;
+        u32 end = i + 1;
+        for (u32 j = end; j < clusters.lightCount && j < end + LIGHT_UPLOAD_MERGE_GAP; ++j)
+            if (j >= knownCount || !IsSameLight(lights[j], contents[j]))
+                end = j + 1;
+
+        glBufferSubData(GL_COPY_WRITE_BUFFER, first * sizeof(GpuLight), (end - first) * sizeof(GpuLight), &lights[first]);
+        clusters.uploadedLights += end - first;
+        i = end;
+    }
+    contents.assign(lights.begin(), lights.end());
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHT_BUFFER_BINDING, clusters.lightBuffer);
+}
+
+void AssignLightsToClusters(App* app)
+{
+    LightClusters& clusters = app->lightClusters;
+    Program& program = app->programs[clusters.clusteringProgramIdx];
+
+    glUseProgram(program.handle);
+    glUniformMatrix4fv(GetProgramUniform(program, ProgramUniform_View), 1, GL_FALSE, &app->camera->GetViewMatrix()[0][0]);
+    glUniformMatrix4fv(GetProgramUniform(program, ProgramUniform_Projection), 1, GL_FALSE, &app->camera->projection[0][0]);
+    glUniform1ui(GetProgramUniform(program, ProgramUniform_LightCount), clusters.lightCount);
+    glUniform1ui(GetProgramUniform(program, ProgramUniform_DirectionalLightCount), clusters.directionalLightCount);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_COUNT_BINDING, clusters.clusterCountBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_INDEX_BINDING, clusters.clusterIndexBuffer);
+    glDispatchCompute((CLUSTER_COUNT + LIGHT_CLUSTERING_GROUP_SIZE - 1) / LIGHT_CLUSTERING_GROUP_SIZE, 1, 1);
+
+    // The lighting pass reads the cluster lists from its fragment shader
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glUseProgram(0);
+}
@@ -0,0 +1,63 @@
+//
+// lighting.h: Lights on the GPU and clustered light assignment for the deferred pass.
+//
+// Every light is packed into a GpuLight in a storage buffer, directional lights first. The
+// view frustum is split into CLUSTER_GRID_X x CLUSTER_GRID_Y screen tiles and CLUSTER_GRID_Z
+// depth slices, exponentially spaced between the near and the far plane. A compute shader
+// (lighting.glsl) tests the range sphere of every point and spot light against the view
+// space box of every cluster and keeps up to CLUSTER_MAX_LIGHTS light indices per cluster.
+// The lighting pass of quad.glsl looks up the cluster of each pixel and only shades the
+// lights listed there, plus every directional light.
+//
+// Point and spot lights reach as far as their attenuation stays above
+// LIGHT_ATTENUATION_CUTOFF, with the same falloff quad.glsl uses.
+//
+// The lights are packed again every frame but only the ranges that differ from what the
+// buffer holds are uploaded, runs closer than LIGHT_UPLOAD_MERGE_GAP lights apart go in a
+// single upload. The buffer starts at LIGHT_BUFFER_MIN_CAPACITY lights, doubles whenever
+// the lights do not fit and halves when they use less than a quarter of it. Both cases
+// reallocate it and upload every light.
+//
+
+#pragma once
+#include "engine.h"
+
+#define CLUSTER_GRID_X     16
+#define CLUSTER_GRID_Y     9
+#define CLUSTER_GRID_Z     24
+#define CLUSTER_COUNT      (CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z)
+#define CLUSTER_MAX_LIGHTS 128 // further lights of a crowded cluster are dropped
+
+#define LIGHT_CLUSTERING_GROUP_SIZE 64 // local_size_x of lighting.glsl
+
+// Storage buffer bindings shared by lighting.glsl and quad.glsl
+#define LIGHT_BUFFER_BINDING         5
+#define CLUSTER_COUNT_BINDING        6
+#define CLUSTER_INDEX_BINDING        7
+
+#define LIGHT_BUFFER_MIN_CAPACITY 64 // lights
+#define LIGHT_UPLOAD_MERGE_GAP    8  // unchanged lights worth uploading to save a call
+
+#define LIGHT_ATTENUATION_LINEAR    0.7f
+#define LIGHT_ATTENUATION_QUADRATIC 1.8f
+#define LIGHT_ATTENUATION_CUTOFF    (1.0f / 256.0f)
+
+/**
+ * Distance at which intensity / (1 + linear * d + quadratic * d^2) drops below the cutoff.
+ */
+f32 ComputeLightRange(f32 intensity);
+
+void CreateLightClusters(LightClusters& clusters);
+void DestroyLightClusters(LightClusters& clusters);
+
+/**
+ * Packs app->lights, uploads the ones that changed and binds the light buffer at
+ * LIGHT_BUFFER_BINDING for the lighting passes of the frame.
+ */
+void UploadLights(App* app);
+
+/**
+ * Dispatches the cluster assignment for the current camera and leaves the cluster lists
+ * bound for the lighting pass.
+ */
+void AssignLightsToClusters(App* app);
@@ -0,0 +1,277 @@
+//
+// lightvolumes.cpp : Deferred point and spot lights drawn as bounding volumes (see lightvolumes.h).
+//
+
+#include "lightvolumes.h"
+#include "lighting.h"
+#include "culling.h"
+#include "programreflection.h"
+
+// Flips the triangle when needed so it faces away from a point inside the volume
+static void AddVolumeTriangle(std::vector<u16>& indices, const std::vector<vec3>& positions, u32 a, u32 b, u32 c, vec3 interior)
+{
+    vec3 normal = glm::cross(positions[b] - positions[a], positions[c] - positions[a]);
+    if (glm::dot(normal, positions[a] - interior) < 0.0f)
+        std::swap(b, c);
+    indices.push_back((u16)a);
+    indices.push_back((u16)b);
+    indices.push_back((u16)c);
+}
+
+// Unit sphere around the origin, grown so its faces, not only its vertices, enclose the sphere
+static void BuildVolumeSphere(std::vector<vec3>& positions, std::vector<u16>& indices)
+{
+    const u32 rings = LIGHT_VOLUME_SEGMENTS / 2;
+    u32 firstVertex = (u32)positions.size();
+
+    positions.push_back(vec3(0.0f, 1.0f, 0.0f));
+    for (u32 ring = 1; ring < rings; ++ring)
+    {
+        f32 theta = glm::pi<f32>() * ring / rings;
+        for (u32 segment = 0; segment < LIGHT_VOLUME_SEGMENTS; ++segment)
+        {
+            f32 phi = 2.0f * glm::pi<f32>() * segment / LIGHT_VOLUME_SEGMENTS;
+            positions.push_back(vec3(sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi)));
+        }
+    }
+    positions.push_back(vec3(0.0f, -1.0f, 0.0f));
+
+    u32 firstIndex = (u32)indices.size();
+    u32 bottom = (u32)positions.size() - 1;
+    auto ringVertex = [&](u32 ring, u32 segment) { return firstVertex + 1 + (ring - 1) * LIGHT_VOLUME_SEGMENTS + segment % LIGHT_VOLUME_SEGMENTS; };
+    for (u32 segment = 0; segment < LIGHT_VOLUME_SEGMENTS; ++segment)
+    {
+        AddVolumeTriangle(indices, positions, firstVertex, ringVertex(1, segment), ringVertex(1, segment + 1), vec3(0.0f));
+        for (u32 ring = 1; ring + 1 < rings; ++ring)
+        {
+            AddVolumeTriangle(indices, positions, ringVertex(ring, segment), ringVertex(ring + 1, segment), ringVertex(ring + 1, segment + 1), vec3(0.0f));
+            AddVolumeTriangle(indices, positions, ringVertex(ring, segment), ringVertex(ring + 1, segment + 1), ringVertex(ring, segment + 1), vec3(0.0f));
+        }
+        AddVolumeTriangle(indices, positions, bottom, ringVertex(rings - 1, segment + 1), ringVertex(rings - 1, segment), vec3(0.0f));
+    }
+
+    // The closest face plane is the radius of the largest sphere inside the mesh
+    f32 inradius = 1.0f;
+    for (u32 i = firstIndex; i < indices.size(); i += 3)
+    {
+        vec3 a = positions[indices[i]];
+        vec3 normal = glm::normalize(glm::cross(positions[indices[i + 1]] - a, positions[indices[i + 2]] - a));
+        inradius = glm::min(inradius, glm::dot(normal, a));
+    }
+    for (u32 i = firstVertex; i < positions.size(); ++i)
+        positions[i] /= inradius;
+}
+
+// Apex at the origin, opening along +z up to a base of radius 1 at z = 1
+static void BuildVolumeCone(std::vector<vec3>& positions, std::vector<u16>& indices)
+{
+    u32 apex = (u32)positions.size();
+    positions.push_back(vec3(0.0f));
+    positions.push_back(vec3(0.0f, 0.0f, 1.0f));
+
+    // The polygon of the base goes around the circle instead of through it
+    f32 baseRadius = 1.0f / cosf(glm::pi<f32>() / LIGHT_VOLUME_SEGMENTS);
+    for (u32 segment = 0; segment < LIGHT_VOLUME_SEGMENTS; ++segment)
+    {
+        f32 phi = 2.0f * glm::pi<f32>() * segment / LIGHT_VOLUME_SEGMENTS;
+        positions.push_back(vec3(cosf(phi) * baseRadius, sinf(phi) * baseRadius, 1.0f));
+    }
+
+    const vec3 interior = vec3(0.0f, 0.0f, 0.75f);
+    for (u32 segment = 0; segment < LIGHT_VOLUME_SEGMENTS; ++segment)
+    {
+        u32 current = apex + 2 + segment;
+        u32 next = apex + 2 + (segment + 1) % LIGHT_VOLUME_SEGMENTS;
+        AddVolumeTriangle(indices, positions, apex, current, next, interior);
+        AddVolumeTriangle(indices, positions, apex + 1, next, current, interior);
+    }
+}
+
+static GLuint CreateAccumulationTexture(ivec2 size)
+{
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, size.x, size.y, 0, GL_RGBA, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+}
+
+void CreateLightVolumes(App* app)
+{
+    LightVolumes& volumes = app->lightVolumes;
+
+    std::vector<vec3> positions;
+    std::vector<u16> indices;
+    BuildVolumeSphere(positions, indices);
+    volumes.sphereIndexCount = (u32)indices.size();
+    volumes.coneBaseVertex = (u32)positions.size();
+    volumes.coneFirstIndex = (u32)indices.size();
+    std::vector<vec3> conePositions;
+    BuildVolumeCone(conePositions, indices);
+    positions.insert(positions.end(), conePositions.begin(), conePositions.end());
+    volumes.coneIndexCount = (u32)indices.size() - volumes.coneFirstIndex;
+
+    glGenVertexArrays(1, &volumes.vao);
+    glGenBuffers(1, &volumes.vertexBuffer);
+    glGenBuffers(1, &volumes.indexBuffer);
+    glBindVertexArray(volumes.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, volumes.vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(vec3), positions.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, volumes.indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(u16), indices.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3), (void*)0);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    volumes.accumulationTexture = CreateAccumulationTexture(app->displaySize);
+    // Same format as the G-buffer depth, blits between depth buffers need it
+    glGenRenderbuffers(1, &volumes.depthStencil);
+    glBindRenderbuffer(GL_RENDERBUFFER, volumes.depthStencil);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, app->displaySize.x, app->displaySize.y);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    glGenFramebuffers(1, &volumes.framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, volumes.framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, volumes.accumulationTexture, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, volumes.depthStencil);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+        ELOG("Light accumulation framebuffer is incomplete: 0x%x\n", status);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    Program& program = app->programs[volumes.programIdx];
+    glUseProgram(program.handle);
+    glUniform1i(GetProgramResourceLocation(program, ProgramResource_Sampler, "gDepth"), 0);
+    glUniform1i(GetProgramResourceLocation(program, ProgramResource_Sampler, "gNormal"), 1);
+    glUniform1i(GetProgramResourceLocation(program, ProgramResource_Sampler, "gAlbedoSpec"), 2);
+    glUseProgram(0);
+}
+
+void DestroyLightVolumes(LightVolumes& volumes)
+{
+    GLuint buffers[] = { volumes.vertexBuffer, volumes.indexBuffer };
+    glDeleteBuffers(ARRAY_COUNT(buffers), buffers);
+    glDeleteVertexArrays(1, &volumes.vao);
+    glDeleteFramebuffers(1, &volumes.framebuffer);
+    glDeleteRenderbuffers(1, &volumes.depthStencil);
+    glDeleteTextures(1, &volumes.accumulationTexture);
+    volumes.vertexBuffer = volumes.indexBuffer = volumes.vao = volumes.framebuffer = volumes.depthStencil = volumes.accumulationTexture = 0;
+}
+
+// Model matrix of the cone, along the lit side of the spot light as quad.glsl tests it
+static glm::mat4 GetConeVolumeMatrix(const Light* light, f32 range)
+{
+    vec3 axis = glm::length(light->direction) > 0.0f ? -glm::normalize(light->direction) : vec3(0.0f, 1.0f, 0.0f);
+    vec3 helper = fabsf(axis.y) < 0.99f ? vec3(0.0f, 1.0f, 0.0f) : vec3(1.0f, 0.0f, 0.0f);
+    vec3 right = glm::normalize(glm::cross(helper, axis));
+    vec3 up = glm::cross(axis, right);
+    f32 radius = range * tanf(glm::radians(light->angle));
+
+    glm::mat4 model;
+    model[0] = vec4(right * radius, 0.0f);
+    model[1] = vec4(up * radius, 0.0f);
+    model[2] = vec4(axis * range, 0.0f);
+    model[3] = vec4(light->position, 1.0f);
+    return model;
+}
+
+void RenderLightVolumes(App* app, const Frustum& frustum)
+{
+    LightVolumes& volumes = app->lightVolumes;
+    Program& stencilProgram = app->programs[volumes.stencilProgramIdx];
+    Program& lightProgram = app->programs[volumes.programIdx];
+    glm::mat4 view = app->camera->GetViewMatrix();
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, app->gBuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, volumes.framebuffer);
+    glBlitFramebuffer(0, 0, app->displaySize.x, app->displaySize.y, 0, 0, app->displaySize.x, app->displaySize.y, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, volumes.framebuffer);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClearStencil(0);
+    glClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, app->gDepth);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, app->gNormal);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, app->gAlbedoSpec);
+
+    Program* programs[] = { &stencilProgram, &lightProgram };
+    for (Program* program : programs)
+    {
+        glUseProgram(program->handle);
+        glUniformMatrix4fv(GetProgramUniform(*program, ProgramUniform_View), 1, GL_FALSE, &view[0][0]);
+        glUniformMatrix4fv(GetProgramUniform(*program, ProgramUniform_Projection), 1, GL_FALSE, &app->camera->projection[0][0]);
+    }
+
+    glBindVertexArray(volumes.vao);
+    glEnable(GL_STENCIL_TEST);
+    glEnable(GL_DEPTH_CLAMP);
+    glDepthMask(GL_FALSE);
+    glBlendFunc(GL_ONE, GL_ONE);
+    glCullFace(GL_FRONT);
+
+    // Same order as UploadLights, directional lights first
+    volumes.drawnLights = 0;
+    u32 lightIdx = app->lightClusters.directionalLightCount;
+    for (u32 i = 0; i < app->lights.size(); ++i)
+    {
+        const Light* light = app->lights[i];
+        if (light->type == Directional)
+            continue;
+        u32 gpuLightIdx = lightIdx++;
+
+        f32 range = app->lightClusters.lights[gpuLightIdx].positionRange.w;
+        if (range <= 0.0f || !IsSphereInFrustum(frustum, light->position, range))
+            continue;
+
+        bool cone = light->type == Spot && light->angle < LIGHT_VOLUME_MAX_CONE_ANGLE;
+        glm::mat4 model = cone ? GetConeVolumeMatrix(light, range) : glm::scale(glm::translate(glm::mat4(1.0f), light->position), vec3(range));
+        u32 indexCount = cone ? volumes.coneIndexCount : volumes.sphereIndexCount;
+        void* indexOffset = (void*)(u64)(cone ? volumes.coneFirstIndex * sizeof(u16) : 0);
+        GLint baseVertex = cone ? volumes.coneBaseVertex : 0;
+
+        // Stencil
+        glUseProgram(stencilProgram.handle);
+        glUniformMatrix4fv(GetProgramUniform(stencilProgram, ProgramUniform_Model), 1, GL_FALSE, &model[0][0]);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glEnable(GL_DEPTH_TEST);
+        glDisable(GL_CULL_FACE);
+        glDisable(GL_BLEND);
+        glStencilFunc(GL_ALWAYS, 0, 0xff);
+        glStencilOpSeparate(GL_BACK, GL_KEEP, GL_INCR_WRAP, GL_KEEP);
+        glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP);
+        glDrawElementsBaseVertex(GL_TRIANGLES, indexCount, GL_UNSIGNED_SHORT, indexOffset, baseVertex);
+
+        // Light
+        glUseProgram(lightProgram.handle);
+        glUniformMatrix4fv(GetProgramUniform(lightProgram, ProgramUniform_Model), 1, GL_FALSE, &model[0][0]);
+        glUniform1ui(GetProgramUniform(lightProgram, ProgramUniform_LightIndex), gpuLightIdx);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDisable(GL_DEPTH_TEST);
+        glEnable(GL_CULL_FACE);
+        glEnable(GL_BLEND);
+        glStencilFunc(GL_NOTEQUAL, 0, 0xff);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_ZERO);
+        glDrawElementsBaseVertex(GL_TRIANGLES, indexCount, GL_UNSIGNED_SHORT, indexOffset, baseVertex);
+
+        volumes.drawnLights++;
+    }
+
+    glBindVertexArray(0);
+    glDisable(GL_STENCIL_TEST);
+    glDisable(GL_DEPTH_CLAMP);
+    glDisable(GL_BLEND);
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_CULL_FACE);
+    glCullFace(GL_BACK);
+    glDepthMask(GL_TRUE);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+    glUseProgram(0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
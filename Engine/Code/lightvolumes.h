@@ -0,0 +1,38 @@
+//
+// lightvolumes.h: Deferred point and spot lights drawn as bounding volumes.
+//
+// Every point light is drawn as a sphere of its range and every spot light as a cone of
+// its range and angle, wide cones fall back to the sphere. The G-buffer depth is copied
+// into the depth stencil buffer of the accumulation framebuffer, so the shading can read
+// positions from the original, and each volume takes two draws against it:
+//
+//   - Stencil: no color, depth test without writes, back faces behind the scene increment
+//     and front faces behind it decrement, so only pixels inside the volume end up nonzero.
+//   - Light: back faces without depth test where the stencil is nonzero, shading the pixel
+//     with additive blending into an HDR accumulation buffer and zeroing the stencil for
+//     the next light.
+//
+// Depth clamping keeps volumes that cross the far plane whole. The lighting pass of
+// quad.glsl adds the ambient term and the directional lights on top of the accumulation.
+//
+
+#pragma once
+#include "engine.h"
+
+struct Frustum;
+
+#define LIGHT_VOLUME_SEGMENTS        16    // around the sphere and the cone, the sphere has half as many rings
+#define LIGHT_VOLUME_MAX_CONE_ANGLE  75.0f // degrees, wider spot lights use the sphere
+
+/**
+ * Builds the volume meshes and the accumulation framebuffer. The programs must be loaded
+ * already.
+ */
+void CreateLightVolumes(App* app);
+void DestroyLightVolumes(LightVolumes& volumes);
+
+/**
+ * Accumulates every point and spot light intersecting the frustum. Expects the lights to
+ * be uploaded this frame (see UploadLights).
+ */
+void RenderLightVolumes(App* app, const Frustum& frustum);
@@ -0,0 +1,173 @@
+//
+// loader.cpp : Worker threads of the asset loader (see loader.h). Nothing in here may
+// call OpenGL or use the frame arena, both belong to the main thread.
+//
+
+#include "loader.h"
+#include "meshcook.h"
+#include "texturecook.h"
+#include "textureregistry.h"
+
+#define PAGE_SIZE KB(4)
+
+// Touches every page of a mapped range so the OS reads it from disk in this thread
+// instead of stalling the main thread when the range is handed to glBufferData.
+static void PrefetchMappedRange(const u8* data, u64 size)
+{
+    volatile u8 sink = 0;
+    for (u64 offset = 0; offset < size; offset += PAGE_SIZE)
+        sink += data[offset];
+    if (size > 0)
+        sink += data[size - 1];
+}
+
+static void ExecuteModelJob(LoadJob& job)
+{
+    const char* filename = job.filepath.c_str();
+    std::string cookedPath = GetCookedMeshPath(filename);
+
+    if (IsCookedMeshUpToDate(filename, cookedPath.c_str(), job.compactVertices))
+    {
+        job.cookedFile = MapFile(cookedPath.c_str());
+
+        const CookedMeshHeader* header = NULL;
+        const CookedSubmesh* submeshes = NULL;
+        const CookedMaterial* materials = NULL;
+        const Meshlet* meshlets = NULL;
+        if (ParseCookedMesh(job.cookedFile, &header, &submeshes, &materials, &meshlets))
+        {
+            PrefetchMappedRange(job.cookedFile.data + header->vertexDataOffset, job.cookedFile.size - header->vertexDataOffset);
+            job.uploadSize = header->vertexDataSize + header->indexDataSize;
+            job.succeeded = true;
+            return;
+        }
+
+        UnmapFile(job.cookedFile);
+    }
+
+    if (!ImportModel(filename, job.model))
+        return;
+
+    WriteCookedMesh(job.model, cookedPath.c_str(), job.compactVertices);
+
+    for (u32 i = 0; i < job.model.mesh.submeshes.size(); ++i)
+    {
+        const Submesh& submesh = job.model.mesh.submeshes[i];
+        job.uploadSize += submesh.vertices.size() * sizeof(float) + submesh.indices.size() * sizeof(u32);
+    }
+    job.succeeded = true;
+}
+
+static void ExecuteTextureJob(LoadJob& job)
+{
+    job.cookedFile = MapCookedTexture(job.filepath.c_str(), job.supportsS3TC);
+    if (job.cookedFile.data)
+    {
+        PrefetchMappedRange(job.cookedFile.data, job.cookedFile.size);
+        job.uploadSize = job.cookedFile.size;
+        job.contentHash = HashCookedTextureContent(job.cookedFile);
+        job.succeeded = true;
+        return;
+    }
+
+    job.image = LoadImage(job.filepath.c_str());
+    if (job.image.pixels)
+    {
+        job.uploadSize = (u64)job.image.stride * job.image.size.y;
+        job.contentHash = HashImageContent(job.image);
+        job.succeeded = true;
+    }
+}
+
+static void WorkerMain(AssetLoader* loader)
+{
+    for (;;)
+    {
+        LoadJob* job = NULL;
+        {
+            std::unique_lock<std::mutex> lock(loader->mutex);
+            loader->jobAvailable.wait(lock, [loader] { return loader->quit || !loader->pendingJobs.empty(); });
+            if (loader->quit)
+                return;
+
+            job = loader->pendingJobs.front();
+            loader->pendingJobs.pop_front();
+        }
+
+        switch (job->type)
+        {
+            case LoadJob_Model:   ExecuteModelJob(*job); break;
+            case LoadJob_Texture: ExecuteTextureJob(*job); break;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(loader->mutex);
+            loader->completedJobs.push_back(job);
+        }
+    }
+}
+
+void StartAssetLoader(AssetLoader& loader, u32 workerCount)
+{
+    loader.quit = false;
+    loader.unfinishedJobCount = 0;
+    for (u32 i = 0; i < workerCount; ++i)
+        loader.workers.push_back(std::thread(WorkerMain, &loader));
+}
+
+void StopAssetLoader(AssetLoader& loader)
+{
+    {
+        std::lock_guard<std::mutex> lock(loader.mutex);
+        loader.quit = true;
+    }
+    loader.jobAvailable.notify_all();
+
+    for (u32 i = 0; i < loader.workers.size(); ++i)
+        loader.workers[i].join();
+    loader.workers.clear();
+
+    for (u32 i = 0; i < loader.pendingJobs.size(); ++i)
+        FreeLoadJob(loader.pendingJobs[i]);
+    for (u32 i = 0; i < loader.completedJobs.size(); ++i)
+        FreeLoadJob(loader.completedJobs[i]);
+    loader.pendingJobs.clear();
+    loader.completedJobs.clear();
+    loader.unfinishedJobCount = 0;
+}
+
+void SubmitLoadJob(AssetLoader& loader, LoadJob* job)
+{
+    {
+        std::lock_guard<std::mutex> lock(loader.mutex);
+        loader.pendingJobs.push_back(job);
+        loader.unfinishedJobCount++;
+    }
+    loader.jobAvailable.notify_one();
+}
+
+LoadJob* PopCompletedLoadJob(AssetLoader& loader)
+{
+    std::lock_guard<std::mutex> lock(loader.mutex);
+    if (loader.completedJobs.empty())
+        return NULL;
+
+    LoadJob* job = loader.completedJobs.front();
+    loader.completedJobs.pop_front();
+    loader.unfinishedJobCount--;
+    return job;
+}
+
+u32 GetUnfinishedLoadJobCount(AssetLoader& loader)
+{
+    std::lock_guard<std::mutex> lock(loader.mutex);
+    return loader.unfinishedJobCount;
+}
+
+void FreeLoadJob(LoadJob* job)
+{
+    UnmapFile(job->cookedFile);
+    if (job->image.pixels)
+        FreeImage(job->image);
+    delete job;
+}
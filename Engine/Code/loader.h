@@ -0,0 +1,65 @@
+//
+// loader.h: Background loading of models and textures. Worker threads take care of the
+// file I/O, the parsing and the image decoding, and hand the results back to the main
+// thread, which is the only one allowed to talk to OpenGL and to modify the App.
+//
+
+#pragma once
+#include "engine.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+enum LoadJobType
+{
+    LoadJob_Model,
+    LoadJob_Texture
+};
+
+struct LoadJob
+{
+    LoadJobType type;
+    u32         targetIdx;  // model or texture slot reserved when the job was submitted
+    std::string filepath;
+    bool        supportsS3TC; // whether BC1/BC3 cooked textures can be used
+    bool        compactVertices; // layout used when a model has to be cooked again
+
+    // Filled by the worker thread
+    bool        succeeded;
+    MappedFile  cookedFile; // up to date cooked mesh or texture, uploaded straight from the mapping
+    ModelImport model;      // model that had to go through the importer
+    Image       image;
+    u64         uploadSize; // bytes that will be sent to the GPU when finishing the job
+    u64         contentHash; // texture texels, to share the GL texture of an identical image
+};
+
+struct AssetLoader
+{
+    std::vector<std::thread> workers;
+    std::mutex               mutex;
+    std::condition_variable  jobAvailable;
+    std::deque<LoadJob*>     pendingJobs;
+    std::deque<LoadJob*>     completedJobs;
+    u32                      unfinishedJobCount; // submitted and not popped yet
+    bool                     quit;
+};
+
+void StartAssetLoader(AssetLoader& loader, u32 workerCount);
+
+/**
+ * Waits for the jobs being executed, then discards everything still queued.
+ */
+void StopAssetLoader(AssetLoader& loader);
+
+void SubmitLoadJob(AssetLoader& loader, LoadJob* job);
+
+/**
+ * Returns the next job whose CPU work is done, or NULL if there is none yet.
+ * The caller owns the job and has to release it with FreeLoadJob.
+ */
+LoadJob* PopCompletedLoadJob(AssetLoader& loader);
+
+u32 GetUnfinishedLoadJobCount(AssetLoader& loader);
+
+void FreeLoadJob(LoadJob* job);
@@ -0,0 +1,252 @@
+//
+// meshcook.cpp : Writes and validates cooked mesh files (see meshcook.h).
+//
+
+#include "meshcook.h"
+#include "vertexformat.h"
+
+std::string GetCookedMeshPath(const char* filename)
+{
+    return std::string(filename) + COOKED_MESH_EXTENSION;
+}
+
+bool IsCookedMeshUpToDate(const char* filename, const char* cookedPath, bool compactVertices)
+{
+    u64 cookedTimestamp = GetFileLastWriteTimestamp(cookedPath);
+    if (cookedTimestamp == 0 || cookedTimestamp < GetFileLastWriteTimestamp(filename))
+        return false;
+
+    FILE* file = fopen(cookedPath, "rb");
+    if (!file)
+        return false;
+
+    CookedMeshHeader header = {};
+    bool read = fread(&header, sizeof(header), 1, file) == 1;
+    fclose(file);
+    return read && header.compactVertices == (compactVertices ? 1u : 0u);
+}
+
+static void CopyFixedString(char* dst, u32 dstSize, const std::string& src)
+{
+    if (src.size() >= dstSize)
+        ELOG("Cooked mesh: '%s' is too long and will be truncated", src.c_str());
+
+    strncpy(dst, src.c_str(), dstSize - 1);
+    dst[dstSize - 1] = '\0';
+}
+
+static void WritePadding(FILE* file, u64& offset, u64 alignment)
+{
+    static const u8 zeros[COOKED_DATA_ALIGNMENT] = {};
+    u64 aligned = (offset + alignment - 1) & ~(alignment - 1);
+    fwrite(zeros, 1, (size_t)(aligned - offset), file);
+    offset = aligned;
+}
+
+bool WriteCookedMesh(const ModelImport& model, const char* filepath, bool compactVertices)
+{
+    const Mesh& mesh = model.mesh;
+
+    CookedMeshHeader header = {};
+    header.magic = COOKED_MESH_MAGIC;
+    header.version = COOKED_MESH_VERSION;
+    header.submeshCount = (u32)mesh.submeshes.size();
+    header.materialCount = (u32)model.materials.size();
+    header.compactVertices = compactVertices ? 1 : 0;
+
+    std::vector<PackedSubmesh> packedSubmeshes(header.submeshCount);
+    std::vector<CookedSubmesh> submeshes(header.submeshCount);
+    for (u32 i = 0; i < header.submeshCount; ++i)
+    {
+        PackedSubmesh& packed = packedSubmeshes[i];
+        PackSubmesh(mesh.submeshes[i], compactVertices, packed);
+        CookedSubmesh& cooked = submeshes[i];
+
+        if (packed.layout.attributes.size() > COOKED_MAX_ATTRIBUTES)
+        {
+            ELOG("Cooked mesh: submesh %u of %s has too many attributes", i, filepath);
+            return false;
+        }
+
+        cooked.attributeCount = (u32)packed.layout.attributes.size();
+        for (u32 j = 0; j < cooked.attributeCount; ++j)
+        {
+            const VertexBufferAttribute& attribute = packed.layout.attributes[j];
+            cooked.attributes[j].location = attribute.location;
+            cooked.attributes[j].componentCount = attribute.componenetCount;
+            cooked.attributes[j].offset = attribute.offset;
+            cooked.attributes[j].normalized = attribute.normalized;
+            cooked.attributes[j].type = attribute.type;
+        }
+        cooked.stride = packed.layout.stride;
+        cooked.vertexOffset = (u32)header.vertexDataSize;
+        cooked.vertexSize = (u32)packed.vertices.size();
+        cooked.indexOffset = (u32)header.indexDataSize;
+        cooked.indexCount = (u32)mesh.submeshes[i].indices.size();
+        cooked.indexType = packed.indexType;
+        cooked.materialIndex = i < model.submeshMaterialIndices.size() ? model.submeshMaterialIndices[i] : 0;
+        cooked.meshletOffset = header.meshletCount;
+        cooked.meshletCount = (u32)mesh.submeshes[i].meshlets.size();
+        header.meshletCount += cooked.meshletCount;
+
+        if (mesh.submeshes[i].lods.size() > SUBMESH_MAX_LODS)
+        {
+            ELOG("Cooked mesh: submesh %u of %s has too many LODs", i, filepath);
+            return false;
+        }
+        cooked.lodCount = (u32)mesh.submeshes[i].lods.size();
+        for (u32 j = 0; j < cooked.lodCount; ++j)
+            cooked.lods[j] = mesh.submeshes[i].lods[j];
+        for (u32 c = 0; c < 3; ++c)
+        {
+            cooked.positionScale[c] = packed.positionScale[c];
+            cooked.positionOffset[c] = packed.positionOffset[c];
+            cooked.boundsCenter[c] = mesh.submeshes[i].boundsCenter[c];
+            cooked.boundsExtent[c] = mesh.submeshes[i].boundsExtent[c];
+        }
+        cooked.boundsRadius = mesh.submeshes[i].boundsRadius;
+
+        // 32 bit indices have to stay 4 byte aligned after 16 bit ones
+        header.vertexDataSize += cooked.vertexSize;
+        header.indexDataSize = (header.indexDataSize + packed.indices.size() + 3) & ~(u64)3;
+    }
+
+    std::vector<CookedMaterial> materials(header.materialCount);
+    for (u32 i = 0; i < header.materialCount; ++i)
+    {
+        const MaterialImport& material = model.materials[i];
+        CookedMaterial& cooked = materials[i];
+        memset(&cooked, 0, sizeof(cooked));
+
+        CopyFixedString(cooked.name, COOKED_MAX_NAME, material.name);
+        cooked.albedo[0] = material.albedo.r;
+        cooked.albedo[1] = material.albedo.g;
+        cooked.albedo[2] = material.albedo.b;
+        cooked.emissive[0] = material.emissive.r;
+        cooked.emissive[1] = material.emissive.g;
+        cooked.emissive[2] = material.emissive.b;
+        cooked.smoothness = material.smoothness;
+        for (u32 slot = 0; slot < MaterialTexture_Count; ++slot)
+            CopyFixedString(cooked.textures[slot], COOKED_MAX_PATH, material.textures[slot]);
+    }
+
+    u64 offset = sizeof(CookedMeshHeader) + header.submeshCount * sizeof(CookedSubmesh) + header.materialCount * sizeof(CookedMaterial) + header.meshletCount * sizeof(Meshlet);
+    header.vertexDataOffset = (offset + COOKED_DATA_ALIGNMENT - 1) & ~(u64)(COOKED_DATA_ALIGNMENT - 1);
+    header.indexDataOffset = (header.vertexDataOffset + header.vertexDataSize + COOKED_DATA_ALIGNMENT - 1) & ~(u64)(COOKED_DATA_ALIGNMENT - 1);
+
+    FILE* file = fopen(filepath, "wb");
+    if (!file)
+    {
+        ELOG("fopen() failed writing cooked mesh %s", filepath);
+        return false;
+    }
+
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(submeshes.data(), sizeof(CookedSubmesh), submeshes.size(), file);
+    fwrite(materials.data(), sizeof(CookedMaterial), materials.size(), file);
+    for (u32 i = 0; i < header.submeshCount; ++i)
+        fwrite(mesh.submeshes[i].meshlets.data(), sizeof(Meshlet), mesh.submeshes[i].meshlets.size(), file);
+
+    WritePadding(file, offset, COOKED_DATA_ALIGNMENT);
+    for (u32 i = 0; i < header.submeshCount; ++i)
+    {
+        const PackedSubmesh& packed = packedSubmeshes[i];
+        fwrite(packed.vertices.data(), 1, packed.vertices.size(), file);
+        offset += packed.vertices.size();
+    }
+
+    WritePadding(file, offset, COOKED_DATA_ALIGNMENT);
+    for (u32 i = 0; i < header.submeshCount; ++i)
+    {
+        const PackedSubmesh& packed = packedSubmeshes[i];
+        fwrite(packed.indices.data(), 1, packed.indices.size(), file);
+        offset += packed.indices.size();
+        WritePadding(file, offset, 4);
+    }
+
+    bool success = ferror(file) == 0;
+    fclose(file);
+
+    if (!success)
+    {
+        ELOG("fwrite() failed writing cooked mesh %s", filepath);
+        remove(filepath);
+    }
+    return success;
+}
+
+bool CookModel(const char* filename, const char* cookedPath, bool compactVertices)
+{
+    ModelImport model;
+    if (!ImportModel(filename, model))
+        return false;
+
+    if (!WriteCookedMesh(model, cookedPath, compactVertices))
+        return false;
+
+    ILOG("Cooked %s -> %s", filename, cookedPath);
+    return true;
+}
+
+bool ParseCookedMesh(const MappedFile& file, const CookedMeshHeader** outHeader, const CookedSubmesh** outSubmeshes, const CookedMaterial** outMaterials, const Meshlet** outMeshlets)
+{
+    if (!file.data || file.size < sizeof(CookedMeshHeader))
+        return false;
+
+    const CookedMeshHeader* header = (const CookedMeshHeader*)file.data;
+    if (header->magic != COOKED_MESH_MAGIC || header->version != COOKED_MESH_VERSION)
+        return false;
+
+    u64 tablesSize = sizeof(CookedMeshHeader) + (u64)header->submeshCount * sizeof(CookedSubmesh) + (u64)header->materialCount * sizeof(CookedMaterial) + (u64)header->meshletCount * sizeof(Meshlet);
+    if (tablesSize > file.size ||
+        header->vertexDataOffset + header->vertexDataSize > file.size ||
+        header->indexDataOffset + header->indexDataSize > file.size)
+        return false;
+
+    const CookedSubmesh* submeshes = (const CookedSubmesh*)(file.data + sizeof(CookedMeshHeader));
+    for (u32 i = 0; i < header->submeshCount; ++i)
+    {
+        const CookedSubmesh& submesh = submeshes[i];
+        if (submesh.attributeCount > COOKED_MAX_ATTRIBUTES ||
+            submesh.stride == 0 || submesh.stride > 255 ||
+            (u64)submesh.vertexOffset + submesh.vertexSize > header->vertexDataSize ||
+            (submesh.indexType != GL_UNSIGNED_SHORT && submesh.indexType != GL_UNSIGNED_INT) ||
+            (u64)submesh.indexOffset + (u64)submesh.indexCount * GetIndexSize(submesh.indexType) > header->indexDataSize ||
+            submesh.materialIndex >= header->materialCount ||
+            (u64)submesh.meshletOffset + submesh.meshletCount > header->meshletCount ||
+            submesh.lodCount > SUBMESH_MAX_LODS)
+            return false;
+
+        for (u32 j = 0; j < submesh.lodCount; ++j)
+            if ((u64)submesh.lods[j].indexOffset + submesh.lods[j].indexCount > submesh.indexCount)
+                return false;
+
+        // A corrupt index would make the GPU read outside the vertices of the submesh
+        const u32 vertexCount = submesh.vertexSize / submesh.stride;
+        const u8* indices = file.data + header->indexDataOffset + submesh.indexOffset;
+        for (u32 j = 0; j < submesh.indexCount; ++j)
+        {
+            u32 index = submesh.indexType == GL_UNSIGNED_SHORT ? ((const u16*)indices)[j] : ((const u32*)indices)[j];
+            if (index >= vertexCount)
+                return false;
+        }
+    }
+
+    const CookedMaterial* materials = (const CookedMaterial*)(submeshes + header->submeshCount);
+    const Meshlet* meshlets = (const Meshlet*)(materials + header->materialCount);
+    for (u32 i = 0; i < header->submeshCount; ++i)
+    {
+        for (u32 j = 0; j < submeshes[i].meshletCount; ++j)
+        {
+            const Meshlet& meshlet = meshlets[submeshes[i].meshletOffset + j];
+            if ((u64)meshlet.indexOffset + meshlet.indexCount > submeshes[i].indexCount)
+                return false;
+        }
+    }
+
+    *outHeader = header;
+    *outSubmeshes = submeshes;
+    *outMaterials = materials;
+    *outMeshlets = meshlets;
+    return true;
+}
@@ -0,0 +1,109 @@
+//
+// meshcook.h: Binary container for models that already went through the import pipeline.
+// A cooked file stores every submesh interleaved exactly as it is uploaded to the GPU (packed
+// by vertexformat.h), so loading it is a page-in of the file plus one glBufferData per buffer.
+//
+// File layout (all offsets are in bytes from the start of the file):
+//
+//   CookedMeshHeader
+//   CookedSubmesh  [header.submeshCount]
+//   CookedMaterial [header.materialCount]
+//   Meshlet        [header.meshletCount]
+//   vertex data    (header.vertexDataOffset, header.vertexDataSize)
+//   index data     (header.indexDataOffset,  header.indexDataSize)
+//
+
+#pragma once
+#include "engine.h"
+#include "simplify.h"
+
+#define COOKED_MESH_MAGIC      0x4D504741 // "AGPM"
+#define COOKED_MESH_VERSION    7
+#define COOKED_MESH_EXTENSION  ".mesh"
+#define COOKED_DATA_ALIGNMENT  16
+
+#define COOKED_MAX_ATTRIBUTES  8
+#define COOKED_MAX_NAME        64
+#define COOKED_MAX_PATH        128
+
+struct CookedMeshHeader
+{
+    u32 magic;
+    u32 version;
+    u32 submeshCount;
+    u32 materialCount;
+    u32 meshletCount;
+    u32 compactVertices; // 1 if the vertices were packed with the compact layout
+    u64 vertexDataOffset;
+    u64 vertexDataSize;
+    u64 indexDataOffset;
+    u64 indexDataSize;
+};
+
+struct CookedAttribute
+{
+    u8  location;
+    u8  componentCount;
+    u8  offset;
+    u8  normalized;
+    u32 type;          // GL_FLOAT, GL_HALF_FLOAT, GL_SHORT...
+};
+
+struct CookedSubmesh
+{
+    CookedAttribute attributes[COOKED_MAX_ATTRIBUTES];
+    u32 attributeCount;
+    u32 stride;
+    u32 vertexOffset;  // relative to the vertex data block
+    u32 vertexSize;
+    u32 indexOffset;   // relative to the index data block
+    u32 indexCount;    // full detail mesh and all its LODs
+    u32 materialIndex; // relative to the materials of this file
+    u32 indexType;     // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    f32 positionScale[3];
+    f32 positionOffset[3];
+    f32 boundsCenter[3];  // object space, see Submesh
+    f32 boundsExtent[3];
+    f32 boundsRadius;
+    u32 meshletOffset; // relative to the meshlets of this file
+    u32 meshletCount;
+    u32 lodCount;
+    SubmeshLod lods[SUBMESH_MAX_LODS];
+};
+
+struct CookedMaterial
+{
+    char name[COOKED_MAX_NAME];
+    f32  albedo[3];
+    f32  emissive[3];
+    f32  smoothness;
+    char textures[MaterialTexture_Count][COOKED_MAX_PATH]; // relative to the model directory
+};
+
+/**
+ * Returns the path of the cooked file that belongs to a source model.
+ */
+std::string GetCookedMeshPath(const char* filename);
+
+/**
+ * True if the cooked file exists, is not older than its source and was written with the
+ * same vertex layout.
+ */
+bool IsCookedMeshUpToDate(const char* filename, const char* cookedPath, bool compactVertices);
+
+/**
+ * Writes an imported model into a cooked mesh file, with compact vertices if requested.
+ * Returns false if the model does not fit the format or the file could not be written.
+ */
+bool WriteCookedMesh(const ModelImport& model, const char* filepath, bool compactVertices);
+
+/**
+ * Imports a source model and writes its cooked version into cookedPath.
+ */
+bool CookModel(const char* filename, const char* cookedPath, bool compactVertices);
+
+/**
+ * Validates a mapped cooked mesh file, down to every index being inside its submesh. On success the returned pointers reference
+ * the mapped memory directly, nothing is copied.
+ */
+bool ParseCookedMesh(const MappedFile& file, const CookedMeshHeader** header, const CookedSubmesh** submeshes, const CookedMaterial** materials, const Meshlet** meshlets);
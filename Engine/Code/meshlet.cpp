@@ -0,0 +1,184 @@
+//
+// meshlet.cpp : Meshlet builder and normal cone test (see meshlet.h).
+//
+// Meshlets are grown greedily: starting from the first triangle not assigned yet, the
+// builder keeps adding the neighbouring triangle that brings the fewest new vertices,
+// which keeps meshlets compact and their bounds tight, until one of the limits is hit.
+//
+
+#include "meshlet.h"
+
+// Wider than a half sphere, such a meshlet can never be backfacing as a whole
+#define MESHLET_CONE_DISABLED 2.0f
+
+static vec3 GetPosition(const Submesh& submesh, u32 positionOffset, u32 vertex)
+{
+    const u32 stride = submesh.vertexBufferLayout.stride / sizeof(float);
+    const float* position = &submesh.vertices[vertex * stride + positionOffset];
+    return vec3(position[0], position[1], position[2]);
+}
+
+static void ComputeMeshletBounds(const Submesh& submesh, u32 positionOffset, const u32* indices, Meshlet& meshlet)
+{
+    vec3 boundsMin = vec3(FLT_MAX);
+    vec3 boundsMax = vec3(-FLT_MAX);
+    for (u32 i = 0; i < meshlet.indexCount; ++i)
+    {
+        vec3 position = GetPosition(submesh, positionOffset, indices[i]);
+        boundsMin = glm::min(boundsMin, position);
+        boundsMax = glm::max(boundsMax, position);
+    }
+
+    meshlet.center = (boundsMin + boundsMax) * 0.5f;
+    meshlet.radius = 0.0f;
+    for (u32 i = 0; i < meshlet.indexCount; ++i)
+        meshlet.radius = glm::max(meshlet.radius, glm::length(GetPosition(submesh, positionOffset, indices[i]) - meshlet.center));
+
+    // Normal cone: average normal and the widest deviation from it
+    std::vector<vec3> normals;
+    vec3 axis = vec3(0.0f);
+    for (u32 i = 0; i < meshlet.indexCount; i += 3)
+    {
+        vec3 p0 = GetPosition(submesh, positionOffset, indices[i + 0]);
+        vec3 p1 = GetPosition(submesh, positionOffset, indices[i + 1]);
+        vec3 p2 = GetPosition(submesh, positionOffset, indices[i + 2]);
+        vec3 normal = glm::cross(p1 - p0, p2 - p0);
+        f32 length = glm::length(normal);
+        normals.push_back(length > 0.0f ? normal / length : vec3(0.0f));
+        axis += normals.back();
+    }
+
+    meshlet.coneAxis = glm::length(axis) > 0.0f ? glm::normalize(axis) : vec3(0.0f, 0.0f, 1.0f);
+    meshlet.coneApex = meshlet.center;
+    meshlet.coneCutoff = MESHLET_CONE_DISABLED;
+
+    f32 minDot = 1.0f;
+    for (u32 i = 0; i < normals.size(); ++i)
+        if (normals[i] != vec3(0.0f))
+            minDot = glm::min(minDot, glm::dot(normals[i], meshlet.coneAxis));
+
+    if (minDot <= 0.1f)
+        return;
+
+    // Move the apex back along the axis until every triangle plane is in front of it
+    f32 maxT = 0.0f;
+    for (u32 i = 0; i < normals.size(); ++i)
+    {
+        if (normals[i] == vec3(0.0f))
+            continue;
+        vec3 p0 = GetPosition(submesh, positionOffset, indices[i * 3]);
+        f32 t = glm::dot(meshlet.center - p0, normals[i]) / glm::dot(meshlet.coneAxis, normals[i]);
+        maxT = glm::max(maxT, t);
+    }
+
+    meshlet.coneApex = meshlet.center - meshlet.coneAxis * maxT;
+    meshlet.coneCutoff = sqrtf(1.0f - minDot * minDot);
+}
+
+void BuildMeshlets(Submesh& submesh)
+{
+    submesh.meshlets.clear();
+
+    const VertexBufferLayout& layout = submesh.vertexBufferLayout;
+    const u32 stride = layout.stride / sizeof(float);
+    const u32 vertexCount = stride > 0 ? (u32)submesh.vertices.size() / stride : 0;
+    const u32 triangleCount = (u32)submesh.indices.size() / 3;
+    if (vertexCount == 0 || triangleCount == 0)
+        return;
+
+    u32 positionOffset = 0;
+    for (u32 i = 0; i < layout.attributes.size(); ++i)
+        if (layout.attributes[i].location == 0)
+            positionOffset = layout.attributes[i].offset / sizeof(float);
+
+    // Triangles that use each vertex
+    std::vector<u32> vertexTriangleStart(vertexCount + 1, 0);
+    for (u32 i = 0; i < triangleCount * 3; ++i)
+        vertexTriangleStart[submesh.indices[i] + 1]++;
+    for (u32 v = 0; v < vertexCount; ++v)
+        vertexTriangleStart[v + 1] += vertexTriangleStart[v];
+
+    std::vector<u32> vertexTriangles(triangleCount * 3);
+    std::vector<u32> fillCursor(vertexTriangleStart.begin(), vertexTriangleStart.end() - 1);
+    for (u32 i = 0; i < triangleCount * 3; ++i)
+        vertexTriangles[fillCursor[submesh.indices[i]]++] = i / 3;
+
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<u32> vertexMeshlet(vertexCount, UINT32_MAX); // last meshlet that used the vertex
+    std::vector<u32> candidates;
+    std::vector<u32> indices;
+    indices.reserve(submesh.indices.size());
+
+    u32 seedCursor = 0;
+    while (indices.size() < triangleCount * 3)
+    {
+        while (emitted[seedCursor])
+            seedCursor++;
+
+        const u32 meshletIdx = (u32)submesh.meshlets.size();
+        Meshlet meshlet = {};
+        meshlet.indexOffset = (u32)indices.size();
+
+        u32 meshletVertexCount = 0;
+        u32 meshletTriangleCount = 0;
+        u32 triangle = seedCursor;
+        candidates.clear();
+
+        while (triangle != UINT32_MAX)
+        {
+            emitted[triangle] = true;
+            meshletTriangleCount++;
+            for (u32 corner = 0; corner < 3; ++corner)
+            {
+                u32 vertex = submesh.indices[triangle * 3 + corner];
+                indices.push_back(vertex);
+                if (vertexMeshlet[vertex] != meshletIdx)
+                {
+                    vertexMeshlet[vertex] = meshletIdx;
+                    meshletVertexCount++;
+                    for (u32 i = vertexTriangleStart[vertex]; i < vertexTriangleStart[vertex + 1]; ++i)
+                        candidates.push_back(vertexTriangles[i]);
+                }
+            }
+
+            if (meshletTriangleCount == MESHLET_MAX_TRIANGLES)
+                break;
+
+            // Neighbour that adds the fewest vertices and still fits
+            triangle = UINT32_MAX;
+            u32 bestNewVertices = 4;
+            u32 remaining = 0;
+            for (u32 i = 0; i < candidates.size(); ++i)
+            {
+                u32 candidate = candidates[i];
+                if (emitted[candidate])
+                    continue;
+                candidates[remaining++] = candidate;
+
+                u32 newVertices = 0;
+                for (u32 corner = 0; corner < 3; ++corner)
+                    newVertices += vertexMeshlet[submesh.indices[candidate * 3 + corner]] != meshletIdx ? 1 : 0;
+
+                if (newVertices < bestNewVertices && meshletVertexCount + newVertices <= MESHLET_MAX_VERTICES)
+                {
+                    bestNewVertices = newVertices;
+                    triangle = candidate;
+                }
+            }
+            candidates.resize(remaining);
+        }
+
+        meshlet.indexCount = (u32)indices.size() - meshlet.indexOffset;
+        ComputeMeshletBounds(submesh, positionOffset, &indices[meshlet.indexOffset], meshlet);
+        submesh.meshlets.push_back(meshlet);
+    }
+
+    submesh.indices.swap(indices);
+}
+
+bool IsMeshletBackfacing(const Meshlet& meshlet, vec3 cameraPosition)
+{
+    vec3 toApex = meshlet.coneApex - cameraPosition;
+    f32 distance = glm::length(toApex);
+    return glm::dot(toApex, meshlet.coneAxis) >= meshlet.coneCutoff * distance;
+}
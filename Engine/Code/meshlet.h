@@ -0,0 +1,23 @@
+//
+// meshlet.h: Splits submeshes into meshlets, small clusters of triangles with their own
+// bounding sphere and normal cone, so the renderer can skip the parts of a big mesh that
+// are outside of the frustum or facing away from the camera.
+//
+
+#pragma once
+#include "engine.h"
+
+#define MESHLET_MAX_VERTICES  64
+#define MESHLET_MAX_TRIANGLES 124
+
+/**
+ * Builds the meshlets of a submesh with the float layout of the importers. The indices are
+ * reordered so that every meshlet is a contiguous range of submesh.indices.
+ */
+void BuildMeshlets(Submesh& submesh);
+
+/**
+ * True if every triangle of the meshlet faces away from a camera at cameraPosition, which
+ * has to be in the object space of the meshlet.
+ */
+bool IsMeshletBackfacing(const Meshlet& meshlet, vec3 cameraPosition);
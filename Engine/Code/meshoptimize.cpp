@@ -0,0 +1,356 @@
+//
+// meshoptimize.cpp : Vertex cache, overdraw and vertex fetch optimization (see meshoptimize.h).
+//
+
+#include "meshoptimize.h"
+#include <algorithm>
+
+// Scoring constants from Forsyth's article
+#define CACHE_DECAY_POWER   1.5f
+#define LAST_TRIANGLE_SCORE 0.75f
+#define VALENCE_BOOST_SCALE 2.0f
+#define VALENCE_BOOST_POWER 0.5f
+
+static f32 ComputeVertexScore(i32 cachePosition, u32 remainingTriangles)
+{
+    if (remainingTriangles == 0)
+        return -1.0f; // no triangle needs it anymore
+
+    f32 score = 0.0f;
+    if (cachePosition >= 0)
+    {
+        if (cachePosition < 3)
+        {
+            // the vertices of the last triangle get a fixed score, so the next one
+            // does not just reuse the same edge
+            score = LAST_TRIANGLE_SCORE;
+        }
+        else
+        {
+            f32 scaler = 1.0f / (VERTEX_CACHE_SIZE - 3);
+            score = powf(1.0f - (cachePosition - 3) * scaler, CACHE_DECAY_POWER);
+        }
+    }
+
+    // vertices with few triangles left get a boost, so they are finished and leave the cache
+    score += VALENCE_BOOST_SCALE * powf((f32)remainingTriangles, -VALENCE_BOOST_POWER);
+    return score;
+}
+
+void OptimizeVertexCache(u32* indices, u32 indexCount, u32 vertexCount)
+{
+    const u32 triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+        return;
+
+    // Triangles that use each vertex
+    std::vector<u32> triangleStart(vertexCount + 1, 0);
+    for (u32 i = 0; i < indexCount; ++i)
+        triangleStart[indices[i] + 1]++;
+    for (u32 v = 0; v < vertexCount; ++v)
+        triangleStart[v + 1] += triangleStart[v];
+
+    std::vector<u32> vertexTriangles(indexCount);
+    std::vector<u32> fillCursor(triangleStart.begin(), triangleStart.end() - 1);
+    for (u32 i = 0; i < indexCount; ++i)
+        vertexTriangles[fillCursor[indices[i]]++] = i / 3;
+
+    std::vector<u32> remainingTriangles(vertexCount);
+    std::vector<i32> cachePosition(vertexCount, -1);
+    std::vector<f32> vertexScore(vertexCount);
+    for (u32 v = 0; v < vertexCount; ++v)
+    {
+        remainingTriangles[v] = triangleStart[v + 1] - triangleStart[v];
+        vertexScore[v] = ComputeVertexScore(-1, remainingTriangles[v]);
+    }
+
+    std::vector<bool> emitted(triangleCount, false);
+
+    std::vector<u32> output;
+    output.reserve(indexCount);
+
+    // 3 extra entries hold the vertices pushed out by the last triangle
+    u32 cache[VERTEX_CACHE_SIZE + 3];
+    u32 cacheCount = 0;
+    u32 scanCursor = 0;
+
+    u32 bestTriangle = UINT32_MAX;
+    while (output.size() < indexCount)
+    {
+        if (bestTriangle == UINT32_MAX)
+        {
+            // Nothing in the cache is useful anymore: restart from the first triangle left,
+            // scanning for the best score here would make the pass quadratic
+            while (emitted[scanCursor])
+                scanCursor++;
+            bestTriangle = scanCursor;
+        }
+
+        emitted[bestTriangle] = true;
+        const u32* triangle = &indices[bestTriangle * 3];
+
+        // Move the vertices of the triangle to the front of the cache
+        u32 newCache[VERTEX_CACHE_SIZE + 3];
+        u32 newCacheCount = 0;
+        for (u32 k = 0; k < 3; ++k)
+        {
+            output.push_back(triangle[k]);
+            if ((k < 1 || triangle[k] != triangle[0]) && (k < 2 || triangle[k] != triangle[1]))
+                newCache[newCacheCount++] = triangle[k]; // degenerate triangles repeat vertices
+
+            // this triangle is done with the vertex: swap it past the live range
+            // [start, start + remaining) of the vertex's triangles
+            u32 vertex = triangle[k];
+            u32 begin = triangleStart[vertex];
+            u32 end = begin + remainingTriangles[vertex];
+            for (u32 i = begin; i < end; ++i)
+            {
+                if (vertexTriangles[i] == bestTriangle)
+                {
+                    vertexTriangles[i] = vertexTriangles[end - 1];
+                    vertexTriangles[end - 1] = bestTriangle;
+                    remainingTriangles[vertex]--;
+                    break;
+                }
+            }
+        }
+        for (u32 i = 0; i < cacheCount; ++i)
+        {
+            u32 vertex = cache[i];
+            if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2])
+                newCache[newCacheCount++] = vertex;
+        }
+
+        // Vertices falling out of the cache lose their position
+        for (u32 i = VERTEX_CACHE_SIZE; i < newCacheCount; ++i)
+        {
+            cachePosition[newCache[i]] = -1;
+            vertexScore[newCache[i]] = ComputeVertexScore(-1, remainingTriangles[newCache[i]]);
+        }
+        cacheCount = glm::min(newCacheCount, (u32)VERTEX_CACHE_SIZE);
+        memcpy(cache, newCache, cacheCount * sizeof(u32));
+
+        // Update the scores of the cached vertices and pick the best of their triangles
+        for (u32 i = 0; i < cacheCount; ++i)
+        {
+            u32 vertex = cache[i];
+            cachePosition[vertex] = (i32)i;
+            vertexScore[vertex] = ComputeVertexScore((i32)i, remainingTriangles[vertex]);
+        }
+
+        bestTriangle = UINT32_MAX;
+        f32 bestScore = -FLT_MAX;
+        for (u32 i = 0; i < cacheCount; ++i)
+        {
+            u32 vertex = cache[i];
+            u32 begin = triangleStart[vertex];
+            for (u32 j = begin; j < begin + remainingTriangles[vertex]; ++j)
+            {
+                u32 t = vertexTriangles[j];
+                const u32* candidate = &indices[t * 3];
+                f32 score = vertexScore[candidate[0]] + vertexScore[candidate[1]] + vertexScore[candidate[2]];
+                if (score > bestScore)
+                {
+                    bestScore = score;
+                    bestTriangle = t;
+                }
+            }
+        }
+    }
+
+    memcpy(indices, output.data(), indexCount * sizeof(u32));
+}
+
+struct TriangleCluster
+{
+    u32 firstTriangle;
+    u32 triangleCount;
+    f32 sortKey;
+};
+
+void OptimizeOverdraw(u32* indices, u32 indexCount, const u8* positions, u32 positionStride, u32 vertexCount)
+{
+    const u32 triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+        return;
+
+    // Clusters start where the cache order restarts, i.e. the triangle misses all its
+    // vertices, so moving them around costs very few extra vertex transforms
+    std::vector<u32> cacheTimestamp(vertexCount, 0);
+    u32 timestamp = VERTEX_CACHE_ANALYSIS_SIZE + 1;
+
+    std::vector<TriangleCluster> clusters;
+    for (u32 t = 0; t < triangleCount; ++t)
+    {
+        u32 misses = 0;
+        for (u32 k = 0; k < 3; ++k)
+        {
+            u32 vertex = indices[t * 3 + k];
+            if (timestamp - cacheTimestamp[vertex] > VERTEX_CACHE_ANALYSIS_SIZE)
+            {
+                cacheTimestamp[vertex] = timestamp++;
+                misses++;
+            }
+        }
+
+        if (t == 0 || misses == 3)
+            clusters.push_back(TriangleCluster{ t, 0, 0.0f });
+        clusters.back().triangleCount++;
+    }
+
+    if (clusters.size() < 2)
+        return;
+
+    // Mesh centroid and, per cluster, area weighted centroid and normal
+    vec3 meshCentroid = vec3(0.0f);
+    f32 meshArea = 0.0f;
+    std::vector<vec3> clusterCentroids(clusters.size());
+    std::vector<vec3> clusterNormals(clusters.size());
+    for (u32 c = 0; c < clusters.size(); ++c)
+    {
+        vec3 centroid = vec3(0.0f);
+        vec3 normal = vec3(0.0f);
+        f32 area = 0.0f;
+        for (u32 t = clusters[c].firstTriangle; t < clusters[c].firstTriangle + clusters[c].triangleCount; ++t)
+        {
+            vec3 p[3];
+            for (u32 k = 0; k < 3; ++k)
+            {
+                const float* position = (const float*)(positions + indices[t * 3 + k] * positionStride);
+                p[k] = vec3(position[0], position[1], position[2]);
+            }
+            vec3 triangleNormal = glm::cross(p[1] - p[0], p[2] - p[0]);
+            f32 triangleArea = glm::length(triangleNormal) * 0.5f;
+            centroid += (p[0] + p[1] + p[2]) * (triangleArea / 3.0f);
+            normal += triangleNormal;
+            area += triangleArea;
+        }
+        clusterCentroids[c] = area > 0.0f ? centroid / area : vec3(0.0f);
+        clusterNormals[c] = glm::length(normal) > 0.0f ? glm::normalize(normal) : vec3(0.0f);
+        meshCentroid += centroid;
+        meshArea += area;
+    }
+    if (meshArea > 0.0f)
+        meshCentroid /= meshArea;
+
+    // Clusters facing away from the centre are likely to occlude the others, draw them first
+    for (u32 c = 0; c < clusters.size(); ++c)
+        clusters[c].sortKey = glm::dot(clusterCentroids[c] - meshCentroid, clusterNormals[c]);
+
+    std::stable_sort(clusters.begin(), clusters.end(), [](const TriangleCluster& a, const TriangleCluster& b) { return a.sortKey > b.sortKey; });
+
+    std::vector<u32> output;
+    output.reserve(indexCount);
+    for (u32 c = 0; c < clusters.size(); ++c)
+        output.insert(output.end(), indices + clusters[c].firstTriangle * 3, indices + (clusters[c].firstTriangle + clusters[c].triangleCount) * 3);
+
+    memcpy(indices, output.data(), indexCount * sizeof(u32));
+}
+
+u32 OptimizeVertexFetch(u8* vertices, u32 vertexCount, u32 vertexSize, u32* indices, u32 indexCount)
+{
+    std::vector<u32> remap(vertexCount, UINT32_MAX);
+    std::vector<u8> reordered(vertexCount * vertexSize);
+
+    u32 nextVertex = 0;
+    for (u32 i = 0; i < indexCount; ++i)
+    {
+        u32 vertex = indices[i];
+        if (remap[vertex] == UINT32_MAX)
+        {
+            remap[vertex] = nextVertex;
+            memcpy(&reordered[nextVertex * vertexSize], &vertices[vertex * vertexSize], vertexSize);
+            nextVertex++;
+        }
+        indices[i] = remap[vertex];
+    }
+
+    memcpy(vertices, reordered.data(), nextVertex * vertexSize);
+    return nextVertex;
+}
+
+void OptimizeVertexCacheRange(u32* indices, u32 indexCount, std::vector<u32>& remap)
+{
+    // Local vertex ids in order of first use
+    std::vector<u32> localVertices;
+    for (u32 i = 0; i < indexCount; ++i)
+    {
+        u32& local = remap[indices[i]];
+        if (local == UINT32_MAX)
+        {
+            local = (u32)localVertices.size();
+            localVertices.push_back(indices[i]);
+        }
+        indices[i] = local;
+    }
+
+    OptimizeVertexCache(indices, indexCount, (u32)localVertices.size());
+
+    for (u32 i = 0; i < indexCount; ++i)
+        indices[i] = localVertices[indices[i]];
+    for (u32 v = 0; v < localVertices.size(); ++v)
+        remap[localVertices[v]] = UINT32_MAX;
+}
+
+VertexCacheStats AnalyzeVertexCache(const u32* indices, u32 indexCount, u32 vertexCount)
+{
+    VertexCacheStats stats = {};
+    stats.triangleCount = indexCount / 3;
+
+    std::vector<u32> cacheTimestamp(vertexCount, 0);
+    std::vector<bool> referenced(vertexCount, false);
+    u32 timestamp = VERTEX_CACHE_ANALYSIS_SIZE + 1;
+
+    for (u32 i = 0; i < indexCount; ++i)
+    {
+        u32 vertex = indices[i];
+        if (!referenced[vertex])
+        {
+            referenced[vertex] = true;
+            stats.vertexCount++;
+        }
+
+        // FIFO cache: a vertex is still in it if fewer than N misses happened since it entered
+        if (timestamp - cacheTimestamp[vertex] > VERTEX_CACHE_ANALYSIS_SIZE)
+        {
+            cacheTimestamp[vertex] = timestamp++;
+            stats.transformedCount++;
+        }
+    }
+
+    stats.acmr = stats.triangleCount > 0 ? (f32)stats.transformedCount / stats.triangleCount : 0.0f;
+    stats.atvr = stats.vertexCount > 0 ? (f32)stats.transformedCount / stats.vertexCount : 0.0f;
+    return stats;
+}
+
+void AccumulateVertexCacheStats(VertexCacheStats& total, const VertexCacheStats& stats)
+{
+    total.triangleCount += stats.triangleCount;
+    total.vertexCount += stats.vertexCount;
+    total.transformedCount += stats.transformedCount;
+    total.acmr = total.triangleCount > 0 ? (f32)total.transformedCount / total.triangleCount : 0.0f;
+    total.atvr = total.vertexCount > 0 ? (f32)total.transformedCount / total.vertexCount : 0.0f;
+}
+
+void OptimizeSubmesh(Submesh& submesh)
+{
+    const VertexBufferLayout& layout = submesh.vertexBufferLayout;
+    const u32 stride = layout.stride / sizeof(float);
+    const u32 vertexCount = stride > 0 ? (u32)submesh.vertices.size() / stride : 0;
+    const u32 indexCount = (u32)submesh.indices.size();
+    if (vertexCount == 0 || indexCount == 0)
+        return;
+
+    u32 positionOffset = 0;
+    for (u32 i = 0; i < layout.attributes.size(); ++i)
+        if (layout.attributes[i].location == 0)
+            positionOffset = layout.attributes[i].offset;
+
+    OptimizeVertexCache(submesh.indices.data(), indexCount, vertexCount);
+
+    const u8* positions = (const u8*)submesh.vertices.data() + positionOffset;
+    OptimizeOverdraw(submesh.indices.data(), indexCount, positions, layout.stride, vertexCount);
+
+    u32 usedVertexCount = OptimizeVertexFetch((u8*)submesh.vertices.data(), vertexCount, layout.stride, submesh.indices.data(), indexCount);
+    submesh.vertices.resize(usedVertexCount * stride);
+}
@@ -0,0 +1,61 @@
+//
+// meshoptimize.h: Post-import optimization of index and vertex buffers, replacing
+// aiProcess_ImproveCacheLocality so every mesh goes through the same passes whatever its
+// source. The passes only need plain index lists and raw interleaved vertices, so they
+// can run on procedural meshes and on already packed (cooked) data as well.
+//
+//   OptimizeVertexCache: reorders triangles for the post-transform cache (Tom Forsyth,
+//                        "Linear-Speed Vertex Cache Optimisation")
+//   OptimizeOverdraw:    splits that order into clusters and draws the outward facing
+//                        ones first (Sander, Nehab and Barczak, "Fast Triangle Reordering
+//                        for Vertex Locality and Reduced Overdraw")
+//   OptimizeVertexFetch: reorders vertices by first use so fetches walk memory linearly
+//
+
+#pragma once
+#include "engine.h"
+
+#define VERTEX_CACHE_SIZE          32 // cache modelled by the optimizer
+#define VERTEX_CACHE_ANALYSIS_SIZE 16 // FIFO used to report statistics, a typical hardware size
+
+struct VertexCacheStats
+{
+    u32 triangleCount;
+    u32 vertexCount;      // vertices referenced by the indices
+    u32 transformedCount; // cache misses
+    f32 acmr;             // average cache miss ratio: transformed vertices per triangle (0.5 - 3)
+    f32 atvr;             // average transformed vertex ratio: transformed per referenced vertex (1 is optimal)
+};
+
+void OptimizeVertexCache(u32* indices, u32 indexCount, u32 vertexCount);
+
+/**
+ * OptimizeVertexCache on a range of a larger index list (a meshlet, a LOD), against only
+ * the vertices the range references so the cost follows its size. remap is scratch shared
+ * by the ranges of a mesh: one entry per vertex, all UINT32_MAX, and left that way.
+ */
+void OptimizeVertexCacheRange(u32* indices, u32 indexCount, std::vector<u32>& remap);
+
+/**
+ * Expects indices already optimized for the vertex cache. positions points to the first
+ * position, positionStride is the distance in bytes between two of them.
+ */
+void OptimizeOverdraw(u32* indices, u32 indexCount, const u8* positions, u32 positionStride, u32 vertexCount);
+
+/**
+ * Reorders vertices (vertexSize bytes each) by first use and remaps the indices. Unused
+ * vertices are dropped, returns the number of vertices left.
+ */
+u32 OptimizeVertexFetch(u8* vertices, u32 vertexCount, u32 vertexSize, u32* indices, u32 indexCount);
+
+VertexCacheStats AnalyzeVertexCache(const u32* indices, u32 indexCount, u32 vertexCount);
+
+/**
+ * Adds the counts of stats to total and updates its ratios.
+ */
+void AccumulateVertexCacheStats(VertexCacheStats& total, const VertexCacheStats& stats);
+
+/**
+ * Runs the three passes on a submesh with the float layout of the importers.
+ */
+void OptimizeSubmesh(Submesh& submesh);
@@ -0,0 +1,691 @@
+//
+// objimport.cpp : Parallel Wavefront OBJ/MTL importer (see objimport.h).
+//
+
+#include "objimport.h"
+#include <thread>
+#include <unordered_map>
+
+#define OBJ_INDEX_NONE 0xFFFFFFFFu
+
+// Default material of the Assimp OBJ importer, for faces before any usemtl
+#define OBJ_DEFAULT_MATERIAL "DefaultMaterial"
+#define OBJ_DEFAULT_ALBEDO   0.6f
+
+struct ObjCorner
+{
+    u32 position;
+    u32 texCoord;
+    u32 normal;
+};
+
+struct ObjMaterialSwitch
+{
+    u32         firstTriangle; // relative to the chunk
+    std::string name;
+};
+
+struct ObjChunk
+{
+    const char* begin;
+    const char* end;
+
+    std::vector<f32>       positions; // xyz
+    std::vector<f32>       texCoords; // uv
+    std::vector<f32>       normals;   // xyz
+    std::vector<ObjCorner> corners;   // 3 per triangle
+
+    // Negative indices are stored relative to the first element of the chunk until the
+    // element counts of the previous chunks are known
+    std::vector<u32> relativeCorners; // corner * 3 + attribute
+
+    std::vector<ObjMaterialSwitch> materialSwitches;
+    std::vector<std::string>       materialLibraries;
+    u32                            errorLine; // line of the first error, relative to the chunk, 0 if none
+};
+
+static const f64 PowersOf10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static bool IsSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static bool IsDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static const char* SkipSpaces(const char* c, const char* end)
+{
+    while (c < end && IsSpace(*c))
+        c++;
+    return c;
+}
+
+static const char* SkipLine(const char* c, const char* end)
+{
+    while (c < end && *c != '\n')
+        c++;
+    return c < end ? c + 1 : end;
+}
+
+// Decimal floats as written by exporters: up to 19 significant digits are accumulated in
+// an integer and scaled once, which is exact enough for 32 bit results and much faster
+// than strtod, which also depends on the locale.
+static const char* ParseFloat(const char* c, const char* end, f32& value)
+{
+    c = SkipSpaces(c, end);
+
+    bool negative = false;
+    if (c < end && (*c == '-' || *c == '+'))
+        negative = *c++ == '-';
+
+    u64 mantissa = 0;
+    u32 digits = 0;
+    i32 exponent = 0;
+    for (; c < end && IsDigit(*c); ++c)
+    {
+        if (digits < 19)
+        {
+            mantissa = mantissa * 10 + (*c - '0');
+            digits += mantissa > 0 ? 1 : 0;
+        }
+        else
+        {
+            exponent++;
+        }
+    }
+    if (c < end && *c == '.')
+    {
+        for (++c; c < end && IsDigit(*c); ++c)
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (*c - '0');
+                digits += mantissa > 0 ? 1 : 0;
+                exponent--;
+            }
+        }
+    }
+    if (c < end && (*c == 'e' || *c == 'E'))
+    {
+        ++c;
+        bool negativeExponent = false;
+        if (c < end && (*c == '-' || *c == '+'))
+            negativeExponent = *c++ == '-';
+        i32 e = 0;
+        for (; c < end && IsDigit(*c); ++c)
+            e = e < 10000 ? e * 10 + (*c - '0') : e;
+        exponent += negativeExponent ? -e : e;
+    }
+
+    f64 result = (f64)mantissa;
+    while (exponent > 22) { result *= 1e22; exponent -= 22; }
+    while (exponent < -22) { result /= 1e22; exponent += 22; }
+    result = exponent >= 0 ? result * PowersOf10[exponent] : result / PowersOf10[-exponent];
+
+    value = (f32)(negative ? -result : result);
+    return c;
+}
+
+// Returns false when there is no number
+static bool ParseIndex(const char*& c, const char* end, i64& value)
+{
+    bool negative = false;
+    if (c < end && *c == '-')
+    {
+        negative = true;
+        c++;
+    }
+    if (c >= end || !IsDigit(*c))
+        return false;
+
+    value = 0;
+    for (; c < end && IsDigit(*c); ++c)
+        value = value * 10 + (*c - '0');
+    if (negative)
+        value = -value;
+    return true;
+}
+
+// Rest of the line without trailing spaces
+static std::string ParseName(const char* c, const char* end)
+{
+    c = SkipSpaces(c, end);
+    const char* nameEnd = c;
+    while (nameEnd < end && *nameEnd != '\n')
+        nameEnd++;
+    while (nameEnd > c && IsSpace(nameEnd[-1]))
+        nameEnd--;
+    return std::string(c, nameEnd);
+}
+
+struct ObjPolygonCorner
+{
+    ObjCorner corner;
+    u32       relativeAttributes; // bit per attribute resolved relative to the chunk
+};
+
+// OBJ indices start at 1, negative ones count back from the last element seen, which
+// may be in a previous chunk, so they stay relative to the chunk for now
+static u32 ResolveIndex(i64 index, u32 localCount, u32 attribute, u32& relativeAttributes)
+{
+    if (index > 0)
+        return (u32)(index - 1);
+
+    relativeAttributes |= 1u << attribute;
+    return (u32)(i32)(index + (i64)localCount);
+}
+
+static bool ParseFace(ObjChunk& chunk, std::vector<ObjPolygonCorner>& polygon, const char* c, const char* end)
+{
+    const u32 counts[3] = { (u32)chunk.positions.size() / 3, (u32)chunk.texCoords.size() / 2, (u32)chunk.normals.size() / 3 };
+    polygon.clear();
+
+    for (;;)
+    {
+        c = SkipSpaces(c, end);
+        if (c >= end || *c == '\n' || *c == '#')
+            break;
+
+        // v, v/vt, v//vn or v/vt/vn
+        ObjPolygonCorner corner = { { OBJ_INDEX_NONE, OBJ_INDEX_NONE, OBJ_INDEX_NONE }, 0 };
+        i64 index;
+        if (!ParseIndex(c, end, index) || index == 0)
+            return false;
+        corner.corner.position = ResolveIndex(index, counts[0], 0, corner.relativeAttributes);
+
+        if (c < end && *c == '/')
+        {
+            c++;
+            if (c < end && *c != '/')
+            {
+                if (!ParseIndex(c, end, index) || index == 0)
+                    return false;
+                corner.corner.texCoord = ResolveIndex(index, counts[1], 1, corner.relativeAttributes);
+            }
+            if (c < end && *c == '/')
+            {
+                c++;
+                if (!ParseIndex(c, end, index) || index == 0)
+                    return false;
+                corner.corner.normal = ResolveIndex(index, counts[2], 2, corner.relativeAttributes);
+            }
+        }
+        if (c < end && !IsSpace(*c) && *c != '\n')
+            return false;
+
+        polygon.push_back(corner);
+    }
+
+    // Fan triangulation, points and lines are dropped like SortByPType does
+    for (u32 i = 2; i < polygon.size(); ++i)
+    {
+        const ObjPolygonCorner* triangle[3] = { &polygon[0], &polygon[i - 1], &polygon[i] };
+        for (u32 k = 0; k < 3; ++k)
+        {
+            for (u32 attribute = 0; attribute < 3; ++attribute)
+                if (triangle[k]->relativeAttributes & (1u << attribute))
+                    chunk.relativeCorners.push_back((u32)chunk.corners.size() * 3 + attribute);
+            chunk.corners.push_back(triangle[k]->corner);
+        }
+    }
+    return true;
+}
+
+static void ParseChunk(ObjChunk* chunk)
+{
+    const char* c = chunk->begin;
+    const char* end = chunk->end;
+    u32 line = 1;
+    std::vector<ObjPolygonCorner> polygon;
+
+    for (; c < end; c = SkipLine(c, end), ++line)
+    {
+        c = SkipSpaces(c, end);
+        if (c >= end || *c == '\n' || *c == '#')
+            continue;
+
+        bool valid = true;
+        if (c[0] == 'v' && c + 1 < end && IsSpace(c[1]))
+        {
+            f32 xyz[3];
+            c = ParseFloat(c + 1, end, xyz[0]);
+            c = ParseFloat(c, end, xyz[1]);
+            c = ParseFloat(c, end, xyz[2]);
+            chunk->positions.insert(chunk->positions.end(), xyz, xyz + 3);
+        }
+        else if (c[0] == 'v' && c + 2 < end && c[1] == 't' && IsSpace(c[2]))
+        {
+            f32 uv[2];
+            c = ParseFloat(c + 2, end, uv[0]);
+            c = ParseFloat(c, end, uv[1]);
+            chunk->texCoords.insert(chunk->texCoords.end(), uv, uv + 2);
+        }
+        else if (c[0] == 'v' && c + 2 < end && c[1] == 'n' && IsSpace(c[2]))
+        {
+            f32 xyz[3];
+            c = ParseFloat(c + 2, end, xyz[0]);
+            c = ParseFloat(c, end, xyz[1]);
+            c = ParseFloat(c, end, xyz[2]);
+            chunk->normals.insert(chunk->normals.end(), xyz, xyz + 3);
+        }
+        else if (c[0] == 'f' && c + 1 < end && IsSpace(c[1]))
+        {
+            valid = ParseFace(*chunk, polygon, c + 1, end);
+        }
+        else if (end - c > 7 && strncmp(c, "usemtl", 6) == 0 && IsSpace(c[6]))
+        {
+            chunk->materialSwitches.push_back(ObjMaterialSwitch{ (u32)chunk->corners.size() / 3, ParseName(c + 6, end) });
+        }
+        else if (end - c > 7 && strncmp(c, "mtllib", 6) == 0 && IsSpace(c[6]))
+        {
+            chunk->materialLibraries.push_back(ParseName(c + 6, end));
+        }
+        // o, g, s, l, p and anything else do not change the result
+
+        if (!valid && chunk->errorLine == 0)
+            chunk->errorLine = line;
+    }
+}
+
+static bool IsMtlKey(const char* c, const char* end, const char* key)
+{
+    size_t length = strlen(key);
+    return (size_t)(end - c) > length && strncmp(c, key, length) == 0 && IsSpace(c[length]);
+}
+
+static void ParseMtlColor(const char* c, const char* end, vec3& color)
+{
+    c = ParseFloat(c, end, color.r);
+    c = ParseFloat(c, end, color.g);
+    c = ParseFloat(c, end, color.b);
+}
+
+// Texture statements may start with options ("-bm 1.0 normal.png"), the file name is last
+static std::string ParseMtlTexture(const char* c, const char* end)
+{
+    std::string line = ParseName(c, end);
+    size_t separator = line.find_last_of(" \t");
+    return separator == std::string::npos ? line : line.substr(separator + 1);
+}
+
+static void ParseMtlFile(const std::string& filepath, std::vector<MaterialImport>& materials)
+{
+    MappedFile file = MapFile(filepath.c_str());
+    if (!file.data)
+    {
+        ELOG("Could not open material library %s", filepath.c_str());
+        return;
+    }
+
+    const char* c = (const char*)file.data;
+    const char* end = c + file.size;
+    MaterialImport* material = NULL;
+
+    for (; c < end; c = SkipLine(c, end))
+    {
+        c = SkipSpaces(c, end);
+        if (IsMtlKey(c, end, "newmtl"))
+        {
+            materials.push_back(MaterialImport{});
+            material = &materials.back();
+            material->name = ParseName(c + 6, end);
+            material->albedo = vec3(OBJ_DEFAULT_ALBEDO);
+            material->emissive = vec3(0.0f);
+            material->smoothness = 0.0f;
+            continue;
+        }
+        if (!material)
+            continue;
+
+        if (IsMtlKey(c, end, "Kd"))
+            ParseMtlColor(c + 2, end, material->albedo);
+        else if (IsMtlKey(c, end, "Ke"))
+            ParseMtlColor(c + 2, end, material->emissive);
+        else if (IsMtlKey(c, end, "Ns"))
+        {
+            ParseFloat(c + 2, end, material->smoothness);
+            material->smoothness /= 256.0f; // same scale as ProcessAssimpMaterial
+        }
+        else if (IsMtlKey(c, end, "map_Kd"))
+            material->textures[MaterialTexture_Albedo] = ParseMtlTexture(c + 6, end);
+        else if (IsMtlKey(c, end, "map_Ke"))
+            material->textures[MaterialTexture_Emissive] = ParseMtlTexture(c + 6, end);
+        else if (IsMtlKey(c, end, "map_Ks"))
+            material->textures[MaterialTexture_Specular] = ParseMtlTexture(c + 6, end);
+        else if (IsMtlKey(c, end, "norm"))
+            material->textures[MaterialTexture_Normals] = ParseMtlTexture(c + 4, end);
+        else if (IsMtlKey(c, end, "map_Kn"))
+            material->textures[MaterialTexture_Normals] = ParseMtlTexture(c + 6, end);
+        else if (IsMtlKey(c, end, "map_Bump") || IsMtlKey(c, end, "map_bump"))
+            material->textures[MaterialTexture_Bump] = ParseMtlTexture(c + 8, end);
+        else if (IsMtlKey(c, end, "bump"))
+            material->textures[MaterialTexture_Bump] = ParseMtlTexture(c + 4, end);
+    }
+
+    UnmapFile(file);
+}
+
+static u32 HashCorner(const ObjCorner& corner)
+{
+    u32 hash = corner.position * 0x9e3779b1u;
+    hash ^= (corner.texCoord + 0x7f4a7c15u + (hash << 6) + (hash >> 2)) * 0x85ebca6bu;
+    hash ^= (corner.normal + 0x7f4a7c15u + (hash << 6) + (hash >> 2)) * 0xc2b2ae35u;
+    return hash ^ (hash >> 16);
+}
+
+static vec3 ReadVec3(const std::vector<f32>& values, u32 index)
+{
+    return vec3(values[index * 3], values[index * 3 + 1], values[index * 3 + 2]);
+}
+
+// Builds an indexed submesh from the triangles of one material, with the same vertex
+// layout ProcessAssimpMesh creates
+static void BuildObjSubmesh(const std::vector<ObjCorner>& corners, const std::vector<f32>& positions, const std::vector<f32>& texCoords, const std::vector<f32>& normals, Submesh& submesh)
+{
+    bool hasTexCoords = false;
+    bool hasNormals = true;
+    for (u32 i = 0; i < corners.size(); ++i)
+    {
+        hasTexCoords |= corners[i].texCoord != OBJ_INDEX_NONE;
+        hasNormals &= corners[i].normal != OBJ_INDEX_NONE;
+    }
+
+    // Unique corners, open addressing on the attribute indices
+    u32 tableSize = 1;
+    while (tableSize < corners.size() * 2)
+        tableSize *= 2;
+    std::vector<u32> table(tableSize, OBJ_INDEX_NONE);
+    std::vector<ObjCorner> uniqueCorners;
+    submesh.indices.resize(corners.size());
+
+    for (u32 i = 0; i < corners.size(); ++i)
+    {
+        ObjCorner key = corners[i];
+        key.texCoord = hasTexCoords ? key.texCoord : OBJ_INDEX_NONE;
+        key.normal = hasNormals ? key.normal : OBJ_INDEX_NONE;
+
+        u32 slot = HashCorner(key) & (tableSize - 1);
+        for (;; slot = (slot + 1) & (tableSize - 1))
+        {
+            u32 vertex = table[slot];
+            if (vertex == OBJ_INDEX_NONE)
+            {
+                vertex = uniqueCorners.size();
+                table[slot] = vertex;
+                uniqueCorners.push_back(key);
+                submesh.indices[i] = vertex;
+                break;
+            }
+            const ObjCorner& other = uniqueCorners[vertex];
+            if (other.position == key.position && other.texCoord == key.texCoord && other.normal == key.normal)
+            {
+                submesh.indices[i] = vertex;
+                break;
+            }
+        }
+    }
+
+    const u32 vertexCount = uniqueCorners.size();
+    std::vector<vec3> vertexNormals(vertexCount);
+    if (hasNormals)
+    {
+        for (u32 v = 0; v < vertexCount; ++v)
+            vertexNormals[v] = ReadVec3(normals, uniqueCorners[v].normal);
+    }
+    else
+    {
+        // Smooth normals shared by every corner on the same position, area weighted
+        std::unordered_map<u32, vec3> positionNormals;
+        for (u32 i = 0; i + 2 < corners.size(); i += 3)
+        {
+            vec3 p0 = ReadVec3(positions, corners[i].position);
+            vec3 p1 = ReadVec3(positions, corners[i + 1].position);
+            vec3 p2 = ReadVec3(positions, corners[i + 2].position);
+            vec3 faceNormal = glm::cross(p1 - p0, p2 - p0);
+            for (u32 k = 0; k < 3; ++k)
+                positionNormals[corners[i + k].position] += faceNormal;
+        }
+        for (u32 v = 0; v < vertexCount; ++v)
+        {
+            vec3 normal = positionNormals[uniqueCorners[v].position];
+            vertexNormals[v] = glm::length(normal) > 0.0f ? glm::normalize(normal) : vec3(0.0f, 1.0f, 0.0f);
+        }
+    }
+
+    // Tangent space from the texture coordinate gradients (Lengyel)
+    std::vector<vec3> tangents;
+    std::vector<vec3> bitangents;
+    if (hasTexCoords)
+    {
+        tangents.assign(vertexCount, vec3(0.0f));
+        bitangents.assign(vertexCount, vec3(0.0f));
+        for (u32 i = 0; i + 2 < submesh.indices.size(); i += 3)
+        {
+            const ObjCorner* c[3] = { &uniqueCorners[submesh.indices[i]], &uniqueCorners[submesh.indices[i + 1]], &uniqueCorners[submesh.indices[i + 2]] };
+            vec2 uv[3];
+            for (u32 k = 0; k < 3; ++k)
+                uv[k] = c[k]->texCoord != OBJ_INDEX_NONE ? vec2(texCoords[c[k]->texCoord * 2], texCoords[c[k]->texCoord * 2 + 1]) : vec2(0.0f);
+
+            vec3 p0 = ReadVec3(positions, c[0]->position);
+            vec3 dp1 = ReadVec3(positions, c[1]->position) - p0;
+            vec3 dp2 = ReadVec3(positions, c[2]->position) - p0;
+            vec2 duv1 = uv[1] - uv[0];
+            vec2 duv2 = uv[2] - uv[0];
+            f32 determinant = duv1.x * duv2.y - duv2.x * duv1.y;
+            if (fabsf(determinant) < 1e-12f)
+                continue;
+
+            f32 r = 1.0f / determinant;
+            vec3 tangent = (dp1 * duv2.y - dp2 * duv1.y) * r;
+            vec3 bitangent = (dp2 * duv1.x - dp1 * duv2.x) * r;
+            for (u32 k = 0; k < 3; ++k)
+            {
+                tangents[submesh.indices[i + k]] += tangent;
+                bitangents[submesh.indices[i + k]] += bitangent;
+            }
+        }
+
+        for (u32 v = 0; v < vertexCount; ++v)
+        {
+            const vec3& n = vertexNormals[v];
+            vec3 t = tangents[v] - n * glm::dot(n, tangents[v]);
+            vec3 b = bitangents[v] - n * glm::dot(n, bitangents[v]);
+            if (glm::length(t) < 1e-12f)
+                t = fabsf(n.x) < 0.9f ? glm::cross(n, vec3(1.0f, 0.0f, 0.0f)) : glm::cross(n, vec3(0.0f, 1.0f, 0.0f));
+            t = glm::normalize(t);
+            b = glm::length(b) < 1e-12f ? glm::cross(n, t) : glm::normalize(b);
+            tangents[v] = t;
+            bitangents[v] = b;
+        }
+    }
+
+    VertexBufferLayout& layout = submesh.vertexBufferLayout;
+    layout.attributes.push_back(VertexBufferAttribute{ 0, 3, 0 });
+    layout.attributes.push_back(VertexBufferAttribute{ 1, 3, 3 * sizeof(float) });
+    layout.stride = 6 * sizeof(float);
+    if (hasTexCoords)
+    {
+        layout.attributes.push_back(VertexBufferAttribute{ 2, 2, layout.stride });
+        layout.stride += 2 * sizeof(float);
+        layout.attributes.push_back(VertexBufferAttribute{ 3, 3, layout.stride });
+        layout.stride += 3 * sizeof(float);
+        layout.attributes.push_back(VertexBufferAttribute{ 4, 3, layout.stride });
+        layout.stride += 3 * sizeof(float);
+    }
+
+    submesh.vertices.reserve(vertexCount * layout.stride / sizeof(float));
+    for (u32 v = 0; v < vertexCount; ++v)
+    {
+        const ObjCorner& corner = uniqueCorners[v];
+        vec3 position = ReadVec3(positions, corner.position);
+        submesh.vertices.insert(submesh.vertices.end(), { position.x, position.y, position.z });
+        submesh.vertices.insert(submesh.vertices.end(), { vertexNormals[v].x, vertexNormals[v].y, vertexNormals[v].z });
+        if (hasTexCoords)
+        {
+            vec2 uv = corner.texCoord != OBJ_INDEX_NONE ? vec2(texCoords[corner.texCoord * 2], texCoords[corner.texCoord * 2 + 1]) : vec2(0.0f);
+            submesh.vertices.insert(submesh.vertices.end(), { uv.x, uv.y });
+            submesh.vertices.insert(submesh.vertices.end(), { tangents[v].x, tangents[v].y, tangents[v].z });
+            submesh.vertices.insert(submesh.vertices.end(), { bitangents[v].x, bitangents[v].y, bitangents[v].z });
+        }
+    }
+}
+
+bool ImportModelObj(const char* filename, ModelImport& model)
+{
+    MappedFile file = MapFile(filename);
+    if (!file.data)
+    {
+        ELOG("Error loading mesh %s: could not open the file", filename);
+        return false;
+    }
+
+    // Line aligned chunks, one per thread
+    u32 threadCount = glm::max(std::thread::hardware_concurrency(), 1u);
+    u32 chunkCount = (u32)glm::clamp(file.size / OBJ_MIN_CHUNK_SIZE, (u64)1, (u64)threadCount);
+
+    std::vector<ObjChunk> chunks(chunkCount);
+    const char* text = (const char*)file.data;
+    const char* textEnd = text + file.size;
+    const char* chunkBegin = text;
+    for (u32 i = 0; i < chunkCount; ++i)
+    {
+        const char* chunkEnd = i + 1 == chunkCount ? textEnd : text + file.size * (i + 1) / chunkCount;
+        if (chunkEnd < chunkBegin)
+            chunkEnd = chunkBegin;
+        while (chunkEnd < textEnd && chunkEnd[-1] != '\n')
+            chunkEnd++;
+        chunks[i].begin = chunkBegin;
+        chunks[i].end = chunkEnd;
+        chunkBegin = chunkEnd;
+    }
+
+    std::vector<std::thread> threads;
+    for (u32 i = 1; i < chunkCount; ++i)
+        threads.push_back(std::thread(ParseChunk, &chunks[i]));
+    ParseChunk(&chunks[0]);
+    for (u32 i = 0; i < threads.size(); ++i)
+        threads[i].join();
+
+    UnmapFile(file);
+
+    for (u32 i = 0; i < chunkCount; ++i)
+    {
+        if (chunks[i].errorLine != 0)
+        {
+            ELOG("Error loading mesh %s: invalid face in chunk %u, line %u", filename, i, chunks[i].errorLine);
+            return false;
+        }
+    }
+
+    // Stitch the attributes of the chunks together
+    std::vector<f32> positions;
+    std::vector<f32> texCoords;
+    std::vector<f32> normals;
+    std::vector<u32> chunkFirstElement[3];
+    for (u32 i = 0; i < chunkCount; ++i)
+    {
+        chunkFirstElement[0].push_back(positions.size() / 3);
+        chunkFirstElement[1].push_back(texCoords.size() / 2);
+        chunkFirstElement[2].push_back(normals.size() / 3);
+        positions.insert(positions.end(), chunks[i].positions.begin(), chunks[i].positions.end());
+        texCoords.insert(texCoords.end(), chunks[i].texCoords.begin(), chunks[i].texCoords.end());
+        normals.insert(normals.end(), chunks[i].normals.begin(), chunks[i].normals.end());
+        chunks[i].positions = std::vector<f32>();
+        chunks[i].texCoords = std::vector<f32>();
+        chunks[i].normals = std::vector<f32>();
+    }
+    const u32 elementCounts[3] = { (u32)positions.size() / 3, (u32)texCoords.size() / 2, (u32)normals.size() / 3 };
+
+    // Materials, in the order the libraries are referenced
+    std::string directory = filename;
+    size_t separator = directory.find_last_of("/\\");
+    directory = separator == std::string::npos ? "" : directory.substr(0, separator + 1);
+
+    std::unordered_map<std::string, u32> materialIndices;
+    for (u32 i = 0; i < chunkCount; ++i)
+        for (u32 j = 0; j < chunks[i].materialLibraries.size(); ++j)
+            ParseMtlFile(directory + chunks[i].materialLibraries[j], model.materials);
+    for (u32 i = 0; i < model.materials.size(); ++i)
+        materialIndices.emplace(model.materials[i].name, i);
+
+    // Triangles grouped by material, the last group is the default material
+    std::vector<std::vector<ObjCorner>> materialCorners(model.materials.size() + 1);
+    u32 currentMaterial = model.materials.size();
+    for (u32 i = 0; i < chunkCount; ++i)
+    {
+        ObjChunk& chunk = chunks[i];
+        for (u32 j = 0; j < chunk.relativeCorners.size(); ++j)
+        {
+            u32 attribute = chunk.relativeCorners[j] % 3;
+            u32* index = &chunk.corners[chunk.relativeCorners[j] / 3].position + attribute;
+            i64 resolved = (i64)chunkFirstElement[attribute][i] + (i32)*index;
+            if (resolved < 0 || resolved >= elementCounts[attribute])
+            {
+                ELOG("Error loading mesh %s: face index out of range", filename);
+                return false;
+            }
+            *index = (u32)resolved;
+        }
+
+        u32 switchIdx = 0;
+        for (u32 t = 0; t < chunk.corners.size() / 3; ++t)
+        {
+            for (; switchIdx < chunk.materialSwitches.size() && chunk.materialSwitches[switchIdx].firstTriangle <= t; ++switchIdx)
+            {
+                auto it = materialIndices.find(chunk.materialSwitches[switchIdx].name);
+                currentMaterial = it != materialIndices.end() ? it->second : model.materials.size();
+            }
+
+            const ObjCorner* triangle = &chunk.corners[t * 3];
+            for (u32 k = 0; k < 3; ++k)
+            {
+                const u32* corner = &triangle[k].position;
+                for (u32 attribute = 0; attribute < 3; ++attribute)
+                {
+                    if (corner[attribute] != OBJ_INDEX_NONE && corner[attribute] >= elementCounts[attribute])
+                    {
+                        ELOG("Error loading mesh %s: face index out of range", filename);
+                        return false;
+                    }
+                }
+            }
+            materialCorners[currentMaterial].insert(materialCorners[currentMaterial].end(), triangle, triangle + 3);
+        }
+        chunk.corners = std::vector<ObjCorner>();
+    }
+
+    if (!materialCorners.back().empty())
+    {
+        MaterialImport material = {};
+        material.name = OBJ_DEFAULT_MATERIAL;
+        material.albedo = vec3(OBJ_DEFAULT_ALBEDO);
+        model.materials.push_back(material);
+    }
+
+    for (u32 m = 0; m < materialCorners.size(); ++m)
+    {
+        if (materialCorners[m].empty())
+            continue;
+
+        Submesh submesh = {};
+        BuildObjSubmesh(materialCorners[m], positions, texCoords, normals, submesh);
+        materialCorners[m] = std::vector<ObjCorner>();
+        model.mesh.submeshes.push_back(submesh);
+        model.submeshMaterialIndices.push_back(m);
+    }
+
+    if (model.mesh.submeshes.empty())
+    {
+        ELOG("Error loading mesh %s: no faces", filename);
+        return false;
+    }
+
+    ProcessModelImport(model, filename);
+    return true;
+}
@@ -0,0 +1,19 @@
+//
+// objimport.h: Wavefront OBJ/MTL importer, used instead of Assimp for .obj files.
+//
+// The file is mapped and split into line aligned chunks that are parsed in parallel. Each
+// chunk keeps its own vertex attributes and triangles, with indices relative to the chunk
+// where the file uses negative ones, and the chunks are stitched together afterwards.
+// Corners sharing the same position/texcoord/normal indices become a single vertex.
+//
+// The result matches what ImportModelAssimp produces with the import flags it uses:
+// triangulated faces, one submesh per material, smooth normals when the file has none and
+// tangent space whenever there are texture coordinates.
+//
+
+#pragma once
+#include "engine.h"
+
+#define OBJ_MIN_CHUNK_SIZE MB(1) // smaller files are parsed on a single thread
+
+bool ImportModelObj(const char* filename, ModelImport& model);
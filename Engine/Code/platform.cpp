@@ -12,13 +12,17 @@
 #else
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <unistd.h>
 #endif
 
 #include "engine.h"
+#include "texturecook.h"
 
 #include <GLFW/glfw3.h>
 #include <stdio.h>
+#include <string.h>
 #include <imgui.h>
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
@@ -116,8 +120,46 @@ void OnGlfwCloseWindow(GLFWwindow* window)
     app->isRunning = false;
 }
 
-int main()
+int main(int argc, char** argv)
 {
+    // Offline cooking, e.g: Engine.exe -cook Patrick/Patrick.obj -bc7 Patrick/Skin.png
+    // Flags apply to the assets after them: -float/-compact select the vertex layout of
+    // models and -bc1, -bc3, -bc5, -bc7, -auto the format of images.
+    if (argc > 2 && strcmp(argv[1], "-cook") == 0)
+    {
+        GlobalFrameArenaMemory = (u8*)malloc(GLOBAL_FRAME_ARENA_SIZE);
+
+        CookOptions options;
+        int failedCount = 0;
+        for (int i = 2; i < argc; ++i)
+        {
+            if (strcmp(argv[i], "-float") == 0 || strcmp(argv[i], "-compact") == 0)
+            {
+                options.compactVertices = strcmp(argv[i], "-compact") == 0;
+                continue;
+            }
+            if (argv[i][0] == '-')
+            {
+                TextureCookFormat format;
+                if (!ParseTextureCookFormat(argv[i] + 1, &format))
+                {
+                    ELOG("Unknown cook flag '%s'", argv[i]);
+                    free(GlobalFrameArenaMemory);
+                    return failedCount + 1;
+                }
+                options.textureFormat = argv[i] + 1;
+                continue;
+            }
+
+            if (!CookAsset(argv[i], options))
+                failedCount++;
+            GlobalFrameArenaHead = 0;
+        }
+
+        free(GlobalFrameArenaMemory);
+        return failedCount;
+    }
+
     App app         = {};
     app.deltaTime   = 1.0f/60.0f;
     app.displaySize = ivec2(WINDOW_WIDTH, WINDOW_HEIGHT);
@@ -265,6 +307,8 @@ int main()
         GlobalFrameArenaHead = 0;
     }
 
+    Shutdown(&app);
+
     free(GlobalFrameArenaMemory);
 
     ImGui_ImplOpenGL3_Shutdown();
@@ -378,6 +422,11 @@ String ReadTextFile(const char* filepath)
     return fileText;
 }
 
+void* GetGLProcAddress(const char* name)
+{
+    return (void*)glfwGetProcAddress(name);
+}
+
 u64 GetFileLastWriteTimestamp(const char* filepath)
 {
 #ifdef _WIN32
@@ -402,6 +451,115 @@ u64 GetFileLastWriteTimestamp(const char* filepath)
     return 0;
 }
 
+MappedFile MapFile(const char* filepath)
+{
+    MappedFile file = {};
+#ifdef _WIN32
+    HANDLE fileHandle = CreateFileA(filepath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (fileHandle == INVALID_HANDLE_VALUE)
+        return file;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0)
+    {
+        CloseHandle(fileHandle);
+        return file;
+    }
+
+    HANDLE mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mappingHandle)
+    {
+        CloseHandle(fileHandle);
+        return file;
+    }
+
+    void* data = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+    if (!data)
+    {
+        CloseHandle(mappingHandle);
+        CloseHandle(fileHandle);
+        return file;
+    }
+
+    file.data = (const u8*)data;
+    file.size = (u64)fileSize.QuadPart;
+    file.fileHandle = fileHandle;
+    file.mappingHandle = mappingHandle;
+#else
+    int fd = open(filepath, O_RDONLY);
+    if (fd < 0)
+        return file;
+
+    struct stat attrib;
+    if (fstat(fd, &attrib) != 0 || attrib.st_size == 0)
+    {
+        close(fd);
+        return file;
+    }
+
+    void* data = mmap(NULL, (size_t)attrib.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping keeps its own reference to the file
+    if (data == MAP_FAILED)
+        return file;
+
+    file.data = (const u8*)data;
+    file.size = (u64)attrib.st_size;
+#endif
+    return file;
+}
+
+void UnmapFile(MappedFile& file)
+{
+    if (!file.data)
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(file.data);
+    CloseHandle((HANDLE)file.mappingHandle);
+    CloseHandle((HANDLE)file.fileHandle);
+#else
+    munmap((void*)file.data, (size_t)file.size);
+#endif
+    file = {};
+}
+
+u64 HashBytes(const void* data, u64 size, u64 seed)
+{
+    const u64 m = 0xc6a4a7935bd1e995ull;
+    const int r = 47;
+
+    u64 h = seed ^ (size * m);
+
+    const u8* bytes = (const u8*)data;
+    const u8* end = bytes + (size & ~7ull);
+    for (; bytes != end; bytes += 8)
+    {
+        u64 k;
+        memcpy(&k, bytes, sizeof(k));
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+
+    switch (size & 7)
+    {
+        case 7: h ^= (u64)bytes[6] << 48; [[fallthrough]];
+        case 6: h ^= (u64)bytes[5] << 40; [[fallthrough]];
+        case 5: h ^= (u64)bytes[4] << 32; [[fallthrough]];
+        case 4: h ^= (u64)bytes[3] << 24; [[fallthrough]];
+        case 3: h ^= (u64)bytes[2] << 16; [[fallthrough]];
+        case 2: h ^= (u64)bytes[1] << 8; [[fallthrough]];
+        case 1: h ^= (u64)bytes[0];
+                h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
 void LogString(const char* str)
 {
 #ifdef _WIN32
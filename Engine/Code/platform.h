@@ -81,6 +81,35 @@ String ReadTextFile(const char *filepath);
  */
 u64 GetFileLastWriteTimestamp(const char *filepath);
 
+/**
+ * Entry point of a GL function the loader does not cover, such as those of extensions
+ * above the context version. NULL when the driver does not provide it.
+ */
+void* GetGLProcAddress(const char* name);
+
+struct MappedFile
+{
+    const u8* data;
+    u64       size;
+    void*     fileHandle;
+    void*     mappingHandle;
+};
+
+/**
+ * Maps a whole file read-only into the address space of the process. Pages are
+ * loaded on demand by the OS, so no copy of the contents is ever made.
+ * On failure, the returned file has a null data pointer.
+ */
+MappedFile MapFile(const char *filepath);
+
+void UnmapFile(MappedFile& file);
+
+/**
+ * 64 bit hash of a block of memory (MurmurHash64A). Meant for lookups and content
+ * comparison, not for security.
+ */
+u64 HashBytes(const void* data, u64 size, u64 seed = 0);
+
 /**
  * It logs a string to whichever outputs are configured in the platform layer.
  * By default, the string is printed in the output console of VisualStudio.
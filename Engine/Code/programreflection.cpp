@@ -0,0 +1,193 @@
+//
+// programreflection.cpp : Interface query of linked programs (see programreflection.h).
+//
+
+#include "programreflection.h"
+
+struct ProgramUniformInfo
+{
+    const char* name;
+    GLenum      type;
+};
+
+static const ProgramUniformInfo programUniforms[ProgramUniform_Count] = {
+    { "view",              GL_FLOAT_MAT4 },
+    { "projection",        GL_FLOAT_MAT4 },
+    { "octahedralNormals", GL_BOOL },
+    { "FinalRenderID",     GL_INT },
+    { "frustumPlanes[0]",  GL_FLOAT_VEC4 },
+    { "cameraPosition",    GL_FLOAT_VEC3 },
+    { "pixelsPerUnit",     GL_FLOAT },
+    { "lodPixelError",     GL_FLOAT },
+    { "drawCount",         GL_UNSIGNED_INT },
+    { "cullingPhase",      GL_UNSIGNED_INT },
+    { "sourceLevel",       GL_INT },
+    { "lightCount",        GL_UNSIGNED_INT },
+    { "directionalLightCount", GL_UNSIGNED_INT },
+    { "lightingPath",      GL_INT },
+    { "model",             GL_FLOAT_MAT4 },
+    { "lightIndex",        GL_UNSIGNED_INT },
+    { "ssaoSampleCount",   GL_UNSIGNED_INT },
+    { "ssaoRadius",        GL_FLOAT },
+    { "ssaoBias",          GL_FLOAT },
+    { "ssaoDivisor",       GL_INT },
+    { "blurDirection",     GL_INT_VEC2 },
+    { "previousViewProjection", GL_FLOAT_MAT4 },
+    { "gtaoSliceCount",    GL_UNSIGNED_INT },
+    { "gtaoStepCount",     GL_UNSIGNED_INT },
+    { "gtaoRadius",        GL_FLOAT },
+    { "frameIndex",        GL_UNSIGNED_INT },
+    { "historyValid",      GL_BOOL },
+};
+
+static u64 HashResourceName(ProgramResourceKind kind, const char* name)
+{
+    return HashBytes(name, strlen(name), kind);
+}
+
+static bool IsSamplerType(GLenum type)
+{
+    switch (type)
+    {
+    case GL_SAMPLER_1D: case GL_SAMPLER_2D: case GL_SAMPLER_3D: case GL_SAMPLER_CUBE:
+    case GL_SAMPLER_1D_SHADOW: case GL_SAMPLER_2D_SHADOW: case GL_SAMPLER_CUBE_SHADOW:
+    case GL_SAMPLER_1D_ARRAY: case GL_SAMPLER_2D_ARRAY:
+    case GL_SAMPLER_1D_ARRAY_SHADOW: case GL_SAMPLER_2D_ARRAY_SHADOW:
+    case GL_SAMPLER_2D_MULTISAMPLE: case GL_SAMPLER_2D_MULTISAMPLE_ARRAY:
+    case GL_SAMPLER_2D_RECT: case GL_SAMPLER_2D_RECT_SHADOW: case GL_SAMPLER_BUFFER:
+    case GL_INT_SAMPLER_1D: case GL_INT_SAMPLER_2D: case GL_INT_SAMPLER_3D: case GL_INT_SAMPLER_CUBE:
+    case GL_INT_SAMPLER_1D_ARRAY: case GL_INT_SAMPLER_2D_ARRAY: case GL_INT_SAMPLER_BUFFER:
+    case GL_UNSIGNED_INT_SAMPLER_1D: case GL_UNSIGNED_INT_SAMPLER_2D: case GL_UNSIGNED_INT_SAMPLER_3D:
+    case GL_UNSIGNED_INT_SAMPLER_CUBE: case GL_UNSIGNED_INT_SAMPLER_1D_ARRAY:
+    case GL_UNSIGNED_INT_SAMPLER_2D_ARRAY: case GL_UNSIGNED_INT_SAMPLER_BUFFER:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static u8 GetComponentCount(GLenum type)
+{
+    switch (type)
+    {
+    case GL_FLOAT: case GL_INT: case GL_UNSIGNED_INT: case GL_DOUBLE: return 1;
+    case GL_FLOAT_VEC2: case GL_INT_VEC2: case GL_UNSIGNED_INT_VEC2: case GL_DOUBLE_VEC2: return 2;
+    case GL_FLOAT_VEC3: case GL_INT_VEC3: case GL_UNSIGNED_INT_VEC3: case GL_DOUBLE_VEC3: return 3;
+    case GL_FLOAT_VEC4: case GL_INT_VEC4: case GL_UNSIGNED_INT_VEC4: case GL_DOUBLE_VEC4: return 4;
+    case GL_FLOAT_MAT2: return 2;
+    case GL_FLOAT_MAT3: return 3;
+    case GL_FLOAT_MAT4: return 4;
+    default:
+        ELOG("Unsupported vertex input type 0x%x", type);
+        return 0;
+    }
+}
+
+// Matrix inputs take one location per column
+static u8 GetLocationCount(GLenum type)
+{
+    switch (type)
+    {
+    case GL_FLOAT_MAT2: return 2;
+    case GL_FLOAT_MAT3: return 3;
+    case GL_FLOAT_MAT4: return 4;
+    default: return 1;
+    }
+}
+
+static void AddResource(Program& program, ProgramResourceKind kind, const char* name, GLenum type, GLint location, u32 size)
+{
+    program.resourceByName[HashResourceName(kind, name)] = (u32)program.resources.size();
+    program.resources.push_back(ProgramResource{ name, kind, type, location, size });
+}
+
+void ReflectProgram(Program& program)
+{
+    program.resources.clear();
+    program.resourceByName.clear();
+    program.vertexInputLayout.attributes.clear();
+
+    GLint maxNameLength = 0;
+    GLint count = 0;
+    std::vector<char> name;
+
+    // Uniforms inside blocks have no location, they are reached through their block
+    glGetProgramInterfaceiv(program.handle, GL_UNIFORM, GL_MAX_NAME_LENGTH, &maxNameLength);
+    glGetProgramInterfaceiv(program.handle, GL_UNIFORM, GL_ACTIVE_RESOURCES, &count);
+    name.resize(maxNameLength + 1);
+    for (GLint i = 0; i < count; ++i)
+    {
+        const GLenum properties[] = { GL_TYPE, GL_LOCATION, GL_ARRAY_SIZE, GL_BLOCK_INDEX };
+        GLint values[ARRAY_COUNT(properties)];
+        glGetProgramResourceiv(program.handle, GL_UNIFORM, i, ARRAY_COUNT(properties), properties, ARRAY_COUNT(values), NULL, values);
+        if (values[3] != -1)
+            continue;
+
+        glGetProgramResourceName(program.handle, GL_UNIFORM, i, (GLsizei)name.size(), NULL, name.data());
+        ProgramResourceKind kind = IsSamplerType(values[0]) ? ProgramResource_Sampler : ProgramResource_Uniform;
+        AddResource(program, kind, name.data(), values[0], values[1], values[2]);
+    }
+
+    glGetProgramInterfaceiv(program.handle, GL_UNIFORM_BLOCK, GL_MAX_NAME_LENGTH, &maxNameLength);
+    glGetProgramInterfaceiv(program.handle, GL_UNIFORM_BLOCK, GL_ACTIVE_RESOURCES, &count);
+    name.resize(maxNameLength + 1);
+    for (GLint i = 0; i < count; ++i)
+    {
+        const GLenum properties[] = { GL_BUFFER_BINDING, GL_BUFFER_DATA_SIZE };
+        GLint values[ARRAY_COUNT(properties)];
+        glGetProgramResourceiv(program.handle, GL_UNIFORM_BLOCK, i, ARRAY_COUNT(properties), properties, ARRAY_COUNT(values), NULL, values);
+        glGetProgramResourceName(program.handle, GL_UNIFORM_BLOCK, i, (GLsizei)name.size(), NULL, name.data());
+        AddResource(program, ProgramResource_UniformBlock, name.data(), GL_UNIFORM_BLOCK, values[0], values[1]);
+    }
+
+    // Built in inputs such as gl_VertexID have no location and are not vertex attributes
+    glGetProgramInterfaceiv(program.handle, GL_PROGRAM_INPUT, GL_MAX_NAME_LENGTH, &maxNameLength);
+    glGetProgramInterfaceiv(program.handle, GL_PROGRAM_INPUT, GL_ACTIVE_RESOURCES, &count);
+    name.resize(maxNameLength + 1);
+    for (GLint i = 0; i < count; ++i)
+    {
+        const GLenum properties[] = { GL_TYPE, GL_LOCATION, GL_ARRAY_SIZE };
+        GLint values[ARRAY_COUNT(properties)];
+        glGetProgramResourceiv(program.handle, GL_PROGRAM_INPUT, i, ARRAY_COUNT(properties), properties, ARRAY_COUNT(values), NULL, values);
+        if (values[1] == -1)
+            continue;
+
+        glGetProgramResourceName(program.handle, GL_PROGRAM_INPUT, i, (GLsizei)name.size(), NULL, name.data());
+        AddResource(program, ProgramResource_Input, name.data(), values[0], values[1], values[2]);
+        for (u32 column = 0; column < GetLocationCount(values[0]); ++column)
+            program.vertexInputLayout.attributes.push_back({ (u8)(values[1] + column), GetComponentCount(values[0]) });
+    }
+
+    for (u32 i = 0; i < ProgramUniform_Count; ++i)
+    {
+        const ProgramUniformInfo& info = programUniforms[i];
+        const ProgramResource* resource = FindProgramResource(program, ProgramResource_Uniform, info.name);
+        program.uniformLocations[i] = -1;
+        if (!resource)
+            continue;
+
+        if (resource->type != info.type)
+        {
+            ELOG("Uniform %s of program %s has type 0x%x, expected 0x%x", info.name, program.programName.c_str(), resource->type, info.type);
+            continue;
+        }
+        program.uniformLocations[i] = resource->location;
+    }
+}
+
+const ProgramResource* FindProgramResource(const Program& program, ProgramResourceKind kind, const char* name)
+{
+    auto it = program.resourceByName.find(HashResourceName(kind, name));
+    if (it == program.resourceByName.end())
+        return NULL;
+
+    // a hash collision would hand out the wrong location
+    const ProgramResource& resource = program.resources[it->second];
+    return resource.kind == kind && resource.name == name ? &resource : NULL;
+}
+
+GLint GetProgramResourceLocation(const Program& program, ProgramResourceKind kind, const char* name)
+{
+    const ProgramResource* resource = FindProgramResource(program, kind, name);
+    return resource ? resource->location : -1;
+}
@@ -0,0 +1,29 @@
+//
+// programreflection.h: Interface query of linked programs. Every active uniform, sampler,
+// uniform block and vertex input is read once with glGetProgramResource* and kept in a
+// flat table on the Program, so nothing queries the driver by name while rendering.
+//
+// The uniforms listed in ProgramUniform are resolved into Program::uniformLocations with
+// the type the renderer sets them with, a uniform declared with another type is reported
+// and left at -1, which glUniform* ignores just like a uniform the program does not use.
+//
+
+#pragma once
+#include "engine.h"
+
+/**
+ * Fills resources, resourceByName, uniformLocations and vertexInputLayout.
+ */
+void ReflectProgram(Program& program);
+
+const ProgramResource* FindProgramResource(const Program& program, ProgramResourceKind kind, const char* name);
+
+/**
+ * Location of a uniform or sampler, binding point of a uniform block, -1 when inactive.
+ */
+GLint GetProgramResourceLocation(const Program& program, ProgramResourceKind kind, const char* name);
+
+inline GLint GetProgramUniform(const Program& program, ProgramUniform uniform)
+{
+    return program.uniformLocations[uniform];
+}
@@ -0,0 +1,88 @@
+//
+// renderqueue.cpp : Sort keys and radix sort of the render queue (see renderqueue.h).
+//
+
+#include "renderqueue.h"
+
+#define SORT_KEY_DEPTH_SHIFT    0
+#define SORT_KEY_MESH_SHIFT     (SORT_KEY_DEPTH_SHIFT + SORT_KEY_DEPTH_BITS)
+#define SORT_KEY_MATERIAL_SHIFT (SORT_KEY_MESH_SHIFT + SORT_KEY_MESH_BITS)
+#define SORT_KEY_PROGRAM_SHIFT  (SORT_KEY_MATERIAL_SHIFT + SORT_KEY_MATERIAL_BITS)
+#define SORT_KEY_PASS_SHIFT     (SORT_KEY_PROGRAM_SHIFT + SORT_KEY_PROGRAM_BITS)
+
+static_assert(SORT_KEY_PASS_SHIFT + SORT_KEY_PASS_BITS == 64, "Sort key fields must fill 64 bits");
+
+static u64 PackField(u32 value, u32 bits, u32 shift)
+{
+    return ((u64)value & ((1ull << bits) - 1)) << shift;
+}
+
+u64 MakeSortKey(RenderPass pass, u32 programIdx, u32 materialIdx, u32 meshIdx, f32 depth)
+{
+    const u32 maxDepth = (1u << SORT_KEY_DEPTH_BITS) - 1;
+    u32 quantizedDepth = (u32)(glm::clamp(depth, 0.0f, 1.0f) * maxDepth);
+
+    return PackField(pass, SORT_KEY_PASS_BITS, SORT_KEY_PASS_SHIFT) |
+           PackField(programIdx, SORT_KEY_PROGRAM_BITS, SORT_KEY_PROGRAM_SHIFT) |
+           PackField(materialIdx, SORT_KEY_MATERIAL_BITS, SORT_KEY_MATERIAL_SHIFT) |
+           PackField(meshIdx, SORT_KEY_MESH_BITS, SORT_KEY_MESH_SHIFT) |
+           PackField(quantizedDepth, SORT_KEY_DEPTH_BITS, SORT_KEY_DEPTH_SHIFT);
+}
+
+void ClearRenderQueue(RenderQueue& queue)
+{
+    queue.items.clear();
+}
+
+void PushRenderItem(RenderQueue& queue, u64 key, u32 objectIdx, u32 submeshIdx)
+{
+    queue.items.push_back(RenderItem{ key, objectIdx, submeshIdx });
+}
+
+void SortRenderQueue(RenderQueue& queue)
+{
+    const u32 itemCount = (u32)queue.items.size();
+    if (itemCount < 2)
+        return;
+
+    queue.sortBuffer.resize(itemCount);
+    RenderItem* source = queue.items.data();
+    RenderItem* destination = queue.sortBuffer.data();
+
+    // All the histograms in a single pass over the keys
+    u32 histograms[8][256] = {};
+    for (u32 i = 0; i < itemCount; ++i)
+    {
+        u64 key = source[i].key;
+        for (u32 digit = 0; digit < 8; ++digit)
+            histograms[digit][(key >> (digit * 8)) & 0xff]++;
+    }
+
+    for (u32 digit = 0; digit < 8; ++digit)
+    {
+        u32* histogram = histograms[digit];
+        u32 shift = digit * 8;
+
+        // Every key has the same value here, the order would not change
+        if (histogram[(source[0].key >> shift) & 0xff] == itemCount)
+            continue;
+
+        u32 offset = 0;
+        for (u32 bucket = 0; bucket < 256; ++bucket)
+        {
+            u32 count = histogram[bucket];
+            histogram[bucket] = offset;
+            offset += count;
+        }
+
+        for (u32 i = 0; i < itemCount; ++i)
+            destination[histogram[(source[i].key >> shift) & 0xff]++] = source[i];
+
+        RenderItem* swap = source;
+        source = destination;
+        destination = swap;
+    }
+
+    if (source != queue.items.data())
+        queue.items.swap(queue.sortBuffer);
+}
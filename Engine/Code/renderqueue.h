@@ -0,0 +1,40 @@
+//
+// renderqueue.h: Visible submeshes are pushed as render items with a packed 64 bit key and
+// radix sorted, so draws sharing a program, a material or a mesh end up next to each other
+// and the state they need is only set once. From the most to the least significant bits:
+//
+//   pass (4) | program (8) | material (16) | mesh (16) | depth (20)
+//
+// Depth is the distance to the camera over the far plane, front to back so the depth
+// test rejects as much as possible inside a batch.
+//
+
+#pragma once
+#include "engine.h"
+
+#define SORT_KEY_PASS_BITS     4
+#define SORT_KEY_PROGRAM_BITS  8
+#define SORT_KEY_MATERIAL_BITS 16
+#define SORT_KEY_MESH_BITS     16
+#define SORT_KEY_DEPTH_BITS    20
+
+enum RenderPass
+{
+    RenderPass_GBuffer,
+    RenderPass_Count
+};
+
+/**
+ * depth is expected in [0, 1], indices that do not fit in their field are wrapped, which
+ * only costs some state changes.
+ */
+u64 MakeSortKey(RenderPass pass, u32 programIdx, u32 materialIdx, u32 meshIdx, f32 depth);
+
+void ClearRenderQueue(RenderQueue& queue);
+
+void PushRenderItem(RenderQueue& queue, u64 key, u32 objectIdx, u32 submeshIdx);
+
+/**
+ * Stable LSD radix sort on 8 bit digits, digits shared by every key are skipped.
+ */
+void SortRenderQueue(RenderQueue& queue);
@@ -0,0 +1,431 @@
+//
+// scenebvh.cpp : Bounding volume hierarchy over the scene objects (see scenebvh.h).
+//
+
+#include "scenebvh.h"
+#include <algorithm>
+
+#define BVH_INSIDE_BIT 0x80000000u // on the traversal stack, every object below is inside
+
+static f32 SurfaceArea(vec3 boundsMin, vec3 boundsMax)
+{
+    vec3 size = glm::max(boundsMax - boundsMin, vec3(0.0f));
+    return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+// Union of the world boxes of the submeshes, objects without geometry are a point
+static void ComputeObjectBounds(App* app, u32 objectIdx)
+{
+    const CullingScene& scene = app->cullingScene;
+    SceneBvh& bvh = app->sceneBvh;
+
+    const u32 firstEntry = scene.firstEntry[objectIdx];
+    const u32 endEntry = objectIdx + 1 < scene.firstEntry.size() ? scene.firstEntry[objectIdx + 1] : scene.entryCount;
+    if (firstEntry == endEntry)
+    {
+        bvh.objectMin[objectIdx] = bvh.objectMax[objectIdx] = vec3(app->sceneObjects[objectIdx]->modelMat[3]);
+        return;
+    }
+
+    vec3 boundsMin = vec3(FLT_MAX);
+    vec3 boundsMax = vec3(-FLT_MAX);
+    for (u32 i = firstEntry; i < endEntry; ++i)
+    {
+        vec3 center = vec3(scene.centerX[i], scene.centerY[i], scene.centerZ[i]);
+        vec3 extent = vec3(scene.extentX[i], scene.extentY[i], scene.extentZ[i]);
+        boundsMin = glm::min(boundsMin, center - extent);
+        boundsMax = glm::max(boundsMax, center + extent);
+    }
+    bvh.objectMin[objectIdx] = boundsMin;
+    bvh.objectMax[objectIdx] = boundsMax;
+}
+
+static void ComputeNodeBounds(SceneBvh& bvh, u32 nodeIdx)
+{
+    BvhNode& node = bvh.nodes[nodeIdx];
+    if (node.objectCount == 0)
+    {
+        const BvhNode& left = bvh.nodes[node.first];
+        const BvhNode& right = bvh.nodes[node.first + 1];
+        node.boundsMin = glm::min(left.boundsMin, right.boundsMin);
+        node.boundsMax = glm::max(left.boundsMax, right.boundsMax);
+        return;
+    }
+
+    node.boundsMin = vec3(FLT_MAX);
+    node.boundsMax = vec3(-FLT_MAX);
+    for (u32 i = node.first; i < node.first + node.objectCount; ++i)
+    {
+        node.boundsMin = glm::min(node.boundsMin, bvh.objectMin[bvh.objects[i]]);
+        node.boundsMax = glm::max(node.boundsMax, bvh.objectMax[bvh.objects[i]]);
+    }
+}
+
+static vec3 GetObjectCentroid(const SceneBvh& bvh, u32 objectIdx)
+{
+    return (bvh.objectMin[objectIdx] + bvh.objectMax[objectIdx]) * 0.5f;
+}
+
+struct SahBin
+{
+    vec3 boundsMin = vec3(FLT_MAX);
+    vec3 boundsMax = vec3(-FLT_MAX);
+    u32  count = 0;
+};
+
+// Number of objects of the node that go to the left child, after reordering them
+static u32 PartitionNode(SceneBvh& bvh, const BvhNode& node, u32 depth)
+{
+    u32* objects = &bvh.objects[node.first];
+    const u32 count = node.objectCount;
+
+    vec3 centroidMin = vec3(FLT_MAX);
+    vec3 centroidMax = vec3(-FLT_MAX);
+    for (u32 i = 0; i < count; ++i)
+    {
+        vec3 centroid = GetObjectCentroid(bvh, objects[i]);
+        centroidMin = glm::min(centroidMin, centroid);
+        centroidMax = glm::max(centroidMax, centroid);
+    }
+
+    vec3 centroidExtent = centroidMax - centroidMin;
+    u32 axis = 0;
+    if (centroidExtent.y > centroidExtent[axis]) axis = 1;
+    if (centroidExtent.z > centroidExtent[axis]) axis = 2;
+
+    // Deep trees fall back to median splits, which bounds the depth of the traversals
+    if (centroidExtent[axis] <= 0.0f)
+        return count / 2;
+    if (depth >= BVH_MAX_DEPTH / 2)
+    {
+        std::nth_element(objects, objects + count / 2, objects + count, [&bvh, axis](u32 a, u32 b) {
+            return GetObjectCentroid(bvh, a)[axis] < GetObjectCentroid(bvh, b)[axis]; });
+        return count / 2;
+    }
+
+    const f32 binScale = BVH_SAH_BINS / centroidExtent[axis];
+    auto getBin = [&bvh, axis, binScale, centroidMin](u32 objectIdx) {
+        return glm::min((u32)((GetObjectCentroid(bvh, objectIdx)[axis] - centroidMin[axis]) * binScale), (u32)BVH_SAH_BINS - 1); };
+
+    SahBin bins[BVH_SAH_BINS];
+    for (u32 i = 0; i < count; ++i)
+    {
+        SahBin& bin = bins[getBin(objects[i])];
+        bin.boundsMin = glm::min(bin.boundsMin, bvh.objectMin[objects[i]]);
+        bin.boundsMax = glm::max(bin.boundsMax, bvh.objectMax[objects[i]]);
+        bin.count++;
+    }
+
+    // Cost of every split plane, the left side swept forwards and the right one backwards
+    f32 rightCosts[BVH_SAH_BINS];
+    SahBin right;
+    for (u32 b = BVH_SAH_BINS - 1; b > 0; --b)
+    {
+        right.boundsMin = glm::min(right.boundsMin, bins[b].boundsMin);
+        right.boundsMax = glm::max(right.boundsMax, bins[b].boundsMax);
+        right.count += bins[b].count;
+        rightCosts[b] = right.count > 0 ? SurfaceArea(right.boundsMin, right.boundsMax) * right.count : 0.0f;
+    }
+
+    u32 bestBin = 0;
+    f32 bestCost = FLT_MAX;
+    SahBin left;
+    for (u32 b = 0; b + 1 < BVH_SAH_BINS; ++b)
+    {
+        left.boundsMin = glm::min(left.boundsMin, bins[b].boundsMin);
+        left.boundsMax = glm::max(left.boundsMax, bins[b].boundsMax);
+        left.count += bins[b].count;
+        if (left.count == 0 || left.count == count)
+            continue;
+        f32 cost = SurfaceArea(left.boundsMin, left.boundsMax) * left.count + rightCosts[b + 1];
+        if (cost < bestCost)
+        {
+            bestCost = cost;
+            bestBin = b;
+        }
+    }
+
+    u32* middle = std::partition(objects, objects + count, [&getBin, bestBin](u32 objectIdx) { return getBin(objectIdx) <= bestBin; });
+    return (u32)(middle - objects);
+}
+
+static void SubdivideNode(SceneBvh& bvh, u32 nodeIdx, u32 depth)
+{
+    ComputeNodeBounds(bvh, nodeIdx);
+
+    const BvhNode node = bvh.nodes[nodeIdx];
+    if (node.objectCount <= BVH_MAX_LEAF_OBJECTS)
+    {
+        for (u32 i = node.first; i < node.first + node.objectCount; ++i)
+            bvh.objectLeaves[bvh.objects[i]] = nodeIdx;
+        return;
+    }
+
+    u32 leftCount = PartitionNode(bvh, node, depth);
+    u32 leftIdx = (u32)bvh.nodes.size();
+    bvh.nodes.push_back(BvhNode{ vec3(0.0f), node.first, vec3(0.0f), leftCount });
+    bvh.nodes.push_back(BvhNode{ vec3(0.0f), node.first + leftCount, vec3(0.0f), node.objectCount - leftCount });
+    bvh.parents.push_back(nodeIdx);
+    bvh.parents.push_back(nodeIdx);
+    bvh.nodes[nodeIdx].first = leftIdx;
+    bvh.nodes[nodeIdx].objectCount = 0;
+
+    SubdivideNode(bvh, leftIdx, depth + 1);
+    SubdivideNode(bvh, leftIdx + 1, depth + 1);
+}
+
+// Expected cost of a query relative to testing the root, inner nodes cost one box test
+static f32 ComputeBvhCost(const SceneBvh& bvh)
+{
+    if (bvh.nodes.empty())
+        return 0.0f;
+
+    f32 cost = 0.0f;
+    for (u32 i = 0; i < bvh.nodes.size(); ++i)
+    {
+        const BvhNode& node = bvh.nodes[i];
+        cost += SurfaceArea(node.boundsMin, node.boundsMax) * (node.objectCount == 0 ? 1.0f : (f32)node.objectCount);
+    }
+    f32 rootArea = SurfaceArea(bvh.nodes[0].boundsMin, bvh.nodes[0].boundsMax);
+    return rootArea > 0.0f ? cost / rootArea : 0.0f;
+}
+
+static void BuildSceneBvh(SceneBvh& bvh)
+{
+    const u32 objectCount = (u32)bvh.objectMin.size();
+    bvh.nodes.clear();
+    bvh.parents.clear();
+    bvh.objects.resize(objectCount);
+    bvh.objectLeaves.resize(objectCount);
+    for (u32 i = 0; i < objectCount; ++i)
+        bvh.objects[i] = i;
+
+    if (objectCount > 0)
+    {
+        bvh.nodes.reserve(2 * objectCount);
+        bvh.parents.reserve(2 * objectCount);
+        bvh.nodes.push_back(BvhNode{ vec3(0.0f), 0, vec3(0.0f), objectCount });
+        bvh.parents.push_back(UINT32_MAX);
+        SubdivideNode(bvh, 0, 0);
+    }
+
+    bvh.buildCost = bvh.cost = ComputeBvhCost(bvh);
+    bvh.builds++;
+}
+
+void UpdateSceneBvh(App* app)
+{
+    const CullingScene& scene = app->cullingScene;
+    SceneBvh& bvh = app->sceneBvh;
+    const u32 objectCount = (u32)app->sceneObjects.size();
+
+    if (bvh.layoutVersion != scene.layoutVersion || bvh.objectMin.size() != objectCount)
+    {
+        bvh.objectMin.resize(objectCount);
+        bvh.objectMax.resize(objectCount);
+        for (u32 a = 0; a < objectCount; ++a)
+            ComputeObjectBounds(app, a);
+        BuildSceneBvh(bvh);
+        bvh.layoutVersion = scene.layoutVersion;
+        return;
+    }
+
+    if (scene.movedObjects.empty())
+        return;
+
+    // From each moved leaf up, until a node whose bounds did not change
+    for (u32 i = 0; i < scene.movedObjects.size(); ++i)
+    {
+        u32 objectIdx = scene.movedObjects[i];
+        ComputeObjectBounds(app, objectIdx);
+        for (u32 nodeIdx = bvh.objectLeaves[objectIdx]; nodeIdx != UINT32_MAX; nodeIdx = bvh.parents[nodeIdx])
+        {
+            BvhNode& node = bvh.nodes[nodeIdx];
+            vec3 previousMin = node.boundsMin;
+            vec3 previousMax = node.boundsMax;
+            ComputeNodeBounds(bvh, nodeIdx);
+            if (node.boundsMin == previousMin && node.boundsMax == previousMax)
+                break;
+        }
+    }
+    bvh.refits++;
+
+    bvh.cost = ComputeBvhCost(bvh);
+    if (bvh.cost > bvh.buildCost * BVH_REBUILD_COST_RATIO)
+        BuildSceneBvh(bvh);
+}
+
+// Appends the objects of the leaves that pass the overlap test of their boxes
+template <typename Overlaps>
+static void QueryBvh(const SceneBvh& bvh, Overlaps overlaps, std::vector<u32>& objects)
+{
+    if (bvh.nodes.empty())
+        return;
+
+    u32 stack[BVH_MAX_DEPTH];
+    u32 stackSize = 0;
+    stack[stackSize++] = 0;
+    while (stackSize > 0)
+    {
+        const BvhNode& node = bvh.nodes[stack[--stackSize]];
+        if (!overlaps(node.boundsMin, node.boundsMax))
+            continue;
+
+        if (node.objectCount > 0)
+        {
+            for (u32 i = node.first; i < node.first + node.objectCount; ++i)
+                if (overlaps(bvh.objectMin[bvh.objects[i]], bvh.objectMax[bvh.objects[i]]))
+                    objects.push_back(bvh.objects[i]);
+            continue;
+        }
+
+        ASSERT(stackSize + 2 <= BVH_MAX_DEPTH, "The scene BVH is deeper than BVH_MAX_DEPTH");
+        stack[stackSize++] = node.first + 1;
+        stack[stackSize++] = node.first;
+    }
+}
+
+void QueryBvhSphere(const SceneBvh& bvh, vec3 center, f32 radius, std::vector<u32>& objects)
+{
+    QueryBvh(bvh, [center, radius](vec3 boundsMin, vec3 boundsMax) {
+        vec3 offset = glm::clamp(center, boundsMin, boundsMax) - center;
+        return glm::dot(offset, offset) <= radius * radius; }, objects);
+}
+
+void QueryBvhBox(const SceneBvh& bvh, vec3 queryMin, vec3 queryMax, std::vector<u32>& objects)
+{
+    QueryBvh(bvh, [queryMin, queryMax](vec3 boundsMin, vec3 boundsMax) {
+        return glm::all(glm::lessThanEqual(boundsMin, queryMax)) && glm::all(glm::lessThanEqual(queryMin, boundsMax)); }, objects);
+}
+
+enum FrustumOverlap
+{
+    FrustumOverlap_Outside,
+    FrustumOverlap_Intersecting,
+    FrustumOverlap_Inside
+};
+
+static FrustumOverlap TestBoxInFrustum(const Frustum& frustum, vec3 boundsMin, vec3 boundsMax)
+{
+    vec3 center = (boundsMin + boundsMax) * 0.5f;
+    vec3 extent = (boundsMax - boundsMin) * 0.5f;
+    FrustumOverlap overlap = FrustumOverlap_Inside;
+    for (u32 i = 0; i < FrustumPlane_Count; ++i)
+    {
+        const vec4& plane = frustum.planes[i];
+        f32 distance = glm::dot(vec3(plane), center) + plane.w;
+        f32 radius = glm::dot(glm::abs(vec3(plane)), extent);
+        if (distance < -radius)
+            return FrustumOverlap_Outside;
+        if (distance < radius)
+            overlap = FrustumOverlap_Intersecting;
+    }
+    return overlap;
+}
+
+void QueryBvhFrustum(const SceneBvh& bvh, const Frustum& frustum, std::vector<u32>& objects)
+{
+    if (bvh.nodes.empty())
+        return;
+
+    // Below a node that is entirely inside there is nothing left to test
+    u32 stack[BVH_MAX_DEPTH];
+    u32 stackSize = 0;
+    stack[stackSize++] = 0;
+    while (stackSize > 0)
+    {
+        u32 entry = stack[--stackSize];
+        const BvhNode& node = bvh.nodes[entry & ~BVH_INSIDE_BIT];
+        u32 inside = entry & BVH_INSIDE_BIT;
+        if (!inside)
+        {
+            FrustumOverlap overlap = TestBoxInFrustum(frustum, node.boundsMin, node.boundsMax);
+            if (overlap == FrustumOverlap_Outside)
+                continue;
+            if (overlap == FrustumOverlap_Inside)
+                inside = BVH_INSIDE_BIT;
+        }
+
+        if (node.objectCount > 0)
+        {
+            for (u32 i = node.first; i < node.first + node.objectCount; ++i)
+            {
+                u32 objectIdx = bvh.objects[i];
+                if (inside || TestBoxInFrustum(frustum, bvh.objectMin[objectIdx], bvh.objectMax[objectIdx]) != FrustumOverlap_Outside)
+                    objects.push_back(objectIdx);
+            }
+            continue;
+        }
+
+        ASSERT(stackSize + 2 <= BVH_MAX_DEPTH, "The scene BVH is deeper than BVH_MAX_DEPTH");
+        stack[stackSize++] = (node.first + 1) | inside;
+        stack[stackSize++] = node.first | inside;
+    }
+}
+
+// Entry distance of the ray into the box, FLT_MAX when it misses it within maxDistance
+static f32 IntersectRayBox(vec3 origin, vec3 inverseDirection, f32 maxDistance, vec3 boundsMin, vec3 boundsMax)
+{
+    vec3 t0 = (boundsMin - origin) * inverseDirection;
+    vec3 t1 = (boundsMax - origin) * inverseDirection;
+    vec3 tNear = glm::min(t0, t1);
+    vec3 tFar = glm::max(t0, t1);
+    f32 enter = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, 0.0f));
+    f32 exit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, maxDistance));
+    return enter <= exit ? enter : FLT_MAX;
+}
+
+bool RaycastBvh(const SceneBvh& bvh, vec3 origin, vec3 direction, f32 maxDistance, u32* objectIdx, f32* distance)
+{
+    if (bvh.nodes.empty())
+        return false;
+
+    const vec3 inverseDirection = 1.0f / direction;
+    f32 closest = maxDistance;
+    u32 closestObject = UINT32_MAX;
+
+    // Nearer child first, so most of the far subtrees fail against the closest hit
+    u32 stack[BVH_MAX_DEPTH];
+    u32 stackSize = 0;
+    if (IntersectRayBox(origin, inverseDirection, closest, bvh.nodes[0].boundsMin, bvh.nodes[0].boundsMax) != FLT_MAX)
+        stack[stackSize++] = 0;
+    while (stackSize > 0)
+    {
+        const BvhNode& node = bvh.nodes[stack[--stackSize]];
+        if (node.objectCount > 0)
+        {
+            for (u32 i = node.first; i < node.first + node.objectCount; ++i)
+            {
+                f32 t = IntersectRayBox(origin, inverseDirection, closest, bvh.objectMin[bvh.objects[i]], bvh.objectMax[bvh.objects[i]]);
+                if (t != FLT_MAX && (t < closest || closestObject == UINT32_MAX))
+                {
+                    closest = t;
+                    closestObject = bvh.objects[i];
+                }
+            }
+            continue;
+        }
+
+        u32 nearIdx = node.first;
+        u32 farIdx = node.first + 1;
+        f32 nearT = IntersectRayBox(origin, inverseDirection, closest, bvh.nodes[nearIdx].boundsMin, bvh.nodes[nearIdx].boundsMax);
+        f32 farT = IntersectRayBox(origin, inverseDirection, closest, bvh.nodes[farIdx].boundsMin, bvh.nodes[farIdx].boundsMax);
+        if (farT < nearT)
+        {
+            std::swap(nearIdx, farIdx);
+            std::swap(nearT, farT);
+        }
+
+        ASSERT(stackSize + 2 <= BVH_MAX_DEPTH, "The scene BVH is deeper than BVH_MAX_DEPTH");
+        if (farT != FLT_MAX)
+            stack[stackSize++] = farIdx;
+        if (nearT != FLT_MAX)
+            stack[stackSize++] = nearIdx;
+    }
+
+    if (closestObject == UINT32_MAX)
+        return false;
+    *objectIdx = closestObject;
+    *distance = closest;
+    return true;
+}
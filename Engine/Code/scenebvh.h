@@ -0,0 +1,50 @@
+//
+// scenebvh.h: Bounding volume hierarchy over the scene objects, so spatial queries do not
+// have to walk app->sceneObjects one by one.
+//
+// Leaves hold up to BVH_MAX_LEAF_OBJECTS objects and their world boxes, which come from the
+// submesh bounds of the CullingScene (see culling.h). The tree is built top down with a
+// binned surface area heuristic whenever objects are created or destroyed, and refitted
+// from the moved leaves up to the root when only transforms change. Refits keep the
+// topology, so once they have made the tree BVH_REBUILD_COST_RATIO times more expensive
+// than it was after the build it is built again.
+//
+// Queries only read the tree and keep their traversal stack on the stack, so any number of
+// threads can run them at once as long as no update runs at the same time.
+//
+
+#pragma once
+#include "engine.h"
+#include "culling.h"
+
+#define BVH_MAX_LEAF_OBJECTS   4
+#define BVH_SAH_BINS           12
+#define BVH_MAX_DEPTH          64
+#define BVH_REBUILD_COST_RATIO 2.0f
+
+/**
+ * Builds or refits the tree after UpdateCullingScene, depending on what changed.
+ */
+void UpdateSceneBvh(App* app);
+
+/**
+ * Appends the objects whose box intersects the frustum. Boxes near the corners of the
+ * frustum may be reported even if they are outside, like with any plane test.
+ */
+void QueryBvhFrustum(const SceneBvh& bvh, const Frustum& frustum, std::vector<u32>& objects);
+
+/**
+ * Appends the objects whose box intersects the sphere.
+ */
+void QueryBvhSphere(const SceneBvh& bvh, vec3 center, f32 radius, std::vector<u32>& objects);
+
+/**
+ * Appends the objects whose box intersects the box.
+ */
+void QueryBvhBox(const SceneBvh& bvh, vec3 boundsMin, vec3 boundsMax, std::vector<u32>& objects);
+
+/**
+ * Finds the object whose box is hit first along the ray, within maxDistance of the origin.
+ * The direction does not need to be normalized, distance is in units of its length.
+ */
+bool RaycastBvh(const SceneBvh& bvh, vec3 origin, vec3 direction, f32 maxDistance, u32* objectIdx, f32* distance);
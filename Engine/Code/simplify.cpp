@@ -0,0 +1,506 @@
+//
+// simplify.cpp : Quadric error metric simplification and LOD selection (see simplify.h).
+//
+// The simplifier works in passes. Every pass classifies the vertices, sorts all the edge
+// collapses allowed by that classification by their quadric error and performs the
+// cheapest ones that do not touch each other and do not flip any triangle.
+//
+
+#include "simplify.h"
+#include <unordered_map>
+#include <algorithm>
+
+#define LOD_HYSTERESIS 0.75f  // a coarser LOD is taken once its error is below this fraction of the threshold
+#define BORDER_WEIGHT  10.0f  // how hard borders and seams resist moving away from their edges
+
+enum VertexKind
+{
+    VertexKind_Manifold, // moves freely
+    VertexKind_Border,   // on an open border, only moves along it
+    VertexKind_Seam,     // on an attribute seam, only moves along it
+    VertexKind_Locked    // corners, non manifold geometry... never moves
+};
+
+// Symmetric 4x4 matrix of the sum of squared distances to a set of planes
+struct Quadric
+{
+    f32 a00, a11, a22, a01, a02, a12;
+    f32 b0, b1, b2;
+    f32 c;
+    f32 weight;
+};
+
+struct EdgeInfo
+{
+    u32  triangleCount;
+    u32  corners[2][2]; // original vertices of the lower and higher welded vertex, per triangle
+    bool seam;
+};
+
+struct Collapse
+{
+    u32 from;        // welded vertices
+    u32 to;
+    u32 wedgeFrom[2]; // original vertices remapped by the collapse, one per side of a seam
+    u32 wedgeTo[2];
+    u32 wedgeCount;
+    f32 cost;
+};
+
+struct Simplifier
+{
+    std::vector<vec3>    positions; // per welded vertex
+    std::vector<u32>     weld;      // original vertex -> welded vertex
+    std::vector<Quadric> quadrics;  // per welded vertex
+    std::vector<u32>     indices;   // current triangles, original vertices
+    f32                  error;     // largest collapse cost so far
+};
+
+static void AddPlaneQuadric(Quadric& q, vec3 n, f32 d, f32 weight)
+{
+    q.a00 += weight * n.x * n.x;
+    q.a11 += weight * n.y * n.y;
+    q.a22 += weight * n.z * n.z;
+    q.a01 += weight * n.x * n.y;
+    q.a02 += weight * n.x * n.z;
+    q.a12 += weight * n.y * n.z;
+    q.b0 += weight * n.x * d;
+    q.b1 += weight * n.y * d;
+    q.b2 += weight * n.z * d;
+    q.c += weight * d * d;
+    q.weight += weight;
+}
+
+static void AddQuadric(Quadric& q, const Quadric& other)
+{
+    q.a00 += other.a00; q.a11 += other.a11; q.a22 += other.a22;
+    q.a01 += other.a01; q.a02 += other.a02; q.a12 += other.a12;
+    q.b0 += other.b0; q.b1 += other.b1; q.b2 += other.b2;
+    q.c += other.c;
+    q.weight += other.weight;
+}
+
+// Weighted mean of the squared distances from p to the planes of the quadric
+static f32 EvaluateQuadric(const Quadric& q, vec3 p)
+{
+    f32 result = q.a00 * p.x * p.x + q.a11 * p.y * p.y + q.a22 * p.z * p.z +
+                 2.0f * (q.a01 * p.x * p.y + q.a02 * p.x * p.z + q.a12 * p.y * p.z) +
+                 2.0f * (q.b0 * p.x + q.b1 * p.y + q.b2 * p.z) + q.c;
+    return q.weight > 0.0f ? fabsf(result) / q.weight : 0.0f;
+}
+
+static u64 EdgeKey(u32 a, u32 b)
+{
+    return a < b ? ((u64)a << 32) | b : ((u64)b << 32) | a;
+}
+
+static void BuildEdges(const Simplifier& s, std::unordered_map<u64, EdgeInfo>& edges)
+{
+    edges.clear();
+    for (u32 i = 0; i < s.indices.size(); i += 3)
+    {
+        for (u32 e = 0; e < 3; ++e)
+        {
+            u32 a = s.indices[i + e];
+            u32 b = s.indices[i + (e + 1) % 3];
+            u32 weldA = s.weld[a];
+            u32 weldB = s.weld[b];
+            if (weldA == weldB)
+                continue;
+
+            EdgeInfo& edge = edges[EdgeKey(weldA, weldB)];
+            u32 lowCorner = weldA < weldB ? a : b;
+            u32 highCorner = weldA < weldB ? b : a;
+            if (edge.triangleCount < 2)
+            {
+                edge.corners[edge.triangleCount][0] = lowCorner;
+                edge.corners[edge.triangleCount][1] = highCorner;
+            }
+            if (edge.triangleCount == 1 && (edge.corners[0][0] != lowCorner || edge.corners[0][1] != highCorner))
+                edge.seam = true;
+            edge.triangleCount++;
+        }
+    }
+}
+
+static void ClassifyVertices(const Simplifier& s, const std::unordered_map<u64, EdgeInfo>& edges, std::vector<u8>& kinds)
+{
+    const u32 vertexCount = (u32)s.positions.size();
+    std::vector<u32> openEdges(vertexCount, 0);
+    std::vector<u32> seamEdges(vertexCount, 0);
+    std::vector<bool> locked(vertexCount, false);
+
+    for (std::unordered_map<u64, EdgeInfo>::const_iterator it = edges.begin(); it != edges.end(); ++it)
+    {
+        u32 a = (u32)(it->first >> 32);
+        u32 b = (u32)(it->first & 0xFFFFFFFF);
+        const EdgeInfo& edge = it->second;
+        if (edge.triangleCount > 2)
+        {
+            locked[a] = locked[b] = true;
+        }
+        else if (edge.triangleCount == 1)
+        {
+            openEdges[a]++;
+            openEdges[b]++;
+        }
+        else if (edge.seam)
+        {
+            seamEdges[a]++;
+            seamEdges[b]++;
+        }
+    }
+
+    // Original vertices (wedges) in use for every welded vertex, up to three
+    std::vector<u32> firstWedge(vertexCount, UINT32_MAX);
+    std::vector<u32> secondWedge(vertexCount, UINT32_MAX);
+    std::vector<u32> wedgeCount(vertexCount, 0);
+    for (u32 i = 0; i < s.indices.size(); ++i)
+    {
+        u32 vertex = s.indices[i];
+        u32 welded = s.weld[vertex];
+        if (firstWedge[welded] == UINT32_MAX)
+        {
+            firstWedge[welded] = vertex;
+            wedgeCount[welded] = 1;
+        }
+        else if (vertex != firstWedge[welded] && secondWedge[welded] == UINT32_MAX)
+        {
+            secondWedge[welded] = vertex;
+            wedgeCount[welded] = 2;
+        }
+        else if (vertex != firstWedge[welded] && vertex != secondWedge[welded])
+        {
+            wedgeCount[welded] = 3;
+        }
+    }
+
+    kinds.resize(vertexCount);
+    for (u32 v = 0; v < vertexCount; ++v)
+    {
+        if (locked[v])
+            kinds[v] = VertexKind_Locked;
+        else if (openEdges[v] == 0 && seamEdges[v] == 0 && wedgeCount[v] == 1)
+            kinds[v] = VertexKind_Manifold;
+        else if (openEdges[v] == 2 && seamEdges[v] == 0 && wedgeCount[v] == 1)
+            kinds[v] = VertexKind_Border;
+        else if (seamEdges[v] == 2 && openEdges[v] == 0 && wedgeCount[v] == 2)
+            kinds[v] = VertexKind_Seam;
+        else
+            kinds[v] = VertexKind_Locked;
+    }
+}
+
+static void ComputeQuadrics(Simplifier& s)
+{
+    std::unordered_map<u64, EdgeInfo> edges;
+    BuildEdges(s, edges);
+
+    s.quadrics.assign(s.positions.size(), Quadric{});
+    for (u32 i = 0; i < s.indices.size(); i += 3)
+    {
+        u32 welded[3] = { s.weld[s.indices[i]], s.weld[s.indices[i + 1]], s.weld[s.indices[i + 2]] };
+        vec3 p0 = s.positions[welded[0]];
+        vec3 p1 = s.positions[welded[1]];
+        vec3 p2 = s.positions[welded[2]];
+
+        vec3 normal = glm::cross(p1 - p0, p2 - p0);
+        f32 doubleArea = glm::length(normal);
+        if (doubleArea == 0.0f)
+            continue;
+        normal /= doubleArea;
+
+        f32 d = -glm::dot(normal, p0);
+        for (u32 k = 0; k < 3; ++k)
+            AddPlaneQuadric(s.quadrics[welded[k]], normal, d, doubleArea * 0.5f);
+
+        // Borders and seams get a plane through the edge, perpendicular to the triangle,
+        // so moving their vertices away from the edge is expensive
+        for (u32 e = 0; e < 3; ++e)
+        {
+            u32 a = welded[e];
+            u32 b = welded[(e + 1) % 3];
+            if (a == b)
+                continue;
+
+            const EdgeInfo& edge = edges[EdgeKey(a, b)];
+            if (edge.triangleCount != 1 && !edge.seam)
+                continue;
+
+            vec3 edgeVector = s.positions[b] - s.positions[a];
+            vec3 edgeNormal = glm::cross(edgeVector, normal);
+            f32 length = glm::length(edgeNormal);
+            if (length == 0.0f)
+                continue;
+            edgeNormal /= length;
+
+            f32 edgeD = -glm::dot(edgeNormal, s.positions[a]);
+            f32 weight = glm::dot(edgeVector, edgeVector) * BORDER_WEIGHT;
+            AddPlaneQuadric(s.quadrics[a], edgeNormal, edgeD, weight);
+            AddPlaneQuadric(s.quadrics[b], edgeNormal, edgeD, weight);
+        }
+    }
+}
+
+static bool TryMakeCollapse(const Simplifier& s, const std::vector<u8>& kinds, const EdgeInfo& edge, u32 from, u32 to, Collapse& collapse)
+{
+    // corners[t][0] belongs to the lower welded vertex of the edge
+    const u32 fromCorner = from < to ? 0 : 1;
+    const u32 toCorner = 1 - fromCorner;
+
+    switch (kinds[from])
+    {
+        case VertexKind_Manifold:
+            collapse.wedgeCount = 1;
+            break;
+        case VertexKind_Border:
+            if (edge.triangleCount != 1)
+                return false;
+            collapse.wedgeCount = 1;
+            break;
+        case VertexKind_Seam:
+            if (!edge.seam)
+                return false;
+            collapse.wedgeCount = 2;
+            break;
+        default:
+            return false;
+    }
+
+    collapse.from = from;
+    collapse.to = to;
+    for (u32 k = 0; k < collapse.wedgeCount; ++k)
+    {
+        collapse.wedgeFrom[k] = edge.corners[k][fromCorner];
+        collapse.wedgeTo[k] = edge.corners[k][toCorner];
+    }
+
+    Quadric quadric = s.quadrics[from];
+    AddQuadric(quadric, s.quadrics[to]);
+    collapse.cost = EvaluateQuadric(quadric, s.positions[to]);
+    return true;
+}
+
+// Moving 'from' onto 'to' must not turn any of the remaining triangles around
+static bool FlipsTriangles(const Simplifier& s, const std::vector<u32>& triangleStart, const std::vector<u32>& triangles, u32 from, u32 to)
+{
+    for (u32 i = triangleStart[from]; i < triangleStart[from + 1]; ++i)
+    {
+        const u32* triangle = &s.indices[triangles[i] * 3];
+        u32 welded[3] = { s.weld[triangle[0]], s.weld[triangle[1]], s.weld[triangle[2]] };
+        if (welded[0] == to || welded[1] == to || welded[2] == to)
+            continue; // collapses into a line and goes away
+
+        vec3 before[3], after[3];
+        for (u32 k = 0; k < 3; ++k)
+        {
+            before[k] = s.positions[welded[k]];
+            after[k] = welded[k] == from ? s.positions[to] : before[k];
+        }
+
+        vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+        vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+        if (glm::dot(normalBefore, normalAfter) <= 0.0f)
+            return true;
+    }
+    return false;
+}
+
+static u32 SimplifyPass(Simplifier& s, u32 targetTriangleCount, f32 maxError)
+{
+    std::unordered_map<u64, EdgeInfo> edges;
+    BuildEdges(s, edges);
+
+    std::vector<u8> kinds;
+    ClassifyVertices(s, edges, kinds);
+
+    const u32 vertexCount = (u32)s.positions.size();
+    const u32 triangleCount = (u32)s.indices.size() / 3;
+
+    // Triangles around every welded vertex
+    std::vector<u32> triangleStart(vertexCount + 1, 0);
+    for (u32 i = 0; i < s.indices.size(); ++i)
+        triangleStart[s.weld[s.indices[i]] + 1]++;
+    for (u32 v = 0; v < vertexCount; ++v)
+        triangleStart[v + 1] += triangleStart[v];
+    std::vector<u32> triangles(s.indices.size());
+    std::vector<u32> fillCursor(triangleStart.begin(), triangleStart.end() - 1);
+    for (u32 i = 0; i < s.indices.size(); ++i)
+        triangles[fillCursor[s.weld[s.indices[i]]]++] = i / 3;
+
+    std::vector<Collapse> collapses;
+    for (std::unordered_map<u64, EdgeInfo>::const_iterator it = edges.begin(); it != edges.end(); ++it)
+    {
+        if (it->second.triangleCount > 2)
+            continue;
+
+        u32 a = (u32)(it->first >> 32);
+        u32 b = (u32)(it->first & 0xFFFFFFFF);
+        Collapse collapse;
+        if (TryMakeCollapse(s, kinds, it->second, a, b, collapse))
+            collapses.push_back(collapse);
+        if (TryMakeCollapse(s, kinds, it->second, b, a, collapse))
+            collapses.push_back(collapse);
+    }
+
+    std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+    std::vector<bool> touched(vertexCount, false);
+    std::vector<u32> remap(s.weld.size());
+    for (u32 i = 0; i < remap.size(); ++i)
+        remap[i] = i;
+
+    u32 collapseCount = 0;
+    u32 removedTriangles = 0;
+    for (u32 i = 0; i < collapses.size() && triangleCount - removedTriangles > targetTriangleCount; ++i)
+    {
+        const Collapse& collapse = collapses[i];
+        if (collapse.cost > maxError)
+            break;
+        if (touched[collapse.from] || touched[collapse.to])
+            continue;
+        if (FlipsTriangles(s, triangleStart, triangles, collapse.from, collapse.to))
+            continue;
+
+        for (u32 k = 0; k < collapse.wedgeCount; ++k)
+            remap[collapse.wedgeFrom[k]] = collapse.wedgeTo[k];
+        AddQuadric(s.quadrics[collapse.to], s.quadrics[collapse.from]);
+        s.error = glm::max(s.error, collapse.cost);
+
+        // The triangles around 'from' change, none of their vertices can move in this pass
+        for (u32 t = triangleStart[collapse.from]; t < triangleStart[collapse.from + 1]; ++t)
+            for (u32 k = 0; k < 3; ++k)
+                touched[s.weld[s.indices[triangles[t] * 3 + k]]] = true;
+
+        removedTriangles += kinds[collapse.from] == VertexKind_Border ? 1 : 2;
+        collapseCount++;
+    }
+
+    // Apply the collapses and drop the triangles that became degenerate
+    u32 writeIdx = 0;
+    for (u32 i = 0; i < s.indices.size(); i += 3)
+    {
+        u32 a = remap[s.indices[i + 0]];
+        u32 b = remap[s.indices[i + 1]];
+        u32 c = remap[s.indices[i + 2]];
+        if (s.weld[a] == s.weld[b] || s.weld[b] == s.weld[c] || s.weld[a] == s.weld[c])
+            continue;
+        s.indices[writeIdx++] = a;
+        s.indices[writeIdx++] = b;
+        s.indices[writeIdx++] = c;
+    }
+    s.indices.resize(writeIdx);
+
+    return collapseCount;
+}
+
+void BuildLods(Submesh& submesh)
+{
+    submesh.lods.clear();
+
+    const VertexBufferLayout& layout = submesh.vertexBufferLayout;
+    const u32 stride = layout.stride / sizeof(float);
+    const u32 vertexCount = stride > 0 ? (u32)submesh.vertices.size() / stride : 0;
+    const u32 baseIndexCount = (u32)submesh.indices.size();
+
+    SubmeshLod baseLod = { 0, baseIndexCount, 0.0f };
+    submesh.lods.push_back(baseLod);
+    if (vertexCount == 0 || baseIndexCount / 3 < LOD_MIN_TRIANGLES * 2)
+        return;
+
+    u32 positionOffset = 0;
+    for (u32 i = 0; i < layout.attributes.size(); ++i)
+        if (layout.attributes[i].location == 0)
+            positionOffset = layout.attributes[i].offset / sizeof(float);
+
+    // Weld the vertices that share a position
+    std::vector<u32> order(vertexCount);
+    for (u32 v = 0; v < vertexCount; ++v)
+        order[v] = v;
+
+    const float* vertices = submesh.vertices.data();
+    auto lessPosition = [vertices, stride, positionOffset](u32 a, u32 b) {
+        const float* pa = vertices + a * stride + positionOffset;
+        const float* pb = vertices + b * stride + positionOffset;
+        if (pa[0] != pb[0]) return pa[0] < pb[0];
+        if (pa[1] != pb[1]) return pa[1] < pb[1];
+        return pa[2] < pb[2];
+    };
+    std::sort(order.begin(), order.end(), lessPosition);
+
+    Simplifier s;
+    s.error = 0.0f;
+    s.weld.resize(vertexCount);
+    for (u32 i = 0; i < vertexCount; ++i)
+    {
+        if (i == 0 || lessPosition(order[i - 1], order[i]))
+        {
+            const float* p = vertices + order[i] * stride + positionOffset;
+            s.positions.push_back(vec3(p[0], p[1], p[2]));
+        }
+        s.weld[order[i]] = (u32)s.positions.size() - 1;
+    }
+
+    vec3 boundsMin = vec3(FLT_MAX);
+    vec3 boundsMax = vec3(-FLT_MAX);
+    for (u32 i = 0; i < s.positions.size(); ++i)
+    {
+        boundsMin = glm::min(boundsMin, s.positions[i]);
+        boundsMax = glm::max(boundsMax, s.positions[i]);
+    }
+    f32 maxDistance = LOD_MAX_ERROR * glm::length(boundsMax - boundsMin) * 0.5f;
+    f32 maxError = maxDistance * maxDistance;
+
+    s.indices.assign(submesh.indices.begin(), submesh.indices.end());
+    ComputeQuadrics(s);
+
+    // Every LOD continues simplifying the previous one
+    u32 triangleCount = baseIndexCount / 3;
+    while (submesh.lods.size() < SUBMESH_MAX_LODS)
+    {
+        u32 targetTriangleCount = (u32)(triangleCount * LOD_TRIANGLE_RATIO);
+        if (targetTriangleCount < LOD_MIN_TRIANGLES)
+            break;
+
+        while (s.indices.size() / 3 > targetTriangleCount)
+            if (SimplifyPass(s, targetTriangleCount, maxError) == 0)
+                break;
+
+        // Not worth another LOD if the error limit stopped it early
+        u32 newTriangleCount = (u32)s.indices.size() / 3;
+        if (newTriangleCount > triangleCount * 0.8f)
+            break;
+
+        SubmeshLod lod = { (u32)submesh.indices.size(), (u32)s.indices.size(), sqrtf(s.error) };
+        submesh.indices.insert(submesh.indices.end(), s.indices.begin(), s.indices.end());
+        submesh.lods.push_back(lod);
+        triangleCount = newTriangleCount;
+    }
+}
+
+void ComputeMeshLodErrors(Mesh& mesh)
+{
+    mesh.lodErrors.clear();
+    for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+    {
+        const Submesh& submesh = mesh.submeshes[i];
+        if (mesh.lodErrors.size() < submesh.lods.size())
+            mesh.lodErrors.resize(submesh.lods.size(), 0.0f);
+        for (u32 l = 0; l < submesh.lods.size(); ++l)
+            mesh.lodErrors[l] = glm::max(mesh.lodErrors[l], submesh.lods[l].error);
+    }
+}
+
+u32 SelectLod(const f32* lodErrors, u32 lodCount, u32 currentLod, f32 distance, f32 pixelsPerUnit, f32 pixelThreshold)
+{
+    if (lodCount == 0)
+        return 0;
+
+    f32 pixelsPerError = pixelsPerUnit / glm::max(distance, 0.0001f);
+    u32 lod = glm::min(currentLod, lodCount - 1);
+    while (lod > 0 && lodErrors[lod] * pixelsPerError > pixelThreshold)
+        lod--;
+    while (lod + 1 < lodCount && lodErrors[lod + 1] * pixelsPerError < pixelThreshold * LOD_HYSTERESIS)
+        lod++;
+    return lod;
+}
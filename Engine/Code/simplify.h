@@ -0,0 +1,41 @@
+//
+// simplify.h: Builds the LOD chain of a submesh with quadric error metrics (Garland and
+// Heckbert). Simplification only collapses edges into one of their existing vertices, so
+// every LOD is just another index list over the vertex buffer of the full detail mesh.
+//
+// Vertices that share a position but not their attributes (UV or normal seams) are welded
+// for the topology and only move along the seam, the same goes for open borders, so LODs
+// keep their silhouette and texture mapping.
+//
+
+#pragma once
+#include "engine.h"
+
+#define SUBMESH_MAX_LODS   5     // including the full detail mesh
+#define LOD_TRIANGLE_RATIO 0.5f  // triangles kept from one LOD to the next
+#define LOD_MIN_TRIANGLES  32
+#define LOD_MAX_ERROR      0.1f  // relative to the radius of the submesh
+
+/**
+ * Appends up to SUBMESH_MAX_LODS - 1 simplified index lists to submesh.indices and fills
+ * submesh.lods, the first one being the current indices. Works on the float layout of
+ * the importers.
+ */
+void BuildLods(Submesh& submesh);
+
+/**
+ * Fills mesh.lodErrors with the largest error of every LOD among its submeshes.
+ */
+void ComputeMeshLodErrors(Mesh& mesh);
+
+/**
+ * Chooses the LOD of a model for the current view. The LOD only gets coarser once its
+ * projected error is clearly below the threshold, which avoids popping back and forth
+ * when an object sits right at a transition distance.
+ *
+ * lodErrors:     error of every LOD of the model (Mesh::lodErrors)
+ * distance:      from the camera to the object, in world units
+ * pixelsPerUnit: screen pixels covered by one unit of error at distance 1, including the
+ *                scale of the object
+ */
+u32 SelectLod(const f32* lodErrors, u32 lodCount, u32 currentLod, f32 distance, f32 pixelsPerUnit, f32 pixelThreshold);
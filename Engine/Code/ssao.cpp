@@ -0,0 +1,156 @@
+//
+// ssao.cpp : Screen space ambient occlusion at a fraction of the display resolution (see ssao.h).
+//
+
+#include "ssao.h"
+#include "programreflection.h"
+
+static void CreateSsaoTargets(SsaoPass& ssao, ivec2 displaySize)
+{
+    ssao.divisor = ssao.resolutionDivisor;
+    ssao.size = glm::max((displaySize + ivec2(ssao.divisor - 1)) / ivec2(ssao.divisor), ivec2(1));
+
+    glGenTextures(ARRAY_COUNT(ssao.occlusionTextures), ssao.occlusionTextures);
+    glGenFramebuffers(ARRAY_COUNT(ssao.framebuffers), ssao.framebuffers);
+    for (u32 i = 0; i < ARRAY_COUNT(ssao.occlusionTextures); ++i)
+    {
+        glBindTexture(GL_TEXTURE_2D, ssao.occlusionTextures[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, ssao.size.x, ssao.size.y, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, ssao.framebuffers[i]);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, ssao.occlusionTextures[i], 0);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+static void DestroySsaoTargets(SsaoPass& ssao)
+{
+    glDeleteFramebuffers(ARRAY_COUNT(ssao.framebuffers), ssao.framebuffers);
+    glDeleteTextures(ARRAY_COUNT(ssao.occlusionTextures), ssao.occlusionTextures);
+    for (u32 i = 0; i < ARRAY_COUNT(ssao.framebuffers); ++i)
+        ssao.framebuffers[i] = ssao.occlusionTextures[i] = 0;
+}
+
+void CreateSsao(App* app)
+{
+    SsaoPass& ssao = app->ssao;
+    CreateSsaoTargets(ssao, app->displaySize);
+
+    // Rotations around the normal, tangent space xy
+    std::uniform_real_distribution<f32> randomFloats(0.0f, 1.0f);
+    std::default_random_engine generator;
+    vec2 noise[SSAO_NOISE_SIZE * SSAO_NOISE_SIZE];
+    for (u32 i = 0; i < ARRAY_COUNT(noise); ++i)
+        noise[i] = vec2(randomFloats(generator) * 2.0f - 1.0f, randomFloats(generator) * 2.0f - 1.0f);
+
+    glGenTextures(1, &ssao.noiseTexture);
+    glBindTexture(GL_TEXTURE_2D, ssao.noiseTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, SSAO_NOISE_SIZE, SSAO_NOISE_SIZE, 0, GL_RG, GL_FLOAT, noise);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    ssao.kernelSampleCount = 0;
+    UpdateSsaoKernel(app);
+
+    Program& program = app->programs[ssao.programIdx];
+    glUseProgram(program.handle);
+    glUniform1i(GetProgramResourceLocation(program, ProgramResource_Sampler, "gDepth"), 0);
+    glUniform1i(GetProgramResourceLocation(program, ProgramResource_Sampler, "gNormal"), 1);
+    glUniform1i(GetProgramResourceLocation(program, ProgramResource_Sampler, "noiseTexture"), 2);
+    Program& blurProgram = app->programs[ssao.blurProgramIdx];
+    glUseProgram(blurProgram.handle);
+    glUniform1i(GetProgramResourceLocation(blurProgram, ProgramResource_Sampler, "occlusion"), 0);
+    glUniform1i(GetProgramResourceLocation(blurProgram, ProgramResource_Sampler, "gDepth"), 1);
+    glUseProgram(0);
+}
+
+void DestroySsao(SsaoPass& ssao)
+{
+    DestroySsaoTargets(ssao);
+    glDeleteTextures(1, &ssao.noiseTexture);
+    ssao.noiseTexture = 0;
+}
+
+void UpdateSsaoKernel(App* app)
+{
+    SsaoPass& ssao = app->ssao;
+    ssao.sampleCount = glm::clamp(ssao.sampleCount, 1u, (u32)SSAO_MAX_SAMPLES);
+    if (ssao.sampleCount == ssao.kernelSampleCount)
+        return;
+
+    // Hemisphere samples, more of them close to the center. The array stays at its full
+    // size so it always covers the uniform block.
+    std::uniform_real_distribution<f32> randomFloats(0.0f, 1.0f);
+    std::default_random_engine generator;
+    app->ssaoKernel.assign(SSAO_MAX_SAMPLES, vec3(0.0f));
+    for (u32 i = 0; i < ssao.sampleCount; ++i)
+    {
+        vec3 sample(randomFloats(generator) * 2.0f - 1.0f, randomFloats(generator) * 2.0f - 1.0f, randomFloats(generator));
+        sample = glm::normalize(sample) * randomFloats(generator);
+        f32 scale = (f32)i / ssao.sampleCount;
+        app->ssaoKernel[i] = sample * glm::mix(0.1f, 1.0f, scale * scale);
+    }
+    ssao.kernelSampleCount = ssao.sampleCount;
+}
+
+void RenderSsao(App* app)
+{
+    SsaoPass& ssao = app->ssao;
+    if (ssao.resolutionDivisor != ssao.divisor)
+    {
+        DestroySsaoTargets(ssao);
+        CreateSsaoTargets(ssao, app->displaySize);
+    }
+
+    Program& program = app->programs[ssao.programIdx];
+    Program& blurProgram = app->programs[ssao.blurProgramIdx];
+
+    glViewport(0, 0, ssao.size.x, ssao.size.y);
+    glDisable(GL_DEPTH_TEST);
+    glBindVertexArray(app->VAO);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, ssao.framebuffers[0]);
+    glUseProgram(program.handle);
+    glUniform1ui(GetProgramUniform(program, ProgramUniform_SsaoSampleCount), ssao.kernelSampleCount);
+    glUniform1f(GetProgramUniform(program, ProgramUniform_SsaoRadius), ssao.radius);
+    glUniform1f(GetProgramUniform(program, ProgramUniform_SsaoBias), ssao.bias);
+    glUniform1i(GetProgramUniform(program, ProgramUniform_SsaoDivisor), ssao.divisor);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, app->gDepth);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, app->gNormal);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, ssao.noiseTexture);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    if (ssao.blur)
+    {
+        // Horizontal into the second target, vertical back into the first
+        glUseProgram(blurProgram.handle);
+        glUniform1i(GetProgramUniform(blurProgram, ProgramUniform_SsaoDivisor), ssao.divisor);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, app->gDepth);
+        for (u32 i = 0; i < 2; ++i)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, ssao.framebuffers[1 - i]);
+            glUniform2i(GetProgramUniform(blurProgram, ProgramUniform_BlurDirection), 1 - i, i);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, ssao.occlusionTextures[i]);
+            glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        }
+    }
+
+    glBindVertexArray(0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glUseProgram(0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glEnable(GL_DEPTH_TEST);
+    glViewport(0, 0, app->displaySize.x, app->displaySize.y);
+}
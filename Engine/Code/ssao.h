@@ -0,0 +1,33 @@
+//
+// ssao.h: Screen space ambient occlusion at a fraction of the display resolution.
+//
+// The occlusion of every SSAO pixel is estimated from the G-buffer texel at the center of
+// the block of display pixels it covers, with a hemisphere kernel rotated per pixel by a
+// tiled 4x4 noise texture. A separable bilateral blur removes the noise pattern without
+// bleeding across depth discontinuities, and the lighting pass of quad.glsl upsamples the
+// result weighting the four closest SSAO texels by how close their depth is to the pixel.
+//
+// Sample count, radius, bias and resolution are settings of the SsaoPass and can change
+// every frame, the kernel and the targets are rebuilt when they do.
+//
+
+#pragma once
+#include "engine.h"
+
+#define SSAO_MAX_SAMPLES 64 // size of the kernel array in GlobalParamss
+#define SSAO_NOISE_SIZE  4
+
+void CreateSsao(App* app);
+void DestroySsao(SsaoPass& ssao);
+
+/**
+ * Rebuilds app->ssaoKernel when the sample count changed. Called before the kernel is
+ * pushed with the global parameters of the frame.
+ */
+void UpdateSsaoKernel(App* app);
+
+/**
+ * Renders and blurs the occlusion of the current G-buffer, leaves the display framebuffer
+ * and viewport bound.
+ */
+void RenderSsao(App* app);
@@ -0,0 +1,613 @@
+//
+// texturecook.cpp : Block compression encoders and cooked texture files (see texturecook.h).
+//
+// The encoders favour speed over quality: endpoints come from the inset bounding box of
+// the block (J.M.P. van Waveren, "Real-Time DXT Compression") and every texel is projected
+// on the endpoint axis to get its index. The projection is the hot loop and runs four
+// texels at a time with SSE2. BC7 blocks only use mode 6 (one subset, RGBA endpoints with
+// a p-bit each and 4 bit indices), which is the usual choice of fast BC7 encoders.
+//
+
+#include "texturecook.h"
+
+#if defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define TEXTURE_COOK_SSE2 1
+#include <emmintrin.h>
+#else
+#define TEXTURE_COOK_SSE2 0
+#endif
+
+#define BLOCK_TEXELS 16
+
+// Texels of a 4x4 block in SoA order, every channel in [0, 255]
+struct TexelBlock
+{
+    f32 channels[4][BLOCK_TEXELS];
+};
+
+// Uncompressed RGBA8 level of the mip chain
+struct MipLevel
+{
+    u32 width;
+    u32 height;
+    std::vector<u8> pixels;
+};
+
+std::string GetCookedTexturePath(const char* filepath)
+{
+    return std::string(filepath) + COOKED_TEXTURE_EXTENSION;
+}
+
+bool IsCookedTextureUpToDate(const char* filepath, const char* cookedPath)
+{
+    u64 cookedTimestamp = GetFileLastWriteTimestamp(cookedPath);
+    return cookedTimestamp != 0 && cookedTimestamp >= GetFileLastWriteTimestamp(filepath);
+}
+
+bool ParseTextureCookFormat(const char* name, TextureCookFormat* format)
+{
+    if      (strcmp(name, "auto") == 0) *format = TextureCook_Auto;
+    else if (strcmp(name, "bc1") == 0)  *format = TextureCook_BC1;
+    else if (strcmp(name, "bc3") == 0)  *format = TextureCook_BC3;
+    else if (strcmp(name, "bc5") == 0)  *format = TextureCook_BC5;
+    else if (strcmp(name, "bc7") == 0)  *format = TextureCook_BC7;
+    else return false;
+    return true;
+}
+
+static u32 GetBlockSize(TextureCookFormat format)
+{
+    return format == TextureCook_BC1 ? 8 : 16;
+}
+
+static u32 GetInternalFormat(TextureCookFormat format)
+{
+    switch (format)
+    {
+        case TextureCook_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case TextureCook_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case TextureCook_BC5: return GL_COMPRESSED_RG_RGTC2;
+        case TextureCook_BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+        default: return 0;
+    }
+}
+
+static u32 GetBlockSizeForInternalFormat(u32 internalFormat)
+{
+    switch (internalFormat)
+    {
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: return 8;
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        case GL_COMPRESSED_RG_RGTC2:
+        case GL_COMPRESSED_RGBA_BPTC_UNORM: return 16;
+        default: return 0;
+    }
+}
+
+////////////////////////////////////////
+// Block helpers
+
+static void LoadTexelBlock(const MipLevel& level, u32 blockX, u32 blockY, TexelBlock& block)
+{
+    for (u32 y = 0; y < 4; ++y)
+    {
+        // blocks crossing the border of the image repeat the last row/column
+        u32 py = blockY * 4 + y < level.height ? blockY * 4 + y : level.height - 1;
+        for (u32 x = 0; x < 4; ++x)
+        {
+            u32 px = blockX * 4 + x < level.width ? blockX * 4 + x : level.width - 1;
+            const u8* texel = &level.pixels[(py * level.width + px) * 4];
+            for (u32 c = 0; c < 4; ++c)
+                block.channels[c][y * 4 + x] = texel[c];
+        }
+    }
+}
+
+static void ComputeBlockBounds(const TexelBlock& block, f32 minColor[4], f32 maxColor[4])
+{
+    for (u32 c = 0; c < 4; ++c)
+    {
+#if TEXTURE_COOK_SSE2
+        const f32* channel = block.channels[c];
+        __m128 minV = _mm_min_ps(_mm_min_ps(_mm_loadu_ps(channel + 0), _mm_loadu_ps(channel + 4)),
+                                 _mm_min_ps(_mm_loadu_ps(channel + 8), _mm_loadu_ps(channel + 12)));
+        __m128 maxV = _mm_max_ps(_mm_max_ps(_mm_loadu_ps(channel + 0), _mm_loadu_ps(channel + 4)),
+                                 _mm_max_ps(_mm_loadu_ps(channel + 8), _mm_loadu_ps(channel + 12)));
+        minV = _mm_min_ps(minV, _mm_shuffle_ps(minV, minV, _MM_SHUFFLE(1, 0, 3, 2)));
+        minV = _mm_min_ps(minV, _mm_shuffle_ps(minV, minV, _MM_SHUFFLE(2, 3, 0, 1)));
+        maxV = _mm_max_ps(maxV, _mm_shuffle_ps(maxV, maxV, _MM_SHUFFLE(1, 0, 3, 2)));
+        maxV = _mm_max_ps(maxV, _mm_shuffle_ps(maxV, maxV, _MM_SHUFFLE(2, 3, 0, 1)));
+        minColor[c] = _mm_cvtss_f32(minV);
+        maxColor[c] = _mm_cvtss_f32(maxV);
+#else
+        minColor[c] = maxColor[c] = block.channels[c][0];
+        for (u32 i = 1; i < BLOCK_TEXELS; ++i)
+        {
+            minColor[c] = block.channels[c][i] < minColor[c] ? block.channels[c][i] : minColor[c];
+            maxColor[c] = block.channels[c][i] > maxColor[c] ? block.channels[c][i] : maxColor[c];
+        }
+#endif
+    }
+}
+
+// The bounding box always gives the main diagonal. Channels that decrease while the
+// reference channel increases get their endpoints swapped to follow the texels instead.
+static void SelectDiagonal(const TexelBlock& block, f32 minColor[4], f32 maxColor[4], u32 referenceChannel, u32 channelCount)
+{
+    const f32* reference = block.channels[referenceChannel];
+    f32 referenceCenter = (minColor[referenceChannel] + maxColor[referenceChannel]) * 0.5f;
+
+    for (u32 c = 0; c < channelCount; ++c)
+    {
+        if (c == referenceChannel)
+            continue;
+
+        f32 center = (minColor[c] + maxColor[c]) * 0.5f;
+        f32 covariance = 0.0f;
+        for (u32 i = 0; i < BLOCK_TEXELS; ++i)
+            covariance += (block.channels[c][i] - center) * (reference[i] - referenceCenter);
+
+        if (covariance < 0.0f)
+        {
+            f32 tmp = minColor[c];
+            minColor[c] = maxColor[c];
+            maxColor[c] = tmp;
+        }
+    }
+}
+
+// Moves the endpoints towards each other, the extremes are rarely the best endpoints
+static void InsetBounds(f32 minColor[4], f32 maxColor[4], u32 channelCount, f32 insetFactor)
+{
+    for (u32 c = 0; c < channelCount; ++c)
+    {
+        f32 inset = (maxColor[c] - minColor[c]) * insetFactor;
+        minColor[c] += inset;
+        maxColor[c] -= inset;
+    }
+}
+
+// Projects every texel of the block on the segment that goes from origin to origin + axis
+// and returns the closest of the stepCount evenly spaced points for each one of them.
+static void ProjectBlockOnAxis(const TexelBlock& block, const f32 origin[4], const f32 axis[4], u32 stepCount, u8 steps[BLOCK_TEXELS])
+{
+    f32 lengthSq = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2] + axis[3] * axis[3];
+    f32 scale = lengthSq > 0.0f ? (f32)(stepCount - 1) / lengthSq : 0.0f;
+
+#if TEXTURE_COOK_SSE2
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 maxStep = _mm_set1_ps((f32)(stepCount - 1));
+    const __m128 scaleV = _mm_set1_ps(scale);
+
+    for (u32 i = 0; i < BLOCK_TEXELS; i += 4)
+    {
+        __m128 dot = _mm_setzero_ps();
+        for (u32 c = 0; c < 4; ++c)
+        {
+            __m128 delta = _mm_sub_ps(_mm_loadu_ps(&block.channels[c][i]), _mm_set1_ps(origin[c]));
+            dot = _mm_add_ps(dot, _mm_mul_ps(delta, _mm_set1_ps(axis[c])));
+        }
+
+        __m128 t = _mm_min_ps(_mm_max_ps(_mm_mul_ps(dot, scaleV), zero), maxStep);
+        __m128i rounded = _mm_cvtps_epi32(t); // round to nearest
+
+        i32 values[4];
+        _mm_storeu_si128((__m128i*)values, rounded);
+        steps[i + 0] = (u8)values[0];
+        steps[i + 1] = (u8)values[1];
+        steps[i + 2] = (u8)values[2];
+        steps[i + 3] = (u8)values[3];
+    }
+#else
+    for (u32 i = 0; i < BLOCK_TEXELS; ++i)
+    {
+        f32 dot = 0.0f;
+        for (u32 c = 0; c < 4; ++c)
+            dot += (block.channels[c][i] - origin[c]) * axis[c];
+
+        f32 t = dot * scale;
+        t = t < 0.0f ? 0.0f : (t > (f32)(stepCount - 1) ? (f32)(stepCount - 1) : t);
+        steps[i] = (u8)(t + 0.5f);
+    }
+#endif
+}
+
+static void WriteLittleEndian(u8* output, u64 value, u32 byteCount)
+{
+    for (u32 i = 0; i < byteCount; ++i)
+        output[i] = (u8)(value >> (8 * i));
+}
+
+////////////////////////////////////////
+// BC1
+
+static u16 PackRGB565(const f32 color[4])
+{
+    u32 r = (u32)(glm::clamp(color[0], 0.0f, 255.0f) * (31.0f / 255.0f) + 0.5f);
+    u32 g = (u32)(glm::clamp(color[1], 0.0f, 255.0f) * (63.0f / 255.0f) + 0.5f);
+    u32 b = (u32)(glm::clamp(color[2], 0.0f, 255.0f) * (31.0f / 255.0f) + 0.5f);
+    return (u16)((r << 11) | (g << 5) | b);
+}
+
+static void UnpackRGB565(u16 packed, f32 color[4])
+{
+    u32 r = (packed >> 11) & 31;
+    u32 g = (packed >> 5) & 63;
+    u32 b = packed & 31;
+    color[0] = (f32)((r << 3) | (r >> 2));
+    color[1] = (f32)((g << 2) | (g >> 4));
+    color[2] = (f32)((b << 3) | (b >> 2));
+    color[3] = 0.0f;
+}
+
+static void EncodeBC1Block(const TexelBlock& block, u8* output)
+{
+    f32 minColor[4], maxColor[4];
+    ComputeBlockBounds(block, minColor, maxColor);
+    SelectDiagonal(block, minColor, maxColor, 1, 3);
+    InsetBounds(minColor, maxColor, 3, 1.0f / 16.0f);
+
+    u16 color0 = PackRGB565(maxColor);
+    u16 color1 = PackRGB565(minColor);
+    u32 indices = 0;
+
+    if (color0 != color1)
+    {
+        f32 endpoint0[4], endpoint1[4];
+        UnpackRGB565(color0, endpoint0);
+        UnpackRGB565(color1, endpoint1);
+        f32 axis[4] = { endpoint1[0] - endpoint0[0], endpoint1[1] - endpoint0[1], endpoint1[2] - endpoint0[2], 0.0f };
+
+        u8 steps[BLOCK_TEXELS];
+        ProjectBlockOnAxis(block, endpoint0, axis, 4, steps);
+
+        // palette order is color0, color1, 2/3 color0 + 1/3 color1, 1/3 color0 + 2/3 color1
+        const u32 stepToIndex[4] = { 0, 2, 3, 1 };
+        for (u32 i = 0; i < BLOCK_TEXELS; ++i)
+            indices |= stepToIndex[steps[i]] << (2 * i);
+
+        // color0 > color1 selects the four color mode
+        if (color0 < color1)
+        {
+            u16 tmp = color0;
+            color0 = color1;
+            color1 = tmp;
+            indices ^= 0x55555555;
+        }
+    }
+
+    WriteLittleEndian(output + 0, color0, 2);
+    WriteLittleEndian(output + 2, color1, 2);
+    WriteLittleEndian(output + 4, indices, 4);
+}
+
+////////////////////////////////////////
+// BC4 (alpha of BC3 and both channels of BC5)
+
+static void EncodeBC4Block(const TexelBlock& block, u32 channel, u8* output)
+{
+    f32 minColor[4], maxColor[4];
+    ComputeBlockBounds(block, minColor, maxColor);
+
+    u8 value0 = (u8)(maxColor[channel] + 0.5f);
+    u8 value1 = (u8)(minColor[channel] + 0.5f);
+    u64 indices = 0;
+
+    // value0 > value1 selects the mode with 8 interpolated values
+    if (value0 > value1)
+    {
+        f32 origin[4] = {};
+        f32 axis[4] = {};
+        origin[channel] = value1;
+        axis[channel] = (f32)(value0 - value1);
+
+        u8 steps[BLOCK_TEXELS];
+        ProjectBlockOnAxis(block, origin, axis, 8, steps);
+
+        // index 0 is value0, 1 is value1 and 2..7 go from value0 towards value1
+        for (u32 i = 0; i < BLOCK_TEXELS; ++i)
+        {
+            u32 index = steps[i] == 7 ? 0 : (steps[i] == 0 ? 1 : 8 - steps[i]);
+            indices |= (u64)index << (3 * i);
+        }
+    }
+
+    output[0] = value0;
+    output[1] = value1;
+    WriteLittleEndian(output + 2, indices, 6);
+}
+
+////////////////////////////////////////
+// BC7 (mode 6 only)
+
+struct BlockBitWriter
+{
+    u8* data;
+    u32 position;
+};
+
+static void WriteBits(BlockBitWriter& writer, u32 value, u32 bitCount)
+{
+    for (u32 i = 0; i < bitCount; ++i, ++writer.position)
+        if ((value >> i) & 1)
+            writer.data[writer.position >> 3] |= (u8)(1 << (writer.position & 7));
+}
+
+// Endpoints are stored with 7 bits per channel plus a p-bit shared by the four channels
+static void QuantizeBC7Endpoint(const f32 color[4], u32 quantized[4], u32* pbit)
+{
+    f32 bestError = FLT_MAX;
+    for (u32 p = 0; p < 2; ++p)
+    {
+        u32 candidate[4];
+        f32 error = 0.0f;
+        for (u32 c = 0; c < 4; ++c)
+        {
+            f32 value = (color[c] - (f32)p) * 0.5f + 0.5f;
+            candidate[c] = (u32)glm::clamp(value, 0.0f, 127.0f);
+            f32 delta = (f32)((candidate[c] << 1) | p) - color[c];
+            error += delta * delta;
+        }
+
+        if (error < bestError)
+        {
+            bestError = error;
+            *pbit = p;
+            for (u32 c = 0; c < 4; ++c)
+                quantized[c] = candidate[c];
+        }
+    }
+}
+
+static void EncodeBC7Block(const TexelBlock& block, u8* output)
+{
+    f32 minColor[4], maxColor[4];
+    ComputeBlockBounds(block, minColor, maxColor);
+    SelectDiagonal(block, minColor, maxColor, 1, 4);
+    InsetBounds(minColor, maxColor, 4, 1.0f / 32.0f);
+
+    u32 quantized0[4], quantized1[4];
+    u32 pbit0, pbit1;
+    QuantizeBC7Endpoint(minColor, quantized0, &pbit0);
+    QuantizeBC7Endpoint(maxColor, quantized1, &pbit1);
+
+    f32 endpoint0[4], axis[4];
+    for (u32 c = 0; c < 4; ++c)
+    {
+        endpoint0[c] = (f32)((quantized0[c] << 1) | pbit0);
+        axis[c] = (f32)((quantized1[c] << 1) | pbit1) - endpoint0[c];
+    }
+
+    // the 4 bit interpolation weights are close enough to i/15 to use the steps as indices
+    u8 indices[BLOCK_TEXELS];
+    ProjectBlockOnAxis(block, endpoint0, axis, 16, indices);
+
+    // the most significant bit of the first index is implicit and has to be zero
+    if (indices[0] & 8)
+    {
+        for (u32 c = 0; c < 4; ++c)
+        {
+            u32 tmp = quantized0[c];
+            quantized0[c] = quantized1[c];
+            quantized1[c] = tmp;
+        }
+        u32 tmp = pbit0;
+        pbit0 = pbit1;
+        pbit1 = tmp;
+
+        for (u32 i = 0; i < BLOCK_TEXELS; ++i)
+            indices[i] = 15 - indices[i];
+    }
+
+    memset(output, 0, 16);
+    BlockBitWriter writer = { output, 0 };
+    WriteBits(writer, 1 << 6, 7); // mode 6
+    for (u32 c = 0; c < 4; ++c)
+    {
+        WriteBits(writer, quantized0[c], 7);
+        WriteBits(writer, quantized1[c], 7);
+    }
+    WriteBits(writer, pbit0, 1);
+    WriteBits(writer, pbit1, 1);
+    WriteBits(writer, indices[0], 3);
+    for (u32 i = 1; i < BLOCK_TEXELS; ++i)
+        WriteBits(writer, indices[i], 4);
+}
+
+////////////////////////////////////////
+// Mip chain
+
+static void DownsampleLevel(const MipLevel& src, MipLevel& dst)
+{
+    dst.width = src.width > 1 ? src.width / 2 : 1;
+    dst.height = src.height > 1 ? src.height / 2 : 1;
+    dst.pixels.resize(dst.width * dst.height * 4);
+
+    for (u32 y = 0; y < dst.height; ++y)
+    {
+        u32 y0 = glm::min(y * 2, src.height - 1);
+        u32 y1 = glm::min(y * 2 + 1, src.height - 1);
+        for (u32 x = 0; x < dst.width; ++x)
+        {
+            u32 x0 = glm::min(x * 2, src.width - 1);
+            u32 x1 = glm::min(x * 2 + 1, src.width - 1);
+            for (u32 c = 0; c < 4; ++c)
+            {
+                u32 sum = src.pixels[(y0 * src.width + x0) * 4 + c] +
+                          src.pixels[(y0 * src.width + x1) * 4 + c] +
+                          src.pixels[(y1 * src.width + x0) * 4 + c] +
+                          src.pixels[(y1 * src.width + x1) * 4 + c];
+                dst.pixels[(y * dst.width + x) * 4 + c] = (u8)((sum + 2) / 4);
+            }
+        }
+    }
+}
+
+static void CompressLevel(const MipLevel& level, TextureCookFormat format, std::vector<u8>& output)
+{
+    u32 blocksX = (level.width + 3) / 4;
+    u32 blocksY = (level.height + 3) / 4;
+    u32 blockSize = GetBlockSize(format);
+    output.resize(blocksX * blocksY * blockSize);
+
+    TexelBlock block;
+    for (u32 blockY = 0; blockY < blocksY; ++blockY)
+    {
+        for (u32 blockX = 0; blockX < blocksX; ++blockX)
+        {
+            LoadTexelBlock(level, blockX, blockY, block);
+            u8* dst = &output[(blockY * blocksX + blockX) * blockSize];
+            switch (format)
+            {
+                case TextureCook_BC1: EncodeBC1Block(block, dst); break;
+                case TextureCook_BC3: EncodeBC4Block(block, 3, dst); EncodeBC1Block(block, dst + 8); break;
+                case TextureCook_BC5: EncodeBC4Block(block, 0, dst); EncodeBC4Block(block, 1, dst + 8); break;
+                case TextureCook_BC7: EncodeBC7Block(block, dst); break;
+                default: break;
+            }
+        }
+    }
+}
+
+static TextureCookFormat ChooseTextureCookFormat(const char* filepath, const MipLevel& level)
+{
+    std::string name = filepath;
+    for (u32 i = 0; i < name.size(); ++i)
+        name[i] = (char)tolower(name[i]);
+    if (name.find("normal") != std::string::npos)
+        return TextureCook_BC5;
+
+    for (u32 i = 3; i < level.pixels.size(); i += 4)
+        if (level.pixels[i] != 255)
+            return TextureCook_BC7;
+
+    return TextureCook_BC1;
+}
+
+bool CookTexture(const char* filepath, const char* cookedPath, TextureCookFormat format)
+{
+    // same orientation as the images loaded at runtime by LoadImage
+    stbi_set_flip_vertically_on_load_thread(true);
+
+    i32 width, height, channelCount;
+    u8* pixels = stbi_load(filepath, &width, &height, &channelCount, 4);
+    if (!pixels)
+    {
+        ELOG("Could not open file %s", filepath);
+        return false;
+    }
+
+    std::vector<MipLevel> levels(1);
+    levels[0].width = (u32)width;
+    levels[0].height = (u32)height;
+    levels[0].pixels.assign(pixels, pixels + width * height * 4);
+    stbi_image_free(pixels);
+
+    if (format == TextureCook_Auto)
+        format = ChooseTextureCookFormat(filepath, levels[0]);
+
+    while ((levels.back().width > 1 || levels.back().height > 1) && levels.size() < COOKED_TEXTURE_MAX_LEVELS)
+    {
+        MipLevel next;
+        DownsampleLevel(levels.back(), next);
+        levels.push_back(next);
+    }
+
+    CookedTextureHeader header = {};
+    header.magic = COOKED_TEXTURE_MAGIC;
+    header.version = COOKED_TEXTURE_VERSION;
+    header.internalFormat = GetInternalFormat(format);
+    header.width = levels[0].width;
+    header.height = levels[0].height;
+    header.levelCount = (u32)levels.size();
+    header.blockSize = GetBlockSize(format);
+
+    std::vector<CookedTextureLevel> levelTable(levels.size());
+    std::vector<std::vector<u8>> compressedLevels(levels.size());
+    u64 offset = sizeof(CookedTextureHeader) + levels.size() * sizeof(CookedTextureLevel);
+    for (u32 i = 0; i < levels.size(); ++i)
+    {
+        CompressLevel(levels[i], format, compressedLevels[i]);
+        levelTable[i].width = levels[i].width;
+        levelTable[i].height = levels[i].height;
+        levelTable[i].offset = offset;
+        levelTable[i].size = compressedLevels[i].size();
+        offset += compressedLevels[i].size();
+    }
+
+    FILE* file = fopen(cookedPath, "wb");
+    if (!file)
+    {
+        ELOG("fopen() failed writing cooked texture %s", cookedPath);
+        return false;
+    }
+
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(levelTable.data(), sizeof(CookedTextureLevel), levelTable.size(), file);
+    for (u32 i = 0; i < compressedLevels.size(); ++i)
+        fwrite(compressedLevels[i].data(), 1, compressedLevels[i].size(), file);
+
+    bool success = ferror(file) == 0;
+    fclose(file);
+
+    if (!success)
+    {
+        ELOG("fwrite() failed writing cooked texture %s", cookedPath);
+        remove(cookedPath);
+        return false;
+    }
+
+    ILOG("Cooked %s -> %s (%u levels, %u bytes)", filepath, cookedPath, header.levelCount, (u32)offset);
+    return true;
+}
+
+bool ParseCookedTexture(const MappedFile& file, const CookedTextureHeader** outHeader, const CookedTextureLevel** outLevels)
+{
+    if (!file.data || file.size < sizeof(CookedTextureHeader))
+        return false;
+
+    const CookedTextureHeader* header = (const CookedTextureHeader*)file.data;
+    if (header->magic != COOKED_TEXTURE_MAGIC || header->version != COOKED_TEXTURE_VERSION ||
+        header->levelCount == 0 || header->levelCount > COOKED_TEXTURE_MAX_LEVELS ||
+        header->blockSize != GetBlockSizeForInternalFormat(header->internalFormat))
+        return false;
+
+    if (sizeof(CookedTextureHeader) + header->levelCount * sizeof(CookedTextureLevel) > file.size)
+        return false;
+
+    const CookedTextureLevel* levels = (const CookedTextureLevel*)(file.data + sizeof(CookedTextureHeader));
+    for (u32 i = 0; i < header->levelCount; ++i)
+    {
+        const CookedTextureLevel& level = levels[i];
+        u64 expectedSize = (u64)((level.width + 3) / 4) * ((level.height + 3) / 4) * header->blockSize;
+        if (level.size != expectedSize || level.offset + level.size > file.size)
+            return false;
+    }
+
+    *outHeader = header;
+    *outLevels = levels;
+    return true;
+}
+
+MappedFile MapCookedTexture(const char* filepath, bool supportsS3TC)
+{
+    MappedFile file = {};
+    std::string cookedPath = GetCookedTexturePath(filepath);
+    if (!IsCookedTextureUpToDate(filepath, cookedPath.c_str()))
+        return file;
+
+    file = MapFile(cookedPath.c_str());
+
+    const CookedTextureHeader* header = NULL;
+    const CookedTextureLevel* levels = NULL;
+    if (!ParseCookedTexture(file, &header, &levels))
+    {
+        ELOG("Cooked texture %s is not valid, loading %s instead", cookedPath.c_str(), filepath);
+        UnmapFile(file);
+    }
+    else if (!supportsS3TC && (header->internalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || header->internalFormat == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT))
+    {
+        UnmapFile(file);
+    }
+    return file;
+}
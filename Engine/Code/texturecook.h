@@ -0,0 +1,83 @@
+//
+// texturecook.h: Offline texture cooker. Source images are converted into block compressed
+// formats (BC1/BC3/BC5/BC7) with their whole mip chain precomputed, and stored in a small
+// KTX2-like container that the engine uploads level by level with glCompressedTexImage2D.
+//
+// File layout (all offsets are in bytes from the start of the file):
+//
+//   CookedTextureHeader
+//   CookedTextureLevel [header.levelCount]
+//   level data         (level.offset, level.size), largest level first
+//
+
+#pragma once
+#include "engine.h"
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT  0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+#define COOKED_TEXTURE_MAGIC      0x54504741 // "AGPT"
+#define COOKED_TEXTURE_VERSION    1
+#define COOKED_TEXTURE_EXTENSION  ".ctex"
+#define COOKED_TEXTURE_MAX_LEVELS 16
+
+enum TextureCookFormat
+{
+    TextureCook_Auto, // BC5 for normal maps, BC7 for images with alpha and BC1 otherwise
+    TextureCook_BC1,
+    TextureCook_BC3,
+    TextureCook_BC5,
+    TextureCook_BC7
+};
+
+struct CookedTextureHeader
+{
+    u32 magic;
+    u32 version;
+    u32 internalFormat; // GL compressed internal format
+    u32 width;
+    u32 height;
+    u32 levelCount;
+    u32 blockSize;      // bytes per 4x4 block
+    u32 padding;
+};
+
+struct CookedTextureLevel
+{
+    u32 width;
+    u32 height;
+    u64 offset;
+    u64 size;
+};
+
+std::string GetCookedTexturePath(const char* filepath);
+
+/**
+ * True if the cooked file exists and is not older than its source.
+ */
+bool IsCookedTextureUpToDate(const char* filepath, const char* cookedPath);
+
+/**
+ * Parses a TextureCookFormat from its name ("bc1", "bc3", "bc5", "bc7" or "auto").
+ */
+bool ParseTextureCookFormat(const char* name, TextureCookFormat* format);
+
+/**
+ * Loads a source image, builds its mip chain, compresses every level and writes the result.
+ */
+bool CookTexture(const char* filepath, const char* cookedPath, TextureCookFormat format);
+
+/**
+ * Validates a mapped cooked texture. On success the returned pointers reference the
+ * mapped memory directly, nothing is copied.
+ */
+bool ParseCookedTexture(const MappedFile& file, const CookedTextureHeader** header, const CookedTextureLevel** levels);
+
+/**
+ * Maps the cooked version of a source image if it is up to date, valid and in a format the
+ * context can sample (BC5 and BC7 are core, BC1 and BC3 need S3TC). Otherwise returns an
+ * empty MappedFile and the caller falls back to the source image.
+ */
+MappedFile MapCookedTexture(const char* filepath, bool supportsS3TC);
@@ -0,0 +1,133 @@
+//
+// textureregistry.cpp : Path and content lookups of loaded textures (see textureregistry.h).
+//
+
+#include "textureregistry.h"
+#include "texturecook.h"
+
+// Different seeds keep decoded and cooked content apart
+#define IMAGE_CONTENT_SEED  0x696d616765ull
+#define COOKED_CONTENT_SEED 0x636f6f6b6564ull
+
+std::string NormalizeTexturePath(const char* filepath)
+{
+    std::vector<std::string> segments;
+    std::string segment;
+    bool absolute = filepath[0] == '/' || filepath[0] == '\\';
+
+    for (const char* c = filepath;; ++c)
+    {
+        if (*c == '/' || *c == '\\' || *c == '\0')
+        {
+            if (segment == "..")
+            {
+                // keep leading ".." segments, they go above the working directory
+                if (!segments.empty() && segments.back() != "..")
+                    segments.pop_back();
+                else
+                    segments.push_back(segment);
+            }
+            else if (!segment.empty() && segment != ".")
+            {
+                segments.push_back(segment);
+            }
+            segment.clear();
+
+            if (*c == '\0')
+                break;
+        }
+        else
+        {
+#ifdef _WIN32
+            segment += (char)tolower((unsigned char)*c);
+#else
+            segment += *c;
+#endif
+        }
+    }
+
+    std::string path = absolute ? "/" : "";
+    for (u32 i = 0; i < segments.size(); ++i)
+    {
+        if (i > 0)
+            path += '/';
+        path += segments[i];
+    }
+    return path;
+}
+
+static u64 HashTexturePath(const std::string& path)
+{
+    return HashBytes(path.data(), path.size());
+}
+
+u64 HashImageContent(const Image& image)
+{
+    u64 hash = HashBytes(image.pixels, (u64)image.stride * image.size.y, IMAGE_CONTENT_SEED);
+    i32 format[3] = { image.size.x, image.size.y, image.nchannels };
+    return HashBytes(format, sizeof(format), hash);
+}
+
+u64 HashCookedTextureContent(const MappedFile& file)
+{
+    return HashBytes(file.data, file.size, COOKED_CONTENT_SEED);
+}
+
+// Compares new texels with the ones of a loaded texture, read again from its source
+static bool HasSameTexels(const Texture& texture, const Image* image, const MappedFile* cookedFile, bool supportsS3TC)
+{
+    if (cookedFile)
+    {
+        // The cooked file holds the dimensions and the format along with every level
+        MappedFile other = MapCookedTexture(texture.filepath.c_str(), supportsS3TC);
+        if (!other.data)
+            return false;
+        bool same = other.size == cookedFile->size && memcmp(other.data, cookedFile->data, cookedFile->size) == 0;
+        UnmapFile(other);
+        return same;
+    }
+
+    Image other = LoadImage(texture.filepath.c_str());
+    if (!other.pixels)
+        return false;
+    bool same = other.size == image->size && other.nchannels == image->nchannels && other.stride == image->stride &&
+                memcmp(other.pixels, image->pixels, (size_t)image->stride * image->size.y) == 0;
+    FreeImage(other);
+    return same;
+}
+
+u32 FindTextureByPath(TextureRegistry& registry, const std::string& path)
+{
+    auto it = registry.pathToTexture.find(HashTexturePath(path));
+    if (it == registry.pathToTexture.end() || it->second.path != path)
+        return TEXTURE_NOT_FOUND;
+
+    registry.pathHits++;
+    return it->second.texIdx;
+}
+
+u32 FindTextureByContent(TextureRegistry& registry, const std::vector<Texture>& textures, u64 contentHash, u64 size, const Image* image, const MappedFile* cookedFile, bool supportsS3TC)
+{
+    auto it = registry.contentToTexture.find(contentHash);
+    if (it == registry.contentToTexture.end() || textures[it->second].size != size)
+        return TEXTURE_NOT_FOUND;
+
+    // a hash collision would share the wrong texels
+    if (!HasSameTexels(textures[it->second], image, cookedFile, supportsS3TC))
+        return TEXTURE_NOT_FOUND;
+
+    registry.contentHits++;
+    registry.bytesSaved += size;
+    return it->second;
+}
+
+void RegisterTexturePath(TextureRegistry& registry, const std::string& path, u32 texIdx)
+{
+    registry.pathToTexture[HashTexturePath(path)] = TexturePathEntry{ path, texIdx };
+}
+
+void RegisterTextureContent(TextureRegistry& registry, u64 contentHash, u32 texIdx)
+{
+    registry.contentToTexture[contentHash] = texIdx;
+    registry.misses++;
+}
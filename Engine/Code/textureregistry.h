@@ -0,0 +1,42 @@
+//
+// textureregistry.h: Constant time lookup of loaded textures. Textures are found by the hash
+// of their normalized path first, so "Textures\Rock.png" and "./textures/rock.png" are the
+// same entry, and then by the hash of their texels, so identical images stored under
+// different paths share a single GL texture. A hash match is only trusted once the paths
+// or the texels themselves compare equal.
+//
+
+#pragma once
+#include "engine.h"
+
+#define TEXTURE_NOT_FOUND UINT32_MAX
+
+/**
+ * Unifies separators, resolves "." and ".." segments and, on Windows, ignores case.
+ */
+std::string NormalizeTexturePath(const char* filepath);
+
+/**
+ * Content hashes of decoded images and cooked textures never match each other, the same
+ * image loaded both ways is uploaded twice.
+ */
+u64 HashImageContent(const Image& image);
+u64 HashCookedTextureContent(const MappedFile& file);
+
+/**
+ * path has to be normalized.
+ */
+u32 FindTextureByPath(TextureRegistry& registry, const std::string& path);
+
+/**
+ * Returns the texture with the same texels, counting the upload it saves. The new texels are
+ * cookedFile, or image when it is NULL. On a hash match the source of the candidate is
+ * loaded again and compared byte for byte, which only costs anything when sharing succeeds.
+ */
+u32 FindTextureByContent(TextureRegistry& registry, const std::vector<Texture>& textures, u64 contentHash, u64 size, const Image* image, const MappedFile* cookedFile, bool supportsS3TC);
+
+/**
+ * path has to be normalized.
+ */
+void RegisterTexturePath(TextureRegistry& registry, const std::string& path, u32 texIdx);
+void RegisterTextureContent(TextureRegistry& registry, u64 contentHash, u32 texIdx);
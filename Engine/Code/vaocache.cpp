@@ -0,0 +1,111 @@
+//
+// vaocache.cpp : Persistent VAOs keyed by vertex format (see vaocache.h).
+//
+
+#include "vaocache.h"
+#include "instancing.h"
+
+#define VAO_VERTEX_BINDING 0
+
+static u64 HashVaoKey(const GeometryArena& arena, GLuint instanceBuffer, const VertexBufferLayout& layout, const VertexShaderLayout& inputs)
+{
+    u64 hash = HashBytes(&layout.stride, sizeof(layout.stride));
+    for (u32 i = 0; i < layout.attributes.size(); ++i)
+    {
+        const VertexBufferAttribute& attribute = layout.attributes[i];
+        u64 packed = (u64)attribute.location | (u64)attribute.componenetCount << 8 |
+                     (u64)attribute.offset << 16 | (u64)attribute.normalized << 24 | (u64)attribute.type << 32;
+        hash = HashBytes(&packed, sizeof(packed), hash);
+    }
+    for (u32 i = 0; i < inputs.attributes.size(); ++i)
+    {
+        u16 packed = (u16)(inputs.attributes[i].location | inputs.attributes[i].componentCount << 8);
+        hash = HashBytes(&packed, sizeof(packed), hash);
+    }
+    GLuint buffers[] = { arena.vertices.handle, arena.indices.handle, instanceBuffer };
+    return HashBytes(buffers, sizeof(buffers), hash);
+}
+
+static void ReleaseVaos(VaoCache& cache)
+{
+    for (auto& entry : cache.vaos)
+        glDeleteVertexArrays(1, &entry.second.handle);
+    cache.vaos.clear();
+}
+
+static GLuint CreateVao(const GeometryArena& arena, GLuint instanceBuffer, const VertexBufferLayout& layout, const Program& program)
+{
+    GLuint handle;
+    glGenVertexArrays(1, &handle);
+    glBindVertexArray(handle);
+
+    bool instanced = false;
+    for (u32 i = 0; i < program.vertexInputLayout.attributes.size(); ++i)
+    {
+        // Instance inputs are vec4s packed in InstanceData order
+        u32 location = program.vertexInputLayout.attributes[i].location;
+        if (location >= INSTANCE_ATTRIBUTE_LOCATION)
+        {
+            glVertexAttribFormat(location, 4, GL_FLOAT, GL_FALSE, (location - INSTANCE_ATTRIBUTE_LOCATION) * sizeof(vec4));
+            glVertexAttribBinding(location, INSTANCE_BUFFER_BINDING);
+            glEnableVertexAttribArray(location);
+            instanced = true;
+            continue;
+        }
+
+        bool attributeWasLinked = false;
+        for (u32 j = 0; j < layout.attributes.size(); ++j)
+        {
+            const VertexBufferAttribute& attribute = layout.attributes[j];
+            if (program.vertexInputLayout.attributes[i].location != attribute.location)
+                continue;
+
+            glVertexAttribFormat(attribute.location, attribute.componenetCount, attribute.type, attribute.normalized ? GL_TRUE : GL_FALSE, attribute.offset);
+            glVertexAttribBinding(attribute.location, VAO_VERTEX_BINDING);
+            glEnableVertexAttribArray(attribute.location);
+            attributeWasLinked = true;
+            break;
+        }
+        ASSERT(attributeWasLinked, "The vertex buffer lacks an input of the program");
+    }
+
+    // The draws add the base vertex, the binding always starts at the beginning of the heap
+    glBindVertexBuffer(VAO_VERTEX_BINDING, arena.vertices.handle, 0, layout.stride);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, arena.indices.handle);
+    if (instanced)
+    {
+        glBindVertexBuffer(INSTANCE_BUFFER_BINDING, instanceBuffer, 0, sizeof(InstanceData));
+        glVertexBindingDivisor(INSTANCE_BUFFER_BINDING, 1);
+    }
+    glBindVertexArray(0);
+    return handle;
+}
+
+GLuint FindOrCreateVao(VaoCache& cache, const GeometryArena& arena, GLuint instanceBuffer, const VertexBufferLayout& layout, const Program& program)
+{
+    if (cache.geometryGeneration != arena.generation)
+    {
+        ReleaseVaos(cache);
+        cache.geometryGeneration = arena.generation;
+    }
+
+    u64 key = HashVaoKey(arena, instanceBuffer, layout, program.vertexInputLayout);
+    auto it = cache.vaos.find(key);
+    if (it != cache.vaos.end())
+    {
+        cache.hits++;
+        return it->second.handle;
+    }
+
+    cache.misses++;
+    Vao vao = { CreateVao(arena, instanceBuffer, layout, program) };
+    cache.vaos[key] = vao;
+    return vao.handle;
+}
+
+void DestroyVaoCache(VaoCache& cache)
+{
+    ReleaseVaos(cache);
+    cache.hits = 0;
+    cache.misses = 0;
+}
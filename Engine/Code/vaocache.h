@@ -0,0 +1,21 @@
+//
+// vaocache.h: VAOs are created once per vertex format and program input set and kept until
+// shutdown. Formats are set with glVertexAttribFormat/glVertexAttribBinding against one
+// binding point for vertices and another for instances, and since all meshes live in the
+// geometry arena the same VAO draws any submesh with that format, the base vertex of the
+// draw selects the submesh.
+//
+// The key hashes the vertex buffer layout, the active program inputs, the arena buffer
+// handles and the instance buffer. When the arena recreates its buffers every cached VAO
+// is released, the keys of the new handles would never match them again.
+//
+
+#pragma once
+#include "engine.h"
+
+/**
+ * instanceBuffer feeds the per instance inputs of instanced programs (see instancing.h).
+ */
+GLuint FindOrCreateVao(VaoCache& cache, const GeometryArena& arena, GLuint instanceBuffer, const VertexBufferLayout& layout, const Program& program);
+
+void DestroyVaoCache(VaoCache& cache);
@@ -0,0 +1,187 @@
+//
+// vertexformat.cpp : Vertex quantization and index narrowing (see vertexformat.h).
+//
+
+#include "vertexformat.h"
+#include <glm/gtc/packing.hpp>
+
+#define ATTRIBUTE_POSITION  0
+#define ATTRIBUTE_NORMAL    1
+#define ATTRIBUTE_TEXCOORD  2
+#define ATTRIBUTE_TANGENT   3
+#define ATTRIBUTE_BITANGENT 4
+
+u32 GetIndexSize(GLenum indexType)
+{
+    return indexType == GL_UNSIGNED_SHORT ? sizeof(u16) : sizeof(u32);
+}
+
+bool HasOctahedralNormals(const VertexBufferLayout& layout)
+{
+    for (u32 i = 0; i < layout.attributes.size(); ++i)
+        if (layout.attributes[i].location == ATTRIBUTE_NORMAL)
+            return layout.attributes[i].type != GL_FLOAT;
+    return false;
+}
+
+// Projects a unit vector on the octahedron and unfolds it on the [-1, 1] square
+static vec2 OctEncode(vec3 n)
+{
+    n /= glm::abs(n.x) + glm::abs(n.y) + glm::abs(n.z);
+    vec2 e = vec2(n.x, n.y);
+    if (n.z < 0.0f)
+    {
+        e.x = (1.0f - glm::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+        e.y = (1.0f - glm::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return e;
+}
+
+static void PushBytes(std::vector<u8>& data, const void* src, u32 size)
+{
+    const u8* bytes = (const u8*)src;
+    data.insert(data.end(), bytes, bytes + size);
+}
+
+static void PackFloatSubmesh(const Submesh& submesh, PackedSubmesh& packed)
+{
+    packed.layout = submesh.vertexBufferLayout;
+    packed.positionScale = vec3(1.0f);
+    packed.positionOffset = vec3(0.0f);
+    PushBytes(packed.vertices, submesh.vertices.data(), (u32)(submesh.vertices.size() * sizeof(float)));
+
+    packed.indexType = GL_UNSIGNED_INT;
+    PushBytes(packed.indices, submesh.indices.data(), (u32)(submesh.indices.size() * sizeof(u32)));
+}
+
+void PackSubmesh(const Submesh& submesh, bool compact, PackedSubmesh& packed)
+{
+    packed.vertices.clear();
+    packed.indices.clear();
+
+    const VertexBufferLayout& source = submesh.vertexBufferLayout;
+    const u32 sourceStride = source.stride / sizeof(float);
+    const u32 vertexCount = sourceStride > 0 ? (u32)submesh.vertices.size() / sourceStride : 0;
+
+    if (!compact || vertexCount == 0)
+    {
+        PackFloatSubmesh(submesh, packed);
+        return;
+    }
+
+    // Layout: attributes keep their locations, only types and offsets change
+    packed.layout = {};
+    std::vector<u32> sourceOffsets;
+    for (u32 i = 0; i < source.attributes.size(); ++i)
+    {
+        const VertexBufferAttribute& attribute = source.attributes[i];
+        VertexBufferAttribute compactAttribute = { attribute.location, attribute.componenetCount, packed.layout.stride };
+        switch (attribute.location)
+        {
+            case ATTRIBUTE_POSITION:
+                compactAttribute.type = GL_SHORT;
+                compactAttribute.normalized = true;
+                packed.layout.stride += 4 * sizeof(i16); // 4 byte aligned
+                break;
+            case ATTRIBUTE_NORMAL:
+            case ATTRIBUTE_TANGENT:
+            case ATTRIBUTE_BITANGENT:
+                compactAttribute.componenetCount = 2;
+                compactAttribute.type = GL_SHORT;
+                compactAttribute.normalized = true;
+                packed.layout.stride += 2 * sizeof(i16);
+                break;
+            case ATTRIBUTE_TEXCOORD:
+                compactAttribute.type = GL_HALF_FLOAT;
+                packed.layout.stride += 2 * sizeof(u16);
+                break;
+            default:
+                packed.layout.stride += attribute.componenetCount * sizeof(float);
+                break;
+        }
+        packed.layout.attributes.push_back(compactAttribute);
+        sourceOffsets.push_back(attribute.offset / sizeof(float));
+    }
+
+    // Positions are normalized inside the bounds of the submesh
+    vec3 boundsMin = vec3(FLT_MAX);
+    vec3 boundsMax = vec3(-FLT_MAX);
+    for (u32 i = 0; i < source.attributes.size(); ++i)
+    {
+        if (source.attributes[i].location != ATTRIBUTE_POSITION)
+            continue;
+        for (u32 v = 0; v < vertexCount; ++v)
+        {
+            const float* position = &submesh.vertices[v * sourceStride + sourceOffsets[i]];
+            boundsMin = glm::min(boundsMin, vec3(position[0], position[1], position[2]));
+            boundsMax = glm::max(boundsMax, vec3(position[0], position[1], position[2]));
+        }
+    }
+
+    vec3 halfExtent = (boundsMax - boundsMin) * 0.5f;
+    packed.positionOffset = (boundsMin + boundsMax) * 0.5f;
+    packed.positionScale = vec3(halfExtent.x > 0.0f ? halfExtent.x : 1.0f,
+                                halfExtent.y > 0.0f ? halfExtent.y : 1.0f,
+                                halfExtent.z > 0.0f ? halfExtent.z : 1.0f);
+
+    packed.vertices.resize(vertexCount * packed.layout.stride);
+    for (u32 v = 0; v < vertexCount; ++v)
+    {
+        const float* sourceVertex = &submesh.vertices[v * sourceStride];
+        u8* vertex = &packed.vertices[v * packed.layout.stride];
+
+        for (u32 i = 0; i < source.attributes.size(); ++i)
+        {
+            const float* value = sourceVertex + sourceOffsets[i];
+            u8* dst = vertex + packed.layout.attributes[i].offset;
+            switch (source.attributes[i].location)
+            {
+                case ATTRIBUTE_POSITION:
+                {
+                    vec3 normalized = (vec3(value[0], value[1], value[2]) - packed.positionOffset) / packed.positionScale;
+                    i16 components[4] = {
+                        (i16)glm::packSnorm1x16(normalized.x),
+                        (i16)glm::packSnorm1x16(normalized.y),
+                        (i16)glm::packSnorm1x16(normalized.z),
+                        0
+                    };
+                    memcpy(dst, components, sizeof(components));
+                    break;
+                }
+                case ATTRIBUTE_NORMAL:
+                case ATTRIBUTE_TANGENT:
+                case ATTRIBUTE_BITANGENT:
+                {
+                    vec3 direction = vec3(value[0], value[1], value[2]);
+                    u32 encoded = glm::length(direction) > 0.0f ? glm::packSnorm2x16(OctEncode(glm::normalize(direction))) : 0;
+                    memcpy(dst, &encoded, sizeof(encoded));
+                    break;
+                }
+                case ATTRIBUTE_TEXCOORD:
+                {
+                    u32 encoded = glm::packHalf2x16(vec2(value[0], value[1]));
+                    memcpy(dst, &encoded, sizeof(encoded));
+                    break;
+                }
+                default:
+                    memcpy(dst, value, source.attributes[i].componenetCount * sizeof(float));
+                    break;
+            }
+        }
+    }
+
+    // 16 bit indices whenever the submesh is small enough
+    if (vertexCount <= 65536)
+    {
+        packed.indexType = GL_UNSIGNED_SHORT;
+        packed.indices.resize(submesh.indices.size() * sizeof(u16));
+        u16* indices = (u16*)packed.indices.data();
+        for (u32 i = 0; i < submesh.indices.size(); ++i)
+            indices[i] = (u16)submesh.indices[i];
+    }
+    else
+    {
+        packed.indexType = GL_UNSIGNED_INT;
+        PushBytes(packed.indices, submesh.indices.data(), (u32)(submesh.indices.size() * sizeof(u32)));
+    }
+}
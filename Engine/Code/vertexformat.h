@@ -0,0 +1,39 @@
+//
+// vertexformat.h: Packs the float vertices produced by the importers into the layout that
+// is uploaded to the GPU. The compact layout takes 24 bytes per vertex instead of 56:
+//
+//   location 0  position   snorm16 x3 (+2 bytes padding), relative to the submesh bounds
+//   location 1  normal     snorm16 x2, octahedral
+//   location 2  texcoord   half x2
+//   location 3  tangent    snorm16 x2, octahedral
+//   location 4  bitangent  snorm16 x2, octahedral
+//
+// Shaders get positions back with aPosition * positionScale + positionOffset and decode
+// normals with OctDecode when octahedralNormals is set (see Submesh).
+//
+
+#pragma once
+#include "engine.h"
+
+struct PackedSubmesh
+{
+    VertexBufferLayout layout;
+    std::vector<u8>    vertices;
+    std::vector<u8>    indices;
+    GLenum             indexType;
+    vec3               positionScale;
+    vec3               positionOffset;
+};
+
+/**
+ * Converts a submesh with the float layout of the importers. With compact set, attributes
+ * are quantized as described above and indices use 16 bits when every index fits.
+ */
+void PackSubmesh(const Submesh& submesh, bool compact, PackedSubmesh& packed);
+
+u32 GetIndexSize(GLenum indexType);
+
+/**
+ * True if the normal attribute of the layout stores octahedral encoded normals.
+ */
+bool HasOctahedralNormals(const VertexBufferLayout& layout);
@@ -9,52 +9,80 @@ layout(location=0) in vec3 aPosition;
 layout (location = 1) in vec3 aNormal;
 layout(location=2) in vec2 aTexCoord;
 
-out vec3 FragPos;
 out vec2 vTexCoord;
 out vec3 Normal;
-out vec3 FFragPos;
-out vec3 FNormal;
 
 uniform mat4 view;
 uniform mat4 projection;
-uniform mat4 model;
+// Per object data laid out as InstanceData in engine.h. Compact vertices store positions
+// relative to the submesh bounds, positionScale and positionOffset bring them back.
+#ifdef INSTANCED
+layout(location=5) in mat4 aInstanceModel;
+layout(location=9) in vec4 aInstanceColor;
+layout(location=10) in vec4 aInstancePositionScale;
+layout(location=11) in vec4 aInstancePositionOffset;
+#define model aInstanceModel
+#define instanceColor aInstanceColor
+#define positionScale aInstancePositionScale.xyz
+#define positionOffset aInstancePositionOffset.xyz
+#else
+layout(binding = 2, std140) uniform LocalParams
+{
+	mat4 uModel;
+	vec4 uColor;
+	vec4 uPositionScale;
+	vec4 uPositionOffset;
+};
+#define model uModel
+#define instanceColor uColor
+#define positionScale uPositionScale.xyz
+#define positionOffset uPositionOffset.xyz
+#endif
+flat out vec4 vInstanceColor;
+uniform bool octahedralNormals;
+
+vec3 OctDecode(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
 void main(){
+	vInstanceColor = instanceColor;
+	vec3 position = aPosition * positionScale + positionOffset;
+	vec3 normal = octahedralNormals ? OctDecode(aNormal.xy) : aNormal;
 	vTexCoord=aTexCoord;
-	vec4 worldPoss = view * model * vec4(aPosition, 1.0);
-	vec4 worldPos =  model * vec4(aPosition, 1.0);
-	FFragPos = worldPoss.xyz;
-	FragPos = worldPos.xyz;
+	vec4 worldPos =  model * vec4(position, 1.0);
 
-	mat3 normalMatrixs = transpose(inverse(mat3(view*model)));
 	mat3 normalMatrix = transpose(inverse(mat3(model)));
-	FNormal=normalMatrixs* aNormal;
-    Normal = normalMatrix * aNormal;
-	gl_Position = projection* worldPoss;
+    Normal = normalMatrix * normal;
+	gl_Position = projection * view * worldPos;
 }
 #elif defined(FRAGMENT) ///////////////////////////////////////////////
 
 in vec2 vTexCoord;
 
-in vec3 FragPos;
 in vec3 Normal;
-in vec3 FFragPos;
-in vec3 FNormal;
-layout (location = 0) out vec3 gPosition;
-layout (location = 1) out vec3 gNormal;
-layout (location = 2) out vec4 gAlbedoSpec;
-layout (location = 3) out vec4 gDepth;
-layout (location = 4) out vec3 ggPosition;
-layout (location = 5) out vec3 ggNormal;
-uniform int lightAffected;
-uniform vec3 ColorToPass;
+// Positions come from the depth buffer, a specular of 1 marks unlit pixels
+layout (location = 0) out vec2 gNormal;
+layout (location = 1) out vec4 gAlbedoSpec;
+flat in vec4 vInstanceColor;
+#define lightAffected int(vInstanceColor.a)
+#define ColorToPass vInstanceColor.rgb
+// World space normal in [0, 1] for the RG16 target of the G-buffer
+vec2 OctEncode(vec3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	vec2 e = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return e * 0.5 + 0.5;
+}
 void main(){
-	gPosition = FragPos;
-	gNormal = normalize(Normal);
-	gAlbedoSpec = vec4(1);
-	ggPosition = FFragPos;
-	ggNormal = normalize(FNormal);
+	gNormal = OctEncode(normalize(Normal));
+	gAlbedoSpec = vec4(1.0, 1.0, 1.0, 254.0 / 255.0);
 	if(lightAffected == 0){
-		gNormal= vec3(-1);
 		gAlbedoSpec = vec4(ColorToPass,1.0);
 		
 	}
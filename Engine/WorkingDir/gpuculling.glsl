@@ -0,0 +1,206 @@
+///////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////
+#ifdef GPU_CULLING
+
+#if defined(COMPUTE) //////////////////////////////////////////////////
+
+// One invocation per draw, see gpudriven.h for the C++ side of these structs
+layout(local_size_x = 64) in;
+
+#define MAX_LODS 5
+
+struct GpuObject
+{
+	mat4 model;
+	vec4 color;
+};
+
+struct LodRange
+{
+	uint  indexCount;
+	uint  firstIndex;
+	float error;
+	uint  padding;
+};
+
+struct GpuDraw
+{
+	vec4     bounds; // object space sphere
+	vec4     positionScale;
+	vec4     positionOffset;
+	uint     objectIdx;
+	int      baseVertex;
+	uint     lodCount;
+	uint     padding;
+	LodRange lods[MAX_LODS];
+};
+
+struct DrawCommand
+{
+	uint count;
+	uint instanceCount;
+	uint firstIndex;
+	int  baseVertex;
+	uint baseInstance;
+};
+
+struct InstanceData
+{
+	mat4 model;
+	vec4 color;
+	vec4 positionScale;
+	vec4 positionOffset;
+};
+
+layout(std430, binding = 0) readonly buffer Objects { GpuObject objects[]; };
+layout(std430, binding = 1) readonly buffer Draws { GpuDraw draws[]; };
+layout(std430, binding = 2) writeonly buffer Commands { DrawCommand commands[]; };
+layout(std430, binding = 3) writeonly buffer Instances { InstanceData instances[]; };
+layout(std430, binding = 4) buffer Visibility { uint visibility[]; };
+
+layout(binding = 0) uniform sampler2D depthPyramid;
+
+// Same values as GpuCullingPhase
+#define PHASE_ALL   0u // frustum only
+#define PHASE_EARLY 1u // draws that were visible last frame
+#define PHASE_LATE  2u // draws that became visible, against the pyramid of the early ones
+
+uniform vec4 frustumPlanes[6];
+uniform vec3 cameraPosition;
+uniform float pixelsPerUnit;
+uniform float lodPixelError; // 0 keeps every draw at full detail
+uniform uint drawCount;
+uniform uint cullingPhase;
+uniform mat4 view;
+uniform mat4 projection;
+
+// Screen rectangle of a view space sphere in NDC, 2D Polyhedral Bounds of a Clipped,
+// Perspective-Projected 3D Sphere (Mara, McGuire 2013). center.z is the distance in front
+// of the camera. False when the sphere crosses the near plane.
+bool ProjectSphere(vec3 center, float radius, float zNear, out vec4 rect)
+{
+	if (center.z < radius + zNear)
+		return false;
+
+	vec2 cx = -center.xz;
+	vec2 vx = vec2(sqrt(dot(cx, cx) - radius * radius), radius);
+	vec2 minX = mat2(vx.x, vx.y, -vx.y, vx.x) * cx;
+	vec2 maxX = mat2(vx.x, -vx.y, vx.y, vx.x) * cx;
+
+	vec2 cy = -center.yz;
+	vec2 vy = vec2(sqrt(dot(cy, cy) - radius * radius), radius);
+	vec2 minY = mat2(vy.x, vy.y, -vy.y, vy.x) * cy;
+	vec2 maxY = mat2(vy.x, -vy.y, vy.y, vy.x) * cy;
+
+	rect = vec4(minX.x / minX.y * projection[0][0], minY.x / minY.y * projection[1][1],
+	            maxX.x / maxX.y * projection[0][0], maxY.x / maxY.y * projection[1][1]);
+	return true;
+}
+
+bool IsSphereOccluded(vec3 worldCenter, float radius)
+{
+	vec3 viewCenter = (view * vec4(worldCenter, 1.0)).xyz;
+	vec3 center = vec3(viewCenter.xy, -viewCenter.z);
+	float zNear = projection[3][2] / (projection[2][2] - 1.0);
+
+	vec4 rect;
+	if (!ProjectSphere(center, radius, zNear, rect))
+		return false;
+	vec4 uv = clamp(rect * 0.5 + 0.5, 0.0, 1.0);
+
+	// At this level the rectangle covers at most 2x2 texels
+	vec2 size = (uv.zw - uv.xy) * vec2(textureSize(depthPyramid, 0));
+	int level = clamp(int(ceil(log2(max(max(size.x, size.y), 1.0)))), 0, textureQueryLevels(depthPyramid) - 1);
+	ivec2 levelSize = textureSize(depthPyramid, level);
+	ivec2 texelMin = clamp(ivec2(uv.xy * vec2(levelSize)), ivec2(0), levelSize - 1);
+	ivec2 texelMax = clamp(ivec2(uv.zw * vec2(levelSize)), ivec2(0), levelSize - 1);
+	float depth = max(max(texelFetch(depthPyramid, texelMin, level).x, texelFetch(depthPyramid, ivec2(texelMax.x, texelMin.y), level).x),
+	                  max(texelFetch(depthPyramid, ivec2(texelMin.x, texelMax.y), level).x, texelFetch(depthPyramid, texelMax, level).x));
+
+	vec4 nearest = projection * vec4(0.0, 0.0, radius - center.z, 1.0);
+	return nearest.z / nearest.w * 0.5 + 0.5 > depth;
+}
+
+void main()
+{
+	uint drawIdx = gl_GlobalInvocationID.x;
+	if (drawIdx >= drawCount)
+		return;
+
+	GpuDraw draw = draws[drawIdx];
+	GpuObject object = objects[draw.objectIdx];
+
+	float scale = max(length(object.model[0].xyz), max(length(object.model[1].xyz), length(object.model[2].xyz)));
+	vec3 center = (object.model * vec4(draw.bounds.xyz, 1.0)).xyz;
+	float radius = draw.bounds.w * scale;
+
+	bool visible = true;
+	for (int i = 0; i < 6; ++i)
+		visible = visible && dot(frustumPlanes[i].xyz, center) + frustumPlanes[i].w >= -radius;
+
+	// The late phase only draws what the early one skipped, and remembers it for the next frame
+	bool submit = visible;
+	if (cullingPhase == PHASE_EARLY)
+	{
+		submit = visible && visibility[drawIdx] != 0u;
+	}
+	else if (cullingPhase == PHASE_LATE)
+	{
+		visible = visible && !IsSphereOccluded(center, radius);
+		submit = visible && visibility[drawIdx] == 0u;
+		visibility[drawIdx] = visible ? 1u : 0u;
+	}
+
+	// Same screen space error metric as SelectLod, without the hysteresis
+	float pixelsPerError = pixelsPerUnit * scale / max(distance(object.model[3].xyz, cameraPosition), 0.0001);
+	uint lod = 0;
+	while (lod + 1 < draw.lodCount && draw.lods[lod + 1].error * pixelsPerError < lodPixelError)
+		lod++;
+
+	// Culled draws stay in place with no instances, the multi draw skips them
+	commands[drawIdx] = DrawCommand(draw.lods[lod].indexCount, submit ? 1u : 0u, draw.lods[lod].firstIndex, draw.baseVertex, drawIdx);
+	instances[drawIdx] = InstanceData(object.model, object.color, draw.positionScale, draw.positionOffset);
+}
+
+#endif
+#endif
+
+///////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////
+#ifdef DEPTH_PYRAMID
+
+#if defined(COMPUTE) //////////////////////////////////////////////////
+
+// One invocation per texel of the level being written, see depthpyramid.h
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(binding = 0) uniform sampler2D sourceDepth;
+layout(binding = 0, r32f) uniform writeonly image2D destination;
+
+uniform int sourceLevel;
+
+void main()
+{
+	ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+	ivec2 destinationSize = imageSize(destination);
+	if (any(greaterThanEqual(texel, destinationSize)))
+		return;
+
+	// Level 0 is not a power of two away from the depth buffer, its texels cover up to 3x3
+	ivec2 sourceSize = textureSize(sourceDepth, sourceLevel);
+	vec2 ratio = vec2(sourceSize) / vec2(destinationSize);
+	ivec2 begin = ivec2(floor(vec2(texel) * ratio));
+	ivec2 end = min(ivec2(ceil(vec2(texel + 1) * ratio)), sourceSize);
+
+	float depth = 0.0;
+	for (int y = begin.y; y < end.y; ++y)
+		for (int x = begin.x; x < end.x; ++x)
+			depth = max(depth, texelFetch(sourceDepth, ivec2(x, y), sourceLevel).x);
+
+	imageStore(destination, texel, vec4(depth));
+}
+
+#endif
+#endif
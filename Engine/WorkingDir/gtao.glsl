@@ -0,0 +1,151 @@
+///////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////
+#ifdef GTAO
+
+#if defined(COMPUTE) //////////////////////////////////////////////////
+
+// One invocation per pixel at ssaoDivisor of the display resolution, see gtao.h
+layout(local_size_x = 8, local_size_y = 8) in;
+
+#define PI                        3.14159265
+#define GTAO_TEMPORAL_ROTATIONS   6     // frames before the slice directions repeat
+#define GTAO_HISTORY_WEIGHT       0.9
+#define GTAO_REJECTION_TOLERANCE  0.05  // relative view depth difference that drops the history
+#define GTAO_MAX_PIXEL_RADIUS     128.0 // display pixels
+
+layout(binding = 0) uniform sampler2D gDepth;
+layout(binding = 1) uniform sampler2D gNormal;
+layout(binding = 2) uniform sampler2D history;       // occlusion and view depth of the last frame
+layout(binding = 0, rg16f) uniform writeonly image2D destination;
+
+uniform mat4 previousViewProjection;
+uniform uint gtaoSliceCount;
+uniform uint gtaoStepCount;  // per side of every slice
+uniform float gtaoRadius;    // view space
+uniform uint frameIndex;
+uniform bool historyValid;
+uniform int ssaoDivisor;
+
+layout(binding = 0, std140) uniform GlobalParams
+{
+	vec3 uCameraPosition;
+	mat4 projectionMat;
+	mat4 projectionMatInv;
+	mat4 viewMat;
+	mat4 viewMatInv;
+};
+
+const float bayer4x4[16] = float[](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+
+vec3 ReconstructViewPosition(vec2 uv, float depth)
+{
+	vec4 posView = projectionMatInv * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+	return posView.xyz / posView.w;
+}
+vec3 OctDecode(vec2 e)
+{
+	e = e * 2.0 - 1.0;
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
+// Highest cosine between the view vector and the samples along one side of a slice,
+// samples fade towards the lowest horizon as they get out of the radius
+float FindHorizonCos(vec2 uv, vec2 direction, vec3 position, vec3 viewVec, float stepPixels, float jitter, vec2 depthSize)
+{
+	float horizonCos = -1.0;
+	for (uint i = 0u; i < gtaoStepCount; ++i)
+	{
+		vec2 sampleUV = uv + direction * max((float(i) + jitter) * stepPixels, 1.0) / depthSize;
+		if (any(lessThan(sampleUV, vec2(0.0))) || any(greaterThan(sampleUV, vec2(1.0))))
+			break;
+
+		vec3 delta = ReconstructViewPosition(sampleUV, textureLod(gDepth, sampleUV, 0.0).r) - position;
+		float distance = length(delta);
+		float falloff = clamp(2.0 - 2.0 * distance / gtaoRadius, 0.0, 1.0);
+		horizonCos = max(horizonCos, mix(-1.0, dot(delta, viewVec) / max(distance, 1e-4), falloff));
+	}
+	return horizonCos;
+}
+
+void main()
+{
+	ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+	ivec2 size = imageSize(destination);
+	if (any(greaterThanEqual(pixel, size)))
+		return;
+
+	ivec2 depthSize = textureSize(gDepth, 0);
+	ivec2 fullPixel = min(pixel * ssaoDivisor + ssaoDivisor / 2, depthSize - 1);
+	float depth = texelFetch(gDepth, fullPixel, 0).r;
+	if (depth == 1.0)
+	{
+		// A view depth of 0 never matches, the next frame starts over here
+		imageStore(destination, pixel, vec4(1.0, 0.0, 0.0, 0.0));
+		return;
+	}
+
+	vec2 uv = (vec2(fullPixel) + 0.5) / vec2(depthSize);
+	vec3 position = ReconstructViewPosition(uv, depth);
+	vec3 viewVec = normalize(-position);
+	vec3 normal = normalize(mat3(viewMat) * OctDecode(texelFetch(gNormal, fullPixel, 0).rg));
+
+	float pixelRadius = min(gtaoRadius * projectionMat[1][1] * 0.5 * float(depthSize.y) / -position.z, GTAO_MAX_PIXEL_RADIUS);
+	float stepPixels = pixelRadius / float(gtaoStepCount);
+
+	// Slices rotate with the frame and across a 4x4 tile, steps start at a jittered distance
+	float spatial = bayer4x4[(pixel.y & 3) * 4 + (pixel.x & 3)] / 16.0;
+	float temporal = float(frameIndex % uint(GTAO_TEMPORAL_ROTATIONS)) / float(GTAO_TEMPORAL_ROTATIONS);
+	float rotation = fract(spatial + temporal);
+	float jitter = fract(spatial + float(frameIndex) * 0.618034);
+
+	float visibility = 0.0;
+	for (uint slice = 0u; slice < gtaoSliceCount; ++slice)
+	{
+		float phi = (float(slice) + rotation) * PI / float(gtaoSliceCount);
+		vec2 direction = vec2(cos(phi), sin(phi));
+
+		// Normal projected onto the slice plane and its angle from the view vector
+		vec3 directionVec = vec3(direction, 0.0);
+		vec3 orthoDirectionVec = directionVec - dot(directionVec, viewVec) * viewVec;
+		vec3 axisVec = normalize(cross(orthoDirectionVec, viewVec));
+		vec3 projectedNormal = normal - axisVec * dot(normal, axisVec);
+		float projectedLength = length(projectedNormal);
+		float cosN = clamp(dot(projectedNormal, viewVec) / max(projectedLength, 1e-4), 0.0, 1.0);
+		float n = sign(dot(orthoDirectionVec, projectedNormal)) * acos(cosN);
+
+		float h0 = -acos(FindHorizonCos(uv, -direction, position, viewVec, stepPixels, jitter, vec2(depthSize)));
+		float h1 = acos(FindHorizonCos(uv, direction, position, viewVec, stepPixels, jitter, vec2(depthSize)));
+		h0 = n + max(h0 - n, -PI * 0.5);
+		h1 = n + min(h1 - n, PI * 0.5);
+
+		// Cosine weighted visible arc between both horizons
+		float sinN = sin(n);
+		float arc0 = -cos(2.0 * h0 - n) + cosN + 2.0 * h0 * sinN;
+		float arc1 = -cos(2.0 * h1 - n) + cosN + 2.0 * h1 * sinN;
+		visibility += projectedLength * 0.25 * (arc0 + arc1);
+	}
+	visibility = clamp(visibility / float(gtaoSliceCount), 0.0, 1.0);
+
+	// Blend with the history where it saw the same surface
+	float occlusion = visibility;
+	vec4 previousClip = previousViewProjection * (viewMatInv * vec4(position, 1.0));
+	if (historyValid && previousClip.w > 0.0)
+	{
+		vec2 previousUV = previousClip.xy / previousClip.w * 0.5 + 0.5;
+		if (all(greaterThanEqual(previousUV, vec2(0.0))) && all(lessThan(previousUV, vec2(1.0))))
+		{
+			vec2 previous = texelFetch(history, ivec2(previousUV * vec2(size)), 0).rg;
+			if (abs(previous.g - previousClip.w) < GTAO_REJECTION_TOLERANCE * previousClip.w)
+				occlusion = mix(visibility, previous.r, GTAO_HISTORY_WEIGHT);
+		}
+	}
+	imageStore(destination, pixel, vec4(occlusion, -position.z, 0.0, 0.0));
+}
+
+#endif
+#endif
@@ -0,0 +1,181 @@
+///////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////
+#ifdef LIGHT_CLUSTERING
+
+#if defined(COMPUTE) //////////////////////////////////////////////////
+
+// One invocation per cluster, see lighting.h for the C++ side
+layout(local_size_x = 64) in;
+
+#define CLUSTER_GRID_X     16
+#define CLUSTER_GRID_Y     9
+#define CLUSTER_GRID_Z     24
+#define CLUSTER_COUNT      (CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z)
+#define CLUSTER_MAX_LIGHTS 128
+
+struct Light
+{
+	vec4 positionRange;
+	vec4 colorIntensity;
+	vec4 directionCosAngle;
+};
+
+layout(std430, binding = 5) readonly buffer Lights { Light lights[]; };
+layout(std430, binding = 6) writeonly buffer ClusterCounts { uint clusterLightCounts[]; };
+layout(std430, binding = 7) writeonly buffer ClusterIndices { uint clusterLightIndices[]; };
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform uint lightCount;
+uniform uint directionalLightCount; // they come first and reach every cluster
+
+// View space range spheres of the lights the group is testing
+shared vec4 lightSpheres[64];
+
+void main()
+{
+	uint clusterIdx = gl_GlobalInvocationID.x;
+	uvec3 cluster = uvec3(clusterIdx % CLUSTER_GRID_X, (clusterIdx / CLUSTER_GRID_X) % CLUSTER_GRID_Y, clusterIdx / (CLUSTER_GRID_X * CLUSTER_GRID_Y));
+
+	// Box around the corners of the tile at the near and the far depth of its slice
+	float zNear = projection[3][2] / (projection[2][2] - 1.0);
+	float zFar = projection[3][2] / (projection[2][2] + 1.0);
+	float sliceNear = zNear * pow(zFar / zNear, float(cluster.z) / float(CLUSTER_GRID_Z));
+	float sliceFar = zNear * pow(zFar / zNear, float(cluster.z + 1u) / float(CLUSTER_GRID_Z));
+	vec2 gridSize = vec2(CLUSTER_GRID_X, CLUSTER_GRID_Y);
+	vec2 tileMin = (vec2(cluster.xy) / gridSize * 2.0 - 1.0) / vec2(projection[0][0], projection[1][1]);
+	vec2 tileMax = (vec2(cluster.xy + 1u) / gridSize * 2.0 - 1.0) / vec2(projection[0][0], projection[1][1]);
+	vec3 boxMin = vec3(min(tileMin * sliceNear, tileMin * sliceFar), -sliceFar);
+	vec3 boxMax = vec3(max(tileMax * sliceNear, tileMax * sliceFar), -sliceNear);
+
+	// Every invocation loads one light per batch, the whole group runs the same batches
+	uint count = 0u;
+	for (uint first = directionalLightCount; first < lightCount; first += 64u)
+	{
+		uint lightIdx = first + gl_LocalInvocationIndex;
+		if (lightIdx < lightCount)
+			lightSpheres[gl_LocalInvocationIndex] = vec4((view * vec4(lights[lightIdx].positionRange.xyz, 1.0)).xyz, lights[lightIdx].positionRange.w);
+		barrier();
+
+		uint batchSize = min(64u, lightCount - first);
+		for (uint i = 0u; i < batchSize && clusterIdx < CLUSTER_COUNT; ++i)
+		{
+			vec4 sphere = lightSpheres[i];
+			vec3 offset = clamp(sphere.xyz, boxMin, boxMax) - sphere.xyz;
+			if (dot(offset, offset) <= sphere.w * sphere.w && count < CLUSTER_MAX_LIGHTS)
+			{
+				clusterLightIndices[clusterIdx * CLUSTER_MAX_LIGHTS + count] = first + i;
+				count++;
+			}
+		}
+		barrier();
+	}
+
+	if (clusterIdx < CLUSTER_COUNT)
+		clusterLightCounts[clusterIdx] = count;
+}
+
+#endif
+#endif
+
+///////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////
+#ifdef LIGHT_VOLUME
+
+#if defined(VERTEX) ///////////////////////////////////////////////////
+
+// Unit sphere or cone, see lightvolumes.h
+layout(location = 0) in vec3 aPosition;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+	gl_Position = projection * view * model * vec4(aPosition, 1.0);
+}
+
+#elif defined(FRAGMENT) ///////////////////////////////////////////////
+
+#if defined(STENCIL_ONLY)
+
+// Color writes are masked, the stencil is all the pass is after
+void main()
+{
+}
+
+#else
+
+struct Light
+{
+	vec4 positionRange;
+	vec4 colorIntensity;
+	vec4 directionCosAngle;
+};
+
+layout(std430, binding = 5) readonly buffer Lights { Light lights[]; };
+
+uniform sampler2D gDepth;
+uniform sampler2D gNormal;
+uniform sampler2D gAlbedoSpec;
+
+layout(binding = 0, std140) uniform GlobalParams
+{
+	vec3 uCameraPosition;
+	mat4 projectionMat;
+	mat4 projectionMatInv;
+	mat4 viewMat;
+	mat4 viewMatInv;
+};
+
+vec3 OctDecode(vec2 e)
+{
+	e = e * 2.0 - 1.0;
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+uniform uint lightIndex;
+
+layout(location = 0) out vec4 oColor;
+
+void main()
+{
+	// No discard, it would keep the stencil writes from running early
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	vec4 albedoSpec = texelFetch(gAlbedoSpec, pixel, 0);
+	if (albedoSpec.a == 1.0)
+	{
+		oColor = vec4(0.0);
+		return;
+	}
+	vec3 normal = OctDecode(texelFetch(gNormal, pixel, 0).rg);
+
+	// World position from the depth, see quad.glsl
+	vec2 uv = gl_FragCoord.xy / vec2(textureSize(gDepth, 0));
+	vec4 viewPosition = projectionMatInv * vec4(vec3(uv, texelFetch(gDepth, pixel, 0).r) * 2.0 - 1.0, 1.0);
+	vec3 position = (viewMatInv * vec4(viewPosition.xyz / viewPosition.w, 1.0)).xyz;
+
+	// Same shading as the point and spot lights of quad.glsl
+	Light light = lights[lightIndex];
+	vec3 lightDir = normalize(light.positionRange.xyz - position);
+	vec3 viewDir = normalize(uCameraPosition - position);
+	float intensity = dot(lightDir, light.directionCosAngle.xyz) < light.directionCosAngle.w ? 0.0 : light.colorIntensity.w;
+	float distance = length(light.positionRange.xyz - position);
+	float attenuation = intensity / (1.0 + 0.7 * distance + 1.8 * distance * distance);
+
+	vec3 diffuse = max(dot(normal, lightDir), 0.0) * albedoSpec.rgb * light.colorIntensity.rgb;
+	vec3 halfwayDir = normalize(lightDir + viewDir);
+	float spec = pow(max(dot(normal, halfwayDir), 0.0), 16.0);
+	vec3 specular = light.colorIntensity.rgb * spec * albedoSpec.a;
+	oColor = vec4((diffuse + specular) * attenuation, 1.0);
+}
+
+#endif
+#endif
+#endif
@@ -20,155 +20,192 @@ void main()
 
 in vec2 vTexCoord;
 layout(location=0) out vec4 oColor;
-uniform sampler2D gPosition;
+// Compact G-buffer: octahedral world normals, albedo with specular and depth, positions
+// are reconstructed from the depth
 uniform sampler2D gNormal;
 uniform sampler2D gAlbedoSpec;
 uniform sampler2D gDepth;
-uniform sampler2D ggPosition;
-uniform sampler2D ggNormal;
+uniform sampler2D lightAccumulation; // point and spot lights of the light volumes
+uniform sampler2D ssaoOcclusion;    // blurred, one texel per ssaoDivisor pixels (see ssao.h)
+uniform int ssaoDivisor;
 uniform int FinalRenderID;
 
 vec4 fin;
 
-
-// parameters (you'd probably want to use them as uniforms to more easily tweak the effect)
-int kernelSize = 64;
-float radius = 0.1;
-float bias = 0.025;
-
-// tile noise texture over screen based on screen dimensions divided by noise size
-const vec2 noiseScale = vec2(800.0/4.0, 600.0/4.0); 
-
-struct Light
-{
-    int type;
-    vec3 color;
-    vec3 direction;
-    vec3 position;
-    float intensity;
-    float angle;
-};
 layout(binding = 0, std140) uniform GlobalParams
 {
     vec3 uCameraPosition;
     mat4 projectionMat;
     mat4 projectionMatInv;
-    int uLightCount;
-    Light uLight[20];
+    mat4 viewMat;
+    mat4 viewMatInv;
 };
-layout(binding = 1, std140) uniform GlobalParamss
-{
-    float left;
-    float right;
-    float bottom;
-    float top;
-    float znear;
-    float zfar;
-    vec3 samples[64];
 
+// Lights and their clusters, see lighting.h
+#define CLUSTER_GRID_X     16
+#define CLUSTER_GRID_Y     9
+#define CLUSTER_GRID_Z     24
+#define CLUSTER_MAX_LIGHTS 128
+
+struct GpuLight
+{
+    vec4 positionRange;
+    vec4 colorIntensity;
+    vec4 directionCosAngle;
 };
-vec3 ReconstructPixelPosition(float depth,mat4 projectionMatrixInv,vec2 v)
+layout(std430, binding = 5) readonly buffer Lights { GpuLight lights[]; };
+layout(std430, binding = 6) readonly buffer ClusterCounts { uint clusterLightCounts[]; };
+layout(std430, binding = 7) readonly buffer ClusterIndices { uint clusterLightIndices[]; };
+uniform uint lightCount;
+uniform uint directionalLightCount; // they come first
+
+// LightingPath of engine.h
+#define LIGHTING_PATH_ALL_LIGHTS 0
+#define LIGHTING_PATH_CLUSTERED  1
+#define LIGHTING_PATH_VOLUMES    2
+uniform int lightingPath;
+vec3 ReconstructViewPosition(vec2 uv, float depth)
 {
-    float xndc =gl_FragCoord.x / v.x * 2.0 - 1.0;
-    float yndc =gl_FragCoord.y / v.y * 2.0 - 1.0;
-    float zndc =depth * 2.0 - 1.0;
-    vec4 posNDC=vec4(xndc,yndc,zndc,1.0);
-    vec4 posView=projectionMatrixInv * posNDC;
+    vec4 posView = projectionMatInv * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
     return posView.xyz / posView.w;
 }
-
-vec4 ambient(vec3 FFragPos,vec3 FNormal)
+vec3 OctDecode(vec2 e)
 {
-     vec3 tangent = cross(FNormal,vec3(0,1,0));
-     vec3 bitangent = cross(FNormal,tangent);
-     mat3 TBN= mat3(tangent,bitangent,FNormal);
-     float occlusion=0.0;
-     for(int i = 0; i < 64; ++i)
-     {
-        vec3 offsetView=TBN * samples[i];
-        vec3 samplePosView = FFragPos + (offsetView * radius);
-
-        vec4 sampleTexCoord= projectionMat*vec4(samplePosView,1.0);
-        sampleTexCoord.xyz /=sampleTexCoord.w;
-        sampleTexCoord.xyz =sampleTexCoord.xyz * 0.5 + 0.5;
-       
-        float sampledDepth=  texture(gDepth, sampleTexCoord.xy).r;
-        vec2 g=vec2(800,600);
-        vec3 sampledPosView=ReconstructPixelPosition(sampledDepth,projectionMatInv,g);
-        //vec3 sampledPosView= Reco(sampledDepth,left,right,bottom,top,znear,zfar,g);
-        occlusion +=(samplePosView.z<sampledPosView.z-0.02 ? 1.0 :0.0);
-     }
-     return vec4(vec3(1.0-occlusion/64.0),1.0);
+    e = e * 2.0 - 1.0;
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+// Depth aware upsample of the SSAO, the bilinear weights of the four closest texels are
+// scaled down by how far their depth is from the pixel
+#define SSAO_UPSAMPLE_DEPTH_TOLERANCE 0.05 // relative to the view depth
 
+float GetSsaoTexelDepth(ivec2 ssaoPixel)
+{
+    ivec2 pixel = min(ssaoPixel * ssaoDivisor + ssaoDivisor / 2, textureSize(gDepth, 0) - 1);
+    float depth = texelFetch(gDepth, pixel, 0).r;
+    return projectionMat[3][2] / (depth * 2.0 - 1.0 + projectionMat[2][2]);
+}
+vec4 ambient(vec2 uv, float viewDepth)
+{
+    ivec2 size = textureSize(ssaoOcclusion, 0);
+    vec2 position = uv * vec2(size) - 0.5;
+    ivec2 base = ivec2(floor(position));
+    vec2 f = fract(position);
+
+    float sum = 0.0;
+    float weightSum = 0.0;
+    float nearestOcclusion = 1.0;
+    float nearestDifference = 1e30;
+    for (int i = 0; i < 4; ++i)
+    {
+        ivec2 offset = ivec2(i & 1, i >> 1);
+        ivec2 texel = clamp(base + offset, ivec2(0), size - 1);
+        float occlusion = texelFetch(ssaoOcclusion, texel, 0).r;
+        float depthDifference = abs(GetSsaoTexelDepth(texel) - viewDepth);
+        vec2 bilinear = mix(1.0 - f, f, vec2(offset));
+        float weight = bilinear.x * bilinear.y * max(1.0 - depthDifference / (viewDepth * SSAO_UPSAMPLE_DEPTH_TOLERANCE), 0.0);
+        sum += occlusion * weight;
+        weightSum += weight;
+        if (depthDifference < nearestDifference)
+        {
+            nearestDifference = depthDifference;
+            nearestOcclusion = occlusion;
+        }
+    }
+    // Thin features no texel landed on take the closest depth
+    float occlusion = weightSum > 1e-4 ? sum / weightSum : nearestOcclusion;
+    return vec4(vec3(occlusion), 1.0);
+}
+uint GetClusterIndex(vec2 uv, float viewDepth)
+{
+    float zNear = projectionMat[3][2] / (projectionMat[2][2] - 1.0);
+    float zFar = projectionMat[3][2] / (projectionMat[2][2] + 1.0);
+    float slice = log(viewDepth / zNear) / log(zFar / zNear) * float(CLUSTER_GRID_Z);
+    uvec3 cluster = uvec3(clamp(uv * vec2(CLUSTER_GRID_X, CLUSTER_GRID_Y), vec2(0.0), vec2(CLUSTER_GRID_X - 1, CLUSTER_GRID_Y - 1)),
+                          clamp(slice, 0.0, float(CLUSTER_GRID_Z - 1)));
+    return cluster.x + (cluster.y + cluster.z * CLUSTER_GRID_Y) * CLUSTER_GRID_X;
+}
+vec3 ShadeLight(GpuLight light, bool directional, vec3 FFragPos, vec3 FNormal, vec3 FDiffuse, float FSpecular)
+{
+    vec3 lightDir;
+    vec3 viewDir;
+    float attenuation;
+    if (directional)
+    {
+        lightDir = -light.directionCosAngle.xyz;
+        viewDir = vec3(0.0);
+        attenuation = light.colorIntensity.w;
+    }
+    else
+    {
+        lightDir = normalize(light.positionRange.xyz - FFragPos);
+        viewDir = normalize(uCameraPosition - FFragPos);
+        // Point lights have a cosine below any dot product
+        float intensity = dot(lightDir, light.directionCosAngle.xyz) < light.directionCosAngle.w ? 0.0 : light.colorIntensity.w;
+        float distance = length(light.positionRange.xyz - FFragPos);
+        attenuation = intensity / (1.0 + 0.7 * distance + 1.8 * distance * distance);
+    }
 
+    vec3 diffuse = max(dot(FNormal, lightDir), 0.0) * FDiffuse * light.colorIntensity.rgb;
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+    float spec = pow(max(dot(FNormal, halfwayDir), 0.0), 16.0);
+    vec3 specular = light.colorIntensity.rgb * spec * FSpecular;
+    return (diffuse + specular) * attenuation;
 }
 vec4 LightRender(vec3 FFragPos,vec3 FNormal,vec3 FDiffuse,float FSpecular)
 {
-    vec3 lighting  = FDiffuse * 0.1; // hard-coded ambient component
-    vec3 viewDir  = normalize(uCameraPosition - FFragPos);
-    vec3 halfwayDir;
-    for(int i = 0; i < uLightCount; ++i)
+    vec3 lighting = FDiffuse * 0.1; // hard-coded ambient component
+    for (uint i = 0u; i < lightCount; ++i)
+        lighting += ShadeLight(lights[i], i < directionalLightCount, FFragPos, FNormal, FDiffuse, FSpecular);
+    return vec4(lighting, 1.0);
+}
+// Same shading as LightRender, over the directional lights and the lights of the pixel cluster
+vec4 LightRenderClustered(vec3 FFragPos,vec3 FNormal,vec3 FDiffuse,float FSpecular,float viewDepth)
+{
+    vec3 lighting = FDiffuse * 0.1; // hard-coded ambient component
+    for (uint i = 0u; i < directionalLightCount; ++i)
+        lighting += ShadeLight(lights[i], true, FFragPos, FNormal, FDiffuse, FSpecular);
+
+    uint clusterIdx = GetClusterIndex(vTexCoord, viewDepth);
+    uint clusterLightCount = clusterLightCounts[clusterIdx];
+    for (uint i = 0u; i < clusterLightCount; ++i)
     {
-        float inten=uLight[i].intensity;
-        float attenuation;
-         // diffuse
-         vec3 lightDir = normalize(uLight[i].position - FFragPos);
-
-         if(uLight[i].type == 0)
-         {
-            lightDir = -normalize(uLight[i].direction);
-            attenuation=uLight[i].intensity;
-            viewDir=vec3(0.0);
-
-         }else if(uLight[i].type == 2){
-         
-            vec3 v2 = normalize(uLight[i].direction);
-            float dot_product = dot(lightDir, v2);
-            float mag1 = length(lightDir);
-            float mag2 = length(v2);
-            float ResultAngle = degrees(acos(dot_product / (mag1 * mag2)));
-            if(ResultAngle>uLight[i].angle)
-            {
-                inten=0;
-            }
-         
-         }
-
-
-         vec3 diffuse = (max(dot(FNormal, lightDir), 0.0) * FDiffuse * uLight[i].color);
-         // specular
-         halfwayDir = normalize(lightDir + viewDir);  
-         float spec = pow(max(dot(FNormal, halfwayDir), 0.0), 16.0);
-         vec3 specular = uLight[i].color * spec * FSpecular;
-         // attenuation
-
-         
-         if(uLight[i].type != 0)
-         {
-            float distance = length(uLight[i].position - FFragPos);
-            attenuation = inten / (1.0 + 0.7 * distance + 1.8 * distance * distance);
-         }
-         
-
-         diffuse *= attenuation;
-         specular *= attenuation;
-         lighting += diffuse + specular;        
-     }
-    
-    
-     return vec4(lighting,1.0);
-     
+        uint lightIdx = clusterLightIndices[clusterIdx * CLUSTER_MAX_LIGHTS + i];
+        lighting += ShadeLight(lights[lightIdx], false, FFragPos, FNormal, FDiffuse, FSpecular);
+    }
+    return vec4(lighting, 1.0);
+}
+// The light volumes have accumulated the rest of the lights already
+vec4 LightRenderVolumes(vec3 FFragPos,vec3 FNormal,vec3 FDiffuse,float FSpecular)
+{
+    vec3 lighting = FDiffuse * 0.1 + texelFetch(lightAccumulation, ivec2(gl_FragCoord.xy), 0).rgb;
+    for (uint i = 0u; i < directionalLightCount; ++i)
+        lighting += ShadeLight(lights[i], true, FFragPos, FNormal, FDiffuse, FSpecular);
+    return vec4(lighting, 1.0);
+}
+vec4 LightRenderPath(vec3 FragPos,vec3 Normal,vec3 Diffuse,float Specular,float viewDepth)
+{
+    if (lightingPath == LIGHTING_PATH_CLUSTERED)
+        return LightRenderClustered(FragPos,Normal,Diffuse,Specular,viewDepth);
+    if (lightingPath == LIGHTING_PATH_VOLUMES)
+        return LightRenderVolumes(FragPos,Normal,Diffuse,Specular);
+    return LightRender(FragPos,Normal,Diffuse,Specular);
 }
 
 void main(){
 
-    vec3 FragPos = texture(gPosition, vTexCoord).rgb;
-    vec3 Normal = texture(gNormal, vTexCoord).rgb;
-     vec3 FFragPos = texture(ggPosition, vTexCoord).rgb;
-    vec3 FNormal = texture(ggNormal, vTexCoord).rgb;
-    vec3 Diffuse = texture(gAlbedoSpec, vTexCoord).rgb;
-    float Specular = texture(gAlbedoSpec, vTexCoord).a;
-    vec3 depht = texture(gDepth, vTexCoord).rgb;
+    float depth = texture(gDepth, vTexCoord).r;
+    vec3 FFragPos = ReconstructViewPosition(vTexCoord, depth);
+    vec3 FragPos = (viewMatInv * vec4(FFragPos, 1.0)).xyz;
+    vec3 Normal = OctDecode(texture(gNormal, vTexCoord).rg);
+    vec4 AlbedoSpec = texture(gAlbedoSpec, vTexCoord);
+    vec3 Diffuse = AlbedoSpec.rgb;
+    float Specular = AlbedoSpec.a;
+    bool lit = AlbedoSpec.a < 1.0; // unlit objects and the background keep a specular of 1
     if(FinalRenderID == 0){
         fin =vec4(Diffuse,1.0);
     }
@@ -181,7 +218,7 @@ void main(){
     }else if(FinalRenderID == 3){
    
         
-        float normalizedDepth =1.0- depht.r;
+        float normalizedDepth =1.0- depth;
         
 
         vec3 grayscaleColor = vec3(normalizedDepth);
@@ -190,20 +227,20 @@ void main(){
     else if(FinalRenderID == 4)
     {       
         
-        fin=ambient(FFragPos,FNormal);
+        fin=ambient(vTexCoord,-FFragPos.z);
         
     }else if(FinalRenderID == 5)
     {
-        if(Normal.x != -1){
-            fin = LightRender(FragPos,Normal,Diffuse,Specular);
+        if(lit){
+            fin = LightRenderPath(FragPos,Normal,Diffuse,Specular,-FFragPos.z);
         }else
         {
             fin =vec4(Diffuse,1.0);
         }
 
     }else{
-        if(Normal.x != -1){
-            fin = LightRender(FragPos,Normal,Diffuse,Specular)*ambient(FFragPos,FNormal);
+        if(lit){
+            fin = LightRenderPath(FragPos,Normal,Diffuse,Specular,-FFragPos.z)*ambient(vTexCoord,-FFragPos.z);
         }else
         {
             fin =vec4(Diffuse,1.0);
@@ -0,0 +1,168 @@
+///////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////
+#ifdef SSAO
+
+#if defined(VERTEX) ///////////////////////////////////////////////////
+
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoords;
+
+void main()
+{
+	gl_Position = vec4(aPos, 1.0);
+}
+
+#elif defined(FRAGMENT) ///////////////////////////////////////////////
+
+// Occlusion of the G-buffer texel at the center of each block of ssaoDivisor pixels,
+// see ssao.h for the C++ side
+uniform sampler2D gDepth;
+uniform sampler2D gNormal;
+uniform sampler2D noiseTexture;
+uniform uint ssaoSampleCount;
+uniform float ssaoRadius;
+uniform float ssaoBias;
+uniform int ssaoDivisor;
+
+layout(binding = 0, std140) uniform GlobalParams
+{
+	vec3 uCameraPosition;
+	mat4 projectionMat;
+	mat4 projectionMatInv;
+	mat4 viewMat;
+	mat4 viewMatInv;
+};
+layout(binding = 1, std140) uniform GlobalParamss
+{
+	float left;
+	float right;
+	float bottom;
+	float top;
+	float znear;
+	float zfar;
+	vec3 samples[64];
+};
+
+layout(location = 0) out float oOcclusion;
+
+vec3 ReconstructViewPosition(vec2 uv, float depth)
+{
+	vec4 posView = projectionMatInv * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+	return posView.xyz / posView.w;
+}
+vec3 OctDecode(vec2 e)
+{
+	e = e * 2.0 - 1.0;
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
+void main()
+{
+	ivec2 pixel = min(ivec2(gl_FragCoord.xy) * ssaoDivisor + ssaoDivisor / 2, textureSize(gDepth, 0) - 1);
+	float depth = texelFetch(gDepth, pixel, 0).r;
+	if (depth == 1.0)
+	{
+		oOcclusion = 1.0;
+		return;
+	}
+
+	vec2 uv = (vec2(pixel) + 0.5) / vec2(textureSize(gDepth, 0));
+	vec3 position = ReconstructViewPosition(uv, depth);
+	vec3 normal = normalize(mat3(viewMat) * OctDecode(texelFetch(gNormal, pixel, 0).rg));
+
+	// The noise tiles over the SSAO pixels, the blur averages its pattern away
+	vec3 randomVec = vec3(texelFetch(noiseTexture, ivec2(gl_FragCoord.xy) & 3, 0).xy, 0.0);
+	vec3 tangent = normalize(randomVec - normal * dot(randomVec, normal));
+	vec3 bitangent = cross(normal, tangent);
+	mat3 TBN = mat3(tangent, bitangent, normal);
+
+	float occlusion = 0.0;
+	for (uint i = 0u; i < ssaoSampleCount; ++i)
+	{
+		vec3 samplePosition = position + TBN * samples[i] * ssaoRadius;
+		vec4 sampleClip = projectionMat * vec4(samplePosition, 1.0);
+		vec2 sampleUV = sampleClip.xy / sampleClip.w * 0.5 + 0.5;
+
+		float sceneZ = ReconstructViewPosition(sampleUV, texture(gDepth, sampleUV).r).z;
+		float rangeCheck = smoothstep(0.0, 1.0, ssaoRadius / abs(position.z - sceneZ));
+		occlusion += (sceneZ >= samplePosition.z + ssaoBias ? 1.0 : 0.0) * rangeCheck;
+	}
+	oOcclusion = 1.0 - occlusion / float(ssaoSampleCount);
+}
+
+#endif
+#endif
+
+///////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////
+#ifdef SSAO_BLUR
+
+#if defined(VERTEX) ///////////////////////////////////////////////////
+
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoords;
+
+void main()
+{
+	gl_Position = vec4(aPos, 1.0);
+}
+
+#elif defined(FRAGMENT) ///////////////////////////////////////////////
+
+// One direction of a separable gaussian, taps across a depth discontinuity are dropped
+uniform sampler2D occlusion;
+uniform sampler2D gDepth;
+uniform ivec2 blurDirection;
+uniform int ssaoDivisor;
+
+layout(binding = 0, std140) uniform GlobalParams
+{
+	vec3 uCameraPosition;
+	mat4 projectionMat;
+	mat4 projectionMatInv;
+	mat4 viewMat;
+	mat4 viewMatInv;
+};
+
+layout(location = 0) out float oOcclusion;
+
+#define BLUR_RADIUS          4
+#define BLUR_DEPTH_TOLERANCE 0.05 // relative to the view depth
+
+const float gaussianWeights[BLUR_RADIUS + 1] = float[](0.227027, 0.194595, 0.121622, 0.054054, 0.016216);
+
+// View depth of the G-buffer texel an SSAO texel was computed at
+float GetLinearDepth(ivec2 ssaoPixel)
+{
+	ivec2 pixel = min(ssaoPixel * ssaoDivisor + ssaoDivisor / 2, textureSize(gDepth, 0) - 1);
+	float depth = texelFetch(gDepth, pixel, 0).r;
+	return projectionMat[3][2] / (depth * 2.0 - 1.0 + projectionMat[2][2]);
+}
+
+void main()
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	ivec2 size = textureSize(occlusion, 0);
+	float centerDepth = GetLinearDepth(pixel);
+
+	float sum = 0.0;
+	float weightSum = 0.0;
+	for (int i = -BLUR_RADIUS; i <= BLUR_RADIUS; ++i)
+	{
+		ivec2 tap = clamp(pixel + blurDirection * i, ivec2(0), size - 1);
+		float depthDifference = abs(GetLinearDepth(tap) - centerDepth) / (centerDepth * BLUR_DEPTH_TOLERANCE);
+		float weight = gaussianWeights[abs(i)] * max(1.0 - depthDifference, 0.0);
+		sum += texelFetch(occlusion, tap, 0).r * weight;
+		weightSum += weight;
+	}
+	oOcclusion = sum / weightSum; // the center tap always has weight
+}
+
+#endif
+#endif